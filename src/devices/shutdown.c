@@ -4,7 +4,9 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/highmem.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -13,6 +15,14 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/reclaim.h"
+#include "vm/swap.h"
+#include "vm/pagein.h"
+#include "vm/flush.h"
+#include "vm/pff.h"
+#include "vm/vmstat.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -122,6 +132,8 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  highmem_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -130,4 +142,12 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  vmstat_print_stats ();
+  reclaim_print_stats ();
+  swap_print_stats ();
+  pagein_print_stats ();
+  flush_print_stats ();
+  pff_print_stats ();
+#endif
 }
@@ -4,6 +4,7 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/vmalloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
@@ -12,7 +13,14 @@ static struct bitmap *free_map;      /* Free map, one bit per sector. */
 void
 free_map_init (void) 
 {
-  free_map = bitmap_create (block_size (fs_device));
+  size_t sector_cnt = block_size (fs_device);
+  size_t bm_size = bitmap_buf_size (sector_cnt);
+  void *bm_buf = vmalloc (bm_size);
+
+  /* Kept in vmalloc space since it grows with the device. */
+  free_map = NULL;
+  if (bm_buf != NULL)
+    free_map = bitmap_create_in_buf (sector_cnt, bm_buf, bm_size);
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
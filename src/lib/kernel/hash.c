@@ -8,6 +8,8 @@
 #include "hash.h"
 #include "../debug.h"
 #include "threads/malloc.h"
+#include "threads/vmalloc.h"
+#include "threads/vaddr.h"
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
         list_entry(LIST_ELEM, struct hash_elem, list_elem)
@@ -18,6 +20,8 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static struct list *alloc_buckets (size_t bucket_cnt);
+static void free_buckets (struct list *buckets, size_t bucket_cnt);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -27,7 +31,7 @@ hash_init (struct hash *h,
 {
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
-  h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->buckets = alloc_buckets (h->bucket_cnt);
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -88,7 +92,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
-  free (h->buckets);
+  free_buckets (h->buckets, h->bucket_cnt);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -376,7 +380,7 @@ rehash (struct hash *h)
     return;
 
   /* Allocate new buckets and initialize them as empty. */
-  new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt);
+  new_buckets = alloc_buckets (new_bucket_cnt);
   if (new_buckets == NULL) 
     {
       /* Allocation failed.  This means that use of the hash table will
@@ -409,7 +413,28 @@ rehash (struct hash *h)
         }
     }
 
-  free (old_buckets);
+  free_buckets (old_buckets, old_bucket_cnt);
+}
+
+/* Allocates an array of BUCKET_CNT buckets.  Arrays bigger than
+   a page come from vmalloc(), so big tables do not need
+   physically contiguous memory. */
+static struct list *
+alloc_buckets (size_t bucket_cnt)
+{
+  size_t size = sizeof (struct list) * bucket_cnt;
+  return size > PGSIZE ? vmalloc (size) : malloc (size);
+}
+
+/* Frees BUCKETS, an array of BUCKET_CNT buckets obtained from
+   alloc_buckets(). */
+static void
+free_buckets (struct list *buckets, size_t bucket_cnt)
+{
+  if (sizeof (struct list) * bucket_cnt > PGSIZE)
+    vfree (buckets);
+  else
+    free (buckets);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
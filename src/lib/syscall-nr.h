@@ -23,6 +23,14 @@ enum
     SYS_MMAP      = 13,         /* Map a file into memory. */
     SYS_MUNMAP    = 14,         /* Remove a memory mapping. */
 
+    /* Virtual memory extensions. */
+    SYS_FORK      = 15,         /* Duplicate the calling process. */
+    SYS_MADVISE   = 16,         /* Advise how pages will be used. */
+    SYS_MMAP_EXT  = 17,         /* Map a file range or anonymous memory. */
+    SYS_MSYNC     = 18,         /* Write back mapped pages. */
+    SYS_EXEC_LIMIT = 19,        /* Start a process with an RSS limit. */
+    SYS_VMSTAT    = 20,         /* Snapshot virtual memory statistics. */
+
     /* Task 4 only. */
     SYS_CHDIR,                  /* Change the current directory. */
     SYS_MKDIR,                  /* Create a directory. */
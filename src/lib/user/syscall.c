@@ -61,6 +61,26 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   ARG3, and ARG4, and returns the return value as an `int'. */
+#define syscall5(NUMBER, ARG0, ARG1, ARG2, ARG3, ARG4)          \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg4]; pushl %[arg3]; pushl %[arg2]; "    \
+             "pushl %[arg1]; pushl %[arg0]; "                   \
+             "pushl %[number]; int $0x30; addl $24, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0),                             \
+                 [arg1] "g" (ARG1),                             \
+                 [arg2] "g" (ARG2),                             \
+                 [arg3] "g" (ARG3),                             \
+                 [arg4] "g" (ARG4)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
@@ -153,6 +173,42 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+mapid_t
+mmap_ext (void **addr, size_t length, int flags, int fd, unsigned offset)
+{
+  return syscall5 (SYS_MMAP_EXT, addr, length, flags, fd, offset);
+}
+
+bool
+msync (void *addr, size_t length, int flags)
+{
+  return syscall3 (SYS_MSYNC, addr, length, flags);
+}
+
+pid_t
+exec_limit (const char *file, size_t max_pages)
+{
+  return (pid_t) syscall2 (SYS_EXEC_LIMIT, file, max_pages);
+}
+
+void
+vmstat (struct vmstat *stat)
+{
+  syscall1 (SYS_VMSTAT, stat);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -2,6 +2,8 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,6 +14,75 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Flags for mmap_ext(). */
+#define MAP_SHARED    0x0001    /* Writes go to the file. */
+#define MAP_PRIVATE   0x0002    /* Writes are copied, not written back. */
+#define MAP_ANONYMOUS 0x0020    /* Zeroed memory, not backed by a file. */
+#define MAP_POPULATE  0x8000    /* Fault every page in up front. */
+
+/* Flags for msync(). */
+#define MS_ASYNC      1         /* Schedule the write back. */
+#define MS_SYNC       4         /* Write back before returning. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL     0       /* No particular access pattern. */
+#define MADV_RANDOM     1       /* Pages are used in no order. */
+#define MADV_SEQUENTIAL 2       /* Pages are used in address order. */
+#define MADV_WILLNEED   3       /* Pages will be needed soon. */
+#define MADV_DONTNEED   4       /* Pages are not needed for now. */
+
+/* How page faults counted by vmstat() were resolved. */
+enum vmstat_fault
+  {
+    VMSTAT_FAULT_MINOR,         /* Page in memory already, or copied. */
+    VMSTAT_FAULT_FILE,          /* Read from a file. */
+    VMSTAT_FAULT_SWAP,          /* Read back from swap. */
+    VMSTAT_FAULT_STACK,         /* Stack grown by a page. */
+    VMSTAT_FAULT_ZERO,          /* Zero filled. */
+    VMSTAT_FAULT_CNT
+  };
+
+/* Kinds of page faulted on, as the kernel's enum frame_type. */
+enum vmstat_page
+  {
+    VMSTAT_PAGE_STACK,          /* Stack. */
+    VMSTAT_PAGE_CODE,           /* Read only executable segments. */
+    VMSTAT_PAGE_DATA,           /* Writable executable segments. */
+    VMSTAT_PAGE_ZERO,           /* Zeros, such as bss or anonymous. */
+    VMSTAT_PAGE_MMAP,           /* Shared file mappings. */
+    VMSTAT_PAGE_CNT
+  };
+
+/* Eviction methods, as the kernel's enum eviction_method. */
+enum vmstat_evict
+  {
+    VMSTAT_EVICT_DELETE,
+    VMSTAT_EVICT_SWAP,
+    VMSTAT_EVICT_SWAP_IF_DIRTY,
+    VMSTAT_EVICT_WRITE_IF_DIRTY,
+    VMSTAT_EVICT_CNT
+  };
+
+/* Time taken to resolve one class of page fault, in CPU cycles.
+   Percentiles are good to within 25%. */
+struct vmstat_latency
+  {
+    long long cnt;
+    uint64_t p50, p90, p99, max;
+  };
+
+/* Virtual memory statistics since boot, as written by vmstat(). */
+struct vmstat
+  {
+    long long faults[VMSTAT_FAULT_CNT];         /* By outcome. */
+    long long page_faults[VMSTAT_PAGE_CNT];     /* By kind of page. */
+    long long evictions[VMSTAT_EVICT_CNT];      /* By eviction method. */
+    long long pin_waits;        /* Waits for frames in I/O. */
+    size_t swap_slots_used;     /* Swap slots claimed. */
+    size_t swap_slot_cnt;       /* Swap slots in all. */
+    struct vmstat_latency latency[VMSTAT_FAULT_CNT];
+  };
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -38,6 +109,15 @@ void close (int fd);
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
 
+/* Virtual memory extensions. */
+pid_t fork (void);
+bool madvise (void *addr, size_t length, int advice);
+mapid_t mmap_ext (void **addr, size_t length, int flags, int fd,
+                  unsigned offset);
+bool msync (void *addr, size_t length, int flags);
+pid_t exec_limit (const char *file, size_t max_pages);
+void vmstat (struct vmstat *);
+
 /* Task 4 only. */
 bool chdir (const char *dir);
 bool mkdir (const char *dir);
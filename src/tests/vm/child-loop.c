@@ -0,0 +1,30 @@
+/* Child process of page-scan-loop.
+   Fills 256 kB with a pattern, then goes round it checking the
+   pattern many times. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-loop";
+
+#define SIZE (256 * 1024)
+#define ROUNDS 1000
+
+static char buf[SIZE];
+
+int
+main (void)
+{
+  size_t i;
+  int round;
+
+  for (i = 0; i < SIZE; i += 4096)
+    buf[i] = i / 4096;
+
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < SIZE; i += 4096)
+      if (buf[i] != (char) (i / 4096))
+        fail ("byte %zu != %d", i, (char) (i / 4096));
+
+  return 0x42;
+}
@@ -0,0 +1,27 @@
+/* Child process of page-scan-loop.
+   Reads through 2 MB of zeros four times, touching each page
+   once per pass. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-scan";
+
+#define SIZE (2 * 1024 * 1024)
+#define PASSES 4
+
+static char buf[SIZE];
+
+int
+main (void)
+{
+  size_t i;
+  int pass;
+
+  for (pass = 0; pass < PASSES; pass++)
+    for (i = 0; i < SIZE; i += 4096)
+      if (buf[i] != '\0')
+        fail ("byte %zu != 0", i);
+
+  return 0x42;
+}
@@ -0,0 +1,71 @@
+/* Forks a child, which checks that it sees its parent's memory,
+   mapping and open file as they were at the fork, and then
+   overwrites the memory.  Meanwhile the parent overwrites half
+   of it too, and each checks it does not see the other's
+   writes, and that the child's reads did not move the parent's
+   file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 4096)
+#define CHUNK 16
+
+static char buf[SIZE];
+
+/* Returns the byte written to offset OFS of buf before the fork */
+static char
+pattern (size_t ofs)
+{
+  return ofs % 251;
+}
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char chunk[CHUNK];
+  int handle;
+  pid_t pid;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = pattern (i);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, actual) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (read (handle, chunk, CHUNK) == CHUNK, "read \"sample.txt\"");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != pattern (i))
+          exit (1);
+      if (memcmp (actual, sample, strlen (sample)))
+        exit (2);
+      if (read (handle, chunk, CHUNK) != CHUNK
+          || memcmp (chunk, sample + CHUNK, CHUNK))
+        exit (3);
+
+      memset (buf, 'c', SIZE);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != 'c')
+          exit (4);
+      exit (81);
+    }
+  CHECK (pid != PID_ERROR, "fork");
+
+  memset (buf, 'p', SIZE / 2);
+  CHECK (wait (pid) == 81, "wait for child");
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i < SIZE / 2 ? 'p' : pattern (i)))
+      fail ("byte %zu of parent's memory changed", i);
+  CHECK (read (handle, chunk, CHUNK) == CHUNK, "read \"sample.txt\" again");
+  if (memcmp (chunk, sample + CHUNK, CHUNK))
+    fail ("read of \"sample.txt\" in parent returned wrong data");
+  close (handle);
+}
@@ -0,0 +1,48 @@
+/* Forks many children, one after another, from a process with a
+   lot of memory, each of which writes just one page of it.  The
+   work done per fork should follow the pages the child writes,
+   not the size of the process. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (2 * 1024 * 1024)
+#define CHILD_CNT 64
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  int child;
+
+  msg ("write pass");
+  memset (buf, 'a', SIZE);
+
+  for (child = 0; child < CHILD_CNT; child++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        {
+          char *page = buf + child * 7 * PAGE_SIZE % SIZE;
+          if (*page != 'a')
+            exit (-1);
+          *page = 'b';
+          exit (child);
+        }
+      if (pid == PID_ERROR)
+        fail ("fork %d failed", child);
+      if (wait (pid) != child)
+        fail ("wait for child %d failed", child);
+    }
+  msg ("forked %d children", CHILD_CNT);
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 'a')
+      fail ("byte %zu != 'a'", i);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-many) begin
+(fork-many) write pass
+(fork-many) forked 64 children
+(fork-many) read pass
+(fork-many) end
+EOF
+pass;
@@ -0,0 +1,62 @@
+/* Forks many children that all run at once, each of which reads
+   every page of the parent's memory and then writes one page of
+   its own, so that the same frames have many owners, which come
+   and go as the children break copy on write and exit. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+#define CHILD_CNT 12
+#define PASS_CNT 4
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+static void
+child_main (int child)
+{
+  int pass, page;
+
+  for (pass = 0; pass < PASS_CNT; pass++)
+    for (page = 0; page < PAGE_CNT; page++)
+      {
+        char expected = pass > 1 && page == child ? child : 'a';
+        if (buf[page * PAGE_SIZE] != expected)
+          exit (-1);
+        if (pass == 1 && page == child)
+          buf[page * PAGE_SIZE] = child;
+      }
+  exit (child);
+}
+
+void
+test_main (void)
+{
+  pid_t pids[CHILD_CNT];
+  size_t i;
+  int child;
+
+  msg ("write pass");
+  memset (buf, 'a', sizeof buf);
+
+  for (child = 0; child < CHILD_CNT; child++)
+    {
+      pids[child] = fork ();
+      if (pids[child] == 0)
+        child_main (child);
+      if (pids[child] == PID_ERROR)
+        fail ("fork %d failed", child);
+    }
+  for (child = 0; child < CHILD_CNT; child++)
+    if (wait (pids[child]) != child)
+      fail ("wait for child %d failed", child);
+  msg ("forked %d children", CHILD_CNT);
+
+  msg ("read pass");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'a')
+      fail ("byte %zu != 'a'", i);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-wide) begin
+(fork-wide) write pass
+(fork-wide) forked 12 children
+(fork-wide) read pass
+(fork-wide) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Gives each kind of advice with madvise, checking that advice
+   leaves contents alone except for MADV_DONTNEED, which resets
+   zero-initialized pages to zeros and keeps writes to a mapped
+   file, and that bad arguments are refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (16 * PAGE_SIZE)
+
+static char buf[SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  char *again = (char *) 0x20000000;
+  int handle;
+  size_t i;
+
+  memset (buf, 'x', SIZE);
+  CHECK (madvise (buf, SIZE, MADV_SEQUENTIAL), "madvise sequential");
+  CHECK (madvise (buf, SIZE, MADV_RANDOM), "madvise random");
+  CHECK (madvise (buf, SIZE, MADV_WILLNEED), "madvise willneed");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 'x')
+      fail ("byte %zu changed by advice", i);
+
+  CHECK (madvise (buf, SIZE, MADV_DONTNEED), "madvise dontneed");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu != 0 after dontneed", i);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, actual) != MAP_FAILED, "mmap \"sample.txt\"");
+  actual[0] = '!';
+  CHECK (madvise (actual, PAGE_SIZE, MADV_DONTNEED), "madvise dontneed mapping");
+  if (actual[0] != '!' || memcmp (actual + 1, sample + 1, strlen (sample) - 1))
+    fail ("mapping lost its contents");
+
+  CHECK (mmap (handle, again) != MAP_FAILED, "mmap \"sample.txt\" again");
+  CHECK (madvise (again, PAGE_SIZE, MADV_WILLNEED), "madvise willneed mapping");
+  if (memcmp (again, actual, PAGE_SIZE))
+    fail ("mappings differ");
+
+  CHECK (!madvise (buf + 1, PAGE_SIZE, MADV_NORMAL),
+         "madvise unaligned address fails");
+  CHECK (!madvise (again + PAGE_SIZE, PAGE_SIZE, MADV_NORMAL),
+         "madvise unmapped page fails");
+  CHECK (!madvise (buf, SIZE, 99), "madvise bad advice fails");
+  close (handle);
+}
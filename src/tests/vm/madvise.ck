@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) madvise sequential
+(madvise) madvise random
+(madvise) madvise willneed
+(madvise) madvise dontneed
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise dontneed mapping
+(madvise) mmap "sample.txt" again
+(madvise) madvise willneed mapping
+(madvise) madvise unaligned address fails
+(madvise) madvise unmapped page fails
+(madvise) madvise bad advice fails
+(madvise) end
+EOF
+pass;
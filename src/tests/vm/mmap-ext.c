@@ -0,0 +1,60 @@
+/* Maps part of a file from an offset, a private copy of a file and
+   anonymous memory with mmap_ext, at addresses the kernel chooses,
+   and checks that private writes stay out of the file and that bad
+   requests are refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static char page[PAGE_SIZE];
+
+void
+test_main (void)
+{
+  void *shared = NULL, *private = NULL, *anon = NULL, *part = NULL;
+  void *fixed = (void *) 0x10000000;
+  int handle, big;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap_ext (&shared, 0, MAP_SHARED, handle, 0) != MAP_FAILED,
+         "map \"sample.txt\" shared");
+  CHECK (shared != NULL && !memcmp (shared, sample, strlen (sample)),
+         "compare shared mapping against data");
+
+  CHECK (mmap_ext (&private, 0, MAP_PRIVATE, handle, 0) != MAP_FAILED,
+         "map \"sample.txt\" private");
+  ((char *) private)[0] = '!';
+  CHECK (((char *) shared)[0] == sample[0], "private write is not shared");
+
+  CHECK (mmap_ext (&anon, 3 * PAGE_SIZE, 
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0) 
+         != MAP_FAILED, "map anonymous memory");
+  for (i = 0; i < 3 * PAGE_SIZE; i++)
+    if (((char *) anon)[i] != 0)
+      fail ("anonymous byte %zu is not zero", i);
+  memset (anon, 'a', 3 * PAGE_SIZE);
+
+  CHECK (create ("big", 2 * PAGE_SIZE), "create \"big\"");
+  CHECK ((big = open ("big")) > 1, "open \"big\"");
+  memset (page, 'b', PAGE_SIZE);
+  seek (big, PAGE_SIZE);
+  CHECK (write (big, page, PAGE_SIZE) == PAGE_SIZE, "write \"big\"");
+  CHECK (mmap_ext (&part, PAGE_SIZE, MAP_SHARED, big, PAGE_SIZE) 
+         != MAP_FAILED, "map second page of \"big\"");
+  CHECK (!memcmp (part, page, PAGE_SIZE), "compare second page");
+
+  CHECK (mmap_ext (&fixed, PAGE_SIZE, MAP_SHARED, big, 1) == MAP_FAILED,
+         "map at unaligned offset fails");
+  CHECK (mmap_ext (&shared, PAGE_SIZE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+         == MAP_FAILED, "map over mapping fails");
+  CHECK (mmap_ext (&fixed, PAGE_SIZE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)
+         == MAP_FAILED, "map shared anonymous memory fails");
+  CHECK (mmap_ext (&fixed, PAGE_SIZE, MAP_ANONYMOUS, -1, 0) == MAP_FAILED,
+         "map without shared or private fails");
+}
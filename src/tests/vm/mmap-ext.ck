@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-ext) begin
+(mmap-ext) open "sample.txt"
+(mmap-ext) map "sample.txt" shared
+(mmap-ext) compare shared mapping against data
+(mmap-ext) map "sample.txt" private
+(mmap-ext) private write is not shared
+(mmap-ext) map anonymous memory
+(mmap-ext) create "big"
+(mmap-ext) open "big"
+(mmap-ext) write "big"
+(mmap-ext) map second page of "big"
+(mmap-ext) compare second page
+(mmap-ext) map at unaligned offset fails
+(mmap-ext) map over mapping fails
+(mmap-ext) map shared anonymous memory fails
+(mmap-ext) map without shared or private fails
+(mmap-ext) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Lets the kernel place mappings, which should be packed down from
+   the stack limit, reuses the gap left by one that is unmapped, and
+   checks that pages in between mappings stay unmapped. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static mapid_t
+map_pages (void **addr, size_t page_cnt)
+{
+  return mmap_ext (addr, page_cnt * PAGE_SIZE, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+}
+
+void
+test_main (void)
+{
+  void *a = NULL, *b = NULL, *c = NULL, *d = NULL;
+  mapid_t map_a;
+
+  CHECK ((map_a = map_pages (&a, 4)) != MAP_FAILED, "map 4 pages");
+  CHECK (map_pages (&b, 2) != MAP_FAILED, "map 2 pages");
+  CHECK (b + 2 * PAGE_SIZE == a, "second mapping is just below the first");
+
+  ((char *) a)[0] = 'a';
+  ((char *) b)[0] = 'b';
+  munmap (map_a);
+  CHECK (map_pages (&c, 3) != MAP_FAILED, "map 3 pages");
+  CHECK (c == a + PAGE_SIZE, "third mapping reuses the gap");
+  CHECK (((char *) c)[0] == 0 && ((char *) b)[0] == 'b',
+         "contents are separate");
+
+  d = a;
+  CHECK (map_pages (&d, 1) != MAP_FAILED, "map 1 page at the rest of the gap");
+  d = b + PAGE_SIZE;
+  CHECK (map_pages (&d, 1) == MAP_FAILED, "map over a mapping fails");
+
+  msg ("read unmapped page between mappings");
+  ((volatile char *) b)[-1];
+  fail ("should have exited with -1");
+}
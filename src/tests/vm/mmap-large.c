@@ -0,0 +1,39 @@
+/* Maps a large region of anonymous memory, touches a page in every
+   64, unmaps it, and maps the same range again, which needs every
+   page of the first mapping to have gone from the supplemental page
+   table. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT (8 * 1024)
+#define STRIDE 64
+
+void
+test_main (void)
+{
+  void *addr = NULL;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((map = mmap_ext (&addr, PAGE_CNT * PAGE_SIZE, 
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED,
+         "map %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i += STRIDE)
+    ((size_t *) (addr + i * PAGE_SIZE))[0] = i;
+  for (i = 0; i < PAGE_CNT; i += STRIDE)
+    if (((size_t *) (addr + i * PAGE_SIZE))[0] != i)
+      fail ("page %zu lost its contents", i);
+  msg ("touch every %d pages", STRIDE);
+
+  munmap (map);
+  CHECK ((map = mmap_ext (&addr, PAGE_CNT * PAGE_SIZE, 
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED,
+         "map the same pages again");
+  for (i = 0; i < PAGE_CNT; i += STRIDE)
+    if (((size_t *) (addr + i * PAGE_SIZE))[0] != 0)
+      fail ("page %zu is not zero", i);
+  munmap (map);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-large) begin
+(mmap-large) map 8192 pages
+(mmap-large) touch every 64 pages
+(mmap-large) map the same pages again
+(mmap-large) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Writes to a shared mapping of a file, writes it back with msync
+   while it is still mapped, and reads the file to check that the
+   write reached it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[sizeof sample];
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  const char *overwrite = "Synced";
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, actual) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (actual, overwrite, strlen (overwrite));
+  memcpy (sample, overwrite, strlen (overwrite));
+
+  CHECK (msync (actual, 4096, MS_SYNC), "msync sync");
+  CHECK (read (handle, buf, strlen (sample)) == (int) strlen (sample),
+         "read \"sample.txt\"");
+  CHECK (!memcmp (buf, sample, strlen (sample)), "compare file to mapping");
+
+  actual[0] = 's';
+  CHECK (msync (actual, 4096, MS_ASYNC), "msync async");
+  CHECK (!msync (actual, 4096, MS_SYNC | MS_ASYNC), "msync bad flags fails");
+  CHECK (!msync (actual + 1, 4096, MS_SYNC), "msync unaligned address fails");
+  CHECK (!msync ((void *) 0x20000000, 4096, MS_SYNC), 
+         "msync unmapped page fails");
+  munmap (0);
+}
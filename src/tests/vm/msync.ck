@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(msync) begin
+(msync) open "sample.txt"
+(msync) mmap "sample.txt"
+(msync) msync sync
+(msync) read "sample.txt"
+(msync) compare file to mapping
+(msync) msync async
+(msync) msync bad flags fails
+(msync) msync unaligned address fails
+(msync) msync unmapped page fails
+(msync) end
+EOF
+pass;
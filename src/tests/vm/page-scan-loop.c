@@ -0,0 +1,21 @@
+/* Runs child-scan, which reads through more memory than there is
+   several times over, alongside child-loop, which keeps going
+   round a small working set.  A scan-resistant replacement
+   policy should keep child-loop's pages resident throughout;
+   compare the page fault counts printed at shutdown under
+   -evict=car and -evict=sca. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t scan, loop;
+
+  CHECK ((loop = exec ("child-loop")) != -1, "exec \"child-loop\"");
+  CHECK ((scan = exec ("child-scan")) != -1, "exec \"child-scan\"");
+  CHECK (wait (loop) == 0x42, "wait for child-loop");
+  CHECK (wait (scan) == 0x42, "wait for child-scan");
+}
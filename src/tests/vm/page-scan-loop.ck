@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-scan-loop) begin
+(page-scan-loop) exec "child-loop"
+(page-scan-loop) exec "child-scan"
+(page-scan-loop) wait for child-loop
+(page-scan-loop) wait for child-scan
+(page-scan-loop) end
+EOF
+pass;
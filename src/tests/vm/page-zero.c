@@ -0,0 +1,62 @@
+/* Reads through more zero-initialized memory than there is, then
+   writes a little of it, including through system calls into
+   pages that have only been read, and verifies that every byte
+   is as it should be. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (6 * 1024 * 1024)
+#define STRIDE 16
+
+static char buf[SIZE];
+
+/* Returns the byte expected at offset OFS of buf */
+static char
+expected (size_t ofs)
+{
+  size_t page = ofs / PAGE_SIZE;
+  if (page % STRIDE != 0 || ofs % PAGE_SIZE >= 16)
+    return 0;
+  return page / STRIDE % 255 + 1;
+}
+
+void
+test_main (void)
+{
+  size_t i;
+  int fd;
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu != 0", i);
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i += STRIDE * PAGE_SIZE)
+    memset (buf + i, expected (i), 16);
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != expected (i))
+      fail ("byte %zu != %d", i, expected (i));
+
+  /* Write out a written page and a page only ever read, and read
+     them back into a page only ever read */
+  CHECK (create ("zeros", 2 * PAGE_SIZE), "create \"zeros\"");
+  CHECK ((fd = open ("zeros")) > 1, "open \"zeros\"");
+  CHECK (write (fd, buf + STRIDE * PAGE_SIZE, PAGE_SIZE) == PAGE_SIZE,
+         "write written page");
+  CHECK (write (fd, buf + 3 * PAGE_SIZE, PAGE_SIZE) == PAGE_SIZE,
+         "write zero page");
+  seek (fd, 0);
+  CHECK (read (fd, buf + 5 * PAGE_SIZE, 2 * PAGE_SIZE) == 2 * PAGE_SIZE,
+         "read into zero pages");
+  if (memcmp (buf + 5 * PAGE_SIZE, buf + STRIDE * PAGE_SIZE, PAGE_SIZE)
+      || memcmp (buf + 6 * PAGE_SIZE, buf + 3 * PAGE_SIZE, PAGE_SIZE))
+    fail ("pages read back differ");
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-zero) begin
+(page-zero) read pass
+(page-zero) write pass
+(page-zero) read pass
+(page-zero) create "zeros"
+(page-zero) open "zeros"
+(page-zero) write written page
+(page-zero) write zero page
+(page-zero) read into zero pages
+(page-zero) end
+EOF
+pass;
@@ -0,0 +1,54 @@
+/* Writes a file from a buffer spanning many pages and reads it back
+   into one whose pages are in every state a system call may find
+   them in: not yet touched, mapped to the zero page by a read,
+   written, and on the stack below the pages used so far. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 16
+#define SIZE (PAGE_CNT * PAGE_SIZE)
+
+static char src[SIZE];
+static char dst[SIZE];
+
+static void
+read_back (const char *name, char *buf)
+{
+  int handle;
+
+  CHECK ((handle = open ("data")) > 1, "open \"data\" for %s", name);
+  CHECK (read (handle, buf, SIZE) == SIZE, "read into %s", name);
+  close (handle);
+  if (memcmp (src, buf, SIZE))
+    fail ("%s differs from what was written", name);
+}
+
+void
+test_main (void)
+{
+  char stack_buf[SIZE];
+  volatile char sum = 0;
+  size_t i;
+  int handle;
+
+  for (i = 0; i < SIZE; i++)
+    src[i] = i * 7 + i / PAGE_SIZE;
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (write (handle, src, SIZE) == SIZE, "write \"data\"");
+  close (handle);
+
+  /* Every third page is read, every third written, and the rest left */
+  for (i = 0; i < PAGE_CNT; i++)
+    if (i % 3 == 1)
+      sum += dst[i * PAGE_SIZE];
+    else if (i % 3 == 2)
+      dst[i * PAGE_SIZE] = 'x';
+
+  read_back ("dst", dst);
+  read_back ("stack_buf", stack_buf);
+}
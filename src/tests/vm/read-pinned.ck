@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(read-pinned) begin
+(read-pinned) create "data"
+(read-pinned) open "data"
+(read-pinned) write "data"
+(read-pinned) open "data" for dst
+(read-pinned) read into dst
+(read-pinned) open "data" for stack_buf
+(read-pinned) read into stack_buf
+(read-pinned) end
+EOF
+pass;
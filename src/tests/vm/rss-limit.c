@@ -0,0 +1,19 @@
+/* Runs child-linear, which uses 256 pages of data, with its resident
+   set limited to 32 pages, alongside one run without a limit, and
+   checks that both get the right answer. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t limited, unlimited;
+
+  CHECK ((limited = exec_limit ("child-linear", 32)) != -1,
+         "exec_limit \"child-linear\"");
+  CHECK ((unlimited = exec ("child-linear")) != -1, "exec \"child-linear\"");
+  CHECK (wait (limited) == 0x42, "wait for limited child");
+  CHECK (wait (unlimited) == 0x42, "wait for unlimited child");
+}
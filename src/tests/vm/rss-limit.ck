@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) exec_limit "child-linear"
+(rss-limit) exec "child-linear"
+(rss-limit) wait for limited child
+(rss-limit) wait for unlimited child
+(rss-limit) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Takes vmstat snapshots around writes to fresh anonymous pages and a
+   read of a mapped file, and checks that the faults were counted by
+   outcome, by kind of page and in the latency histograms. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 8
+
+static struct vmstat before, after;
+
+void
+test_main (void)
+{
+  void *anon = NULL, *file = NULL;
+  int handle, i;
+
+  CHECK (mmap_ext (&anon, PAGE_CNT * PAGE_SIZE, 
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) != MAP_FAILED,
+         "map anonymous memory");
+  vmstat (&before);
+  for (i = 0; i < PAGE_CNT; i++)
+    ((char *) anon)[i * PAGE_SIZE] = 'a';
+  vmstat (&after);
+
+  CHECK (after.faults[VMSTAT_FAULT_ZERO] - before.faults[VMSTAT_FAULT_ZERO] 
+         >= PAGE_CNT, "zero fill faults counted");
+  CHECK (after.page_faults[VMSTAT_PAGE_ZERO] 
+         - before.page_faults[VMSTAT_PAGE_ZERO] >= PAGE_CNT,
+         "faults on zero pages counted");
+  CHECK (after.latency[VMSTAT_FAULT_ZERO].cnt 
+         - before.latency[VMSTAT_FAULT_ZERO].cnt >= PAGE_CNT,
+         "zero fill latencies recorded");
+  CHECK (after.latency[VMSTAT_FAULT_ZERO].p50 
+         <= after.latency[VMSTAT_FAULT_ZERO].max, "p50 within max");
+  CHECK (after.swap_slots_used <= after.swap_slot_cnt, "swap slots in use");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap_ext (&file, 0, MAP_SHARED, handle, 0) != MAP_FAILED,
+         "map \"sample.txt\"");
+  vmstat (&before);
+  CHECK (!memcmp (file, sample, strlen (sample)), "compare mapping");
+  vmstat (&after);
+  CHECK (after.faults[VMSTAT_FAULT_FILE] + after.faults[VMSTAT_FAULT_MINOR]
+         > before.faults[VMSTAT_FAULT_FILE] 
+           + before.faults[VMSTAT_FAULT_MINOR], "file fault counted");
+  CHECK (after.page_faults[VMSTAT_PAGE_MMAP] 
+         > before.page_faults[VMSTAT_PAGE_MMAP], "fault on mapping counted");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vmstat) begin
+(vmstat) map anonymous memory
+(vmstat) zero fill faults counted
+(vmstat) faults on zero pages counted
+(vmstat) zero fill latencies recorded
+(vmstat) p50 within max
+(vmstat) swap slots in use
+(vmstat) open "sample.txt"
+(vmstat) map "sample.txt"
+(vmstat) compare mapping
+(vmstat) file fault counted
+(vmstat) fault on mapping counted
+(vmstat) end
+EOF
+pass;
@@ -0,0 +1,270 @@
+#include "threads/highmem.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An E820 memory map entry, as stored by start.S. */
+struct e820_entry
+  {
+    uint64_t base;              /* Physical start address. */
+    uint64_t length;            /* Length in bytes. */
+    uint32_t type;              /* E820_USABLE or something else. */
+  } __attribute__ ((packed));
+
+#define E820_USABLE 1
+
+/* Highest physical address we can map without PAE. */
+#define PADDR_LIMIT ((uint64_t) 1 << 32)
+
+/* High memory pages. */
+static struct lock highmem_lock;
+static struct bitmap *highmem_map;      /* Pages in use, or holes. */
+static uintptr_t highmem_base;          /* Physical address of page 0. */
+static size_t highmem_pages;            /* Pages covered by the map. */
+static size_t highmem_free;             /* Usable pages not in use. */
+static size_t highmem_used_max;         /* Most pages ever in use. */
+static size_t highmem_usable;           /* Usable pages in all. */
+
+/* kmap() slots. */
+static struct semaphore kmap_sema;      /* Free slots. */
+static uint32_t kmap_busy;              /* Bit per slot in use. */
+static uint32_t *kmap_pt;               /* Page table for the slots. */
+
+static void reserve_range (uint64_t start, uint64_t end, bool usable);
+
+/* Finds high memory in the E820 map and sets up the kmap()
+   slots.  Must be called after vmalloc_init() and before any
+   page directory is created, since it adds a page table to
+   init_page_dir. */
+void
+highmem_init (void)
+{
+  const struct e820_entry *map = ptov (LOADER_E820_MAP);
+  uint64_t low_end = (uint64_t) init_ram_pages * PGSIZE;
+  uint64_t high_end = low_end;
+  uint32_t i;
+
+  ASSERT (KMAP_SLOTS <= 32);
+  ASSERT (KMAP_SLOTS <= PGSIZE / sizeof (uint32_t));
+
+  lock_init (&highmem_lock);
+  sema_init (&kmap_sema, KMAP_SLOTS);
+  kmap_pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  ASSERT (init_page_dir[pd_no (KMAP_START)] == 0);
+  init_page_dir[pd_no (KMAP_START)] = pde_create (kmap_pt);
+
+  /* Find where usable memory ends, ignoring anything we could not
+     map without PAE. */
+  for (i = 0; i < init_e820_cnt && i < LOADER_E820_MAX; i++)
+    if (map[i].type == E820_USABLE && map[i].length > 0)
+      {
+        uint64_t end = map[i].base + map[i].length;
+        if (end > PADDR_LIMIT)
+          end = PADDR_LIMIT;
+        if (end > high_end)
+          high_end = end & ~(uint64_t) PGMASK;
+      }
+  if (high_end == low_end)
+    return;
+
+  /* Start with every page marked in use, then free the usable
+     ones, so holes in the map are never handed out. */
+  highmem_base = low_end;
+  highmem_pages = (high_end - low_end) / PGSIZE;
+  size_t bm_size = bitmap_buf_size (highmem_pages);
+  void *bm_buf = vmalloc (bm_size);
+  if (bm_buf == NULL)
+    {
+      printf ("highmem: no room for map of %zu pages\n", highmem_pages);
+      highmem_pages = 0;
+      return;
+    }
+  highmem_map = bitmap_create_in_buf (highmem_pages, bm_buf, bm_size);
+  bitmap_set_all (highmem_map, true);
+  for (i = 0; i < init_e820_cnt && i < LOADER_E820_MAX; i++)
+    if (map[i].type == E820_USABLE)
+      reserve_range (map[i].base, map[i].base + map[i].length, true);
+
+  /* Overlapping entries of another type win. */
+  for (i = 0; i < init_e820_cnt && i < LOADER_E820_MAX; i++)
+    if (map[i].type != E820_USABLE)
+      reserve_range (map[i].base, map[i].base + map[i].length, false);
+
+  highmem_free = highmem_usable
+    = bitmap_count (highmem_map, 0, highmem_pages, false);
+  printf ("%zu pages of high memory.\n", highmem_usable);
+}
+
+/* Marks the whole pages of high memory between physical addresses
+   START and END free if USABLE, otherwise in use. */
+static void
+reserve_range (uint64_t start, uint64_t end, bool usable)
+{
+  uint64_t high_end = highmem_base + (uint64_t) highmem_pages * PGSIZE;
+
+  /* Usable ranges shrink to whole pages, others grow. */
+  if (usable)
+    {
+      start = (start + PGMASK) & ~(uint64_t) PGMASK;
+      end &= ~(uint64_t) PGMASK;
+    }
+  else
+    {
+      start &= ~(uint64_t) PGMASK;
+      end = (end + PGMASK) & ~(uint64_t) PGMASK;
+    }
+  if (start < highmem_base)
+    start = highmem_base;
+  if (end > high_end)
+    end = high_end;
+  if (start >= end)
+    return;
+
+  bitmap_set_multiple (highmem_map, (start - highmem_base) / PGSIZE,
+                       (end - start) / PGSIZE, !usable);
+}
+
+/* Allocates a page of high memory, filled with zeros if ZERO is
+   true, and returns its physical address, or 0 if none is
+   free. */
+uintptr_t
+highmem_get_page (bool zero)
+{
+  size_t page_idx = BITMAP_ERROR;
+
+  if (highmem_pages == 0)
+    return 0;
+
+  lock_acquire (&highmem_lock);
+  page_idx = bitmap_scan_and_flip (highmem_map, 0, 1, false);
+  if (page_idx != BITMAP_ERROR)
+    {
+      highmem_free--;
+      if (highmem_usable - highmem_free > highmem_used_max)
+        highmem_used_max = highmem_usable - highmem_free;
+    }
+  lock_release (&highmem_lock);
+  if (page_idx == BITMAP_ERROR)
+    return 0;
+
+  uintptr_t paddr = highmem_base + page_idx * PGSIZE;
+  if (zero)
+    {
+      void *kaddr = kmap (paddr);
+      memset (kaddr, 0, PGSIZE);
+      kunmap (kaddr);
+    }
+  return paddr;
+}
+
+/* Frees the page of high memory at physical address PADDR. */
+void
+highmem_free_page (uintptr_t paddr)
+{
+  size_t page_idx = highmem_page_no (paddr);
+
+  lock_acquire (&highmem_lock);
+  ASSERT (bitmap_test (highmem_map, page_idx));
+  bitmap_reset (highmem_map, page_idx);
+  highmem_free++;
+  lock_release (&highmem_lock);
+}
+
+/* Returns true if PADDR is in high memory. */
+bool
+is_highmem_paddr (uintptr_t paddr)
+{
+  return paddr >= highmem_base
+         && paddr - highmem_base < (uint64_t) highmem_pages * PGSIZE;
+}
+
+/* Returns the number of pages high memory page numbers run up
+   to, holes included. */
+size_t
+highmem_page_cnt (void)
+{
+  return highmem_pages;
+}
+
+/* Returns the number of usable high memory pages not in use. */
+size_t
+highmem_free_page_cnt (void)
+{
+  return highmem_free;
+}
+
+/* Returns the page number of PADDR within high memory. */
+size_t
+highmem_page_no (uintptr_t paddr)
+{
+  ASSERT (is_highmem_paddr (paddr));
+  return (paddr - highmem_base) / PGSIZE;
+}
+
+/* Prints high memory statistics. */
+void
+highmem_print_stats (void)
+{
+  if (highmem_pages > 0)
+    printf ("Highmem: %zu pages, at most %zu in use\n",
+            highmem_usable, highmem_used_max);
+}
+
+/* Returns a kernel virtual address through which the page at
+   physical address PADDR can be accessed, until it is passed to
+   kunmap().  Directly mapped pages need no slot.  Otherwise this
+   may sleep until one of the KMAP_SLOTS slots is free, so only a
+   few pages should be kept mapped at once and never from an
+   interrupt handler. */
+void *
+kmap (uintptr_t paddr)
+{
+  enum intr_level old_level;
+  int slot;
+
+  ASSERT (pg_ofs ((void *) paddr) == 0);
+  if (paddr < (uintptr_t) init_ram_pages * PGSIZE)
+    return ptov (paddr);
+
+  ASSERT (!intr_context ());
+  sema_down (&kmap_sema);
+  old_level = intr_disable ();
+  for (slot = 0; kmap_busy & (1u << slot); slot++)
+    ASSERT (slot < KMAP_SLOTS);
+  kmap_busy |= 1u << slot;
+  intr_set_level (old_level);
+
+  /* The slot's entry was cleared and flushed by kunmap(). */
+  kmap_pt[slot] = paddr | PTE_P | PTE_W | PTE_G;
+  return KMAP_START + slot * PGSIZE;
+}
+
+/* Releases KADDR, obtained from kmap(). */
+void
+kunmap (void *kaddr)
+{
+  enum intr_level old_level;
+  int slot;
+
+  if ((uint8_t *) kaddr < KMAP_START
+      || (uint8_t *) kaddr >= KMAP_START + KMAP_SLOTS * PGSIZE)
+    return;
+
+  slot = ((uint8_t *) kaddr - KMAP_START) / PGSIZE;
+  kmap_pt[slot] = 0;
+  invlpg (kaddr);
+
+  old_level = intr_disable ();
+  ASSERT (kmap_busy & (1u << slot));
+  kmap_busy &= ~(1u << slot);
+  intr_set_level (old_level);
+  sema_up (&kmap_sema);
+}
@@ -0,0 +1,35 @@
+#ifndef THREADS_HIGHMEM_H
+#define THREADS_HIGHMEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vmalloc.h"
+
+/* Physical memory beyond the direct map at PHYS_BASE.
+
+   The kernel maps only the first init_ram_pages pages of RAM.
+   Any further RAM that the BIOS E820 map reports usable below
+   4 GB is handed out a page at a time by physical address, for
+   user frames, which only need to be mapped into user page
+   tables.  The kernel reaches such a page by mapping it into one
+   of a few temporary slots with kmap(). */
+
+/* Kernel virtual region for kmap() slots, just above vmalloc. */
+#define KMAP_START VMALLOC_END
+#define KMAP_SLOTS 32
+
+void highmem_init (void);
+
+uintptr_t highmem_get_page (bool zero);
+void highmem_free_page (uintptr_t paddr);
+bool is_highmem_paddr (uintptr_t paddr);
+size_t highmem_page_cnt (void);
+size_t highmem_free_page_cnt (void);
+size_t highmem_page_no (uintptr_t paddr);
+void highmem_print_stats (void);
+
+void *kmap (uintptr_t paddr);
+void kunmap (void *kaddr);
+
+#endif /* threads/highmem.h */
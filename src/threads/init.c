@@ -22,6 +22,8 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
+#include "threads/highmem.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -40,6 +42,13 @@
 #ifdef VM
 #include "vm/ft.h"
 #include "vm/swap.h"
+#include "vm/reclaim.h"
+#include "vm/evict.h"
+#include "vm/trace.h"
+#include "vm/zswap.h"
+#include "vm/pagein.h"
+#include "vm/flush.h"
+#include "vm/pff.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -63,6 +72,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static void enable_global_pages (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -102,6 +112,8 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  vmalloc_init ();
+  highmem_init ();
 #ifdef VM
   ASSERT (ft_init ());
 #endif
@@ -135,12 +147,19 @@ main (void)
 #endif
 #ifdef VM
   swap_init ();
+  reclaim_init ();
+  pagein_init ();
+  flush_init ();
+  trace_init ();
 #endif
 
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
   run_actions (argv);
+#ifdef VM
+  trace_finish ();
+#endif
 
   /* Finish up. */
   shutdown ();
@@ -190,7 +209,9 @@ paging_init (void)
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      /* Kernel mappings are identical in every page directory, so
+         mark them global to keep them in the TLB across CR3 loads. */
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -199,6 +220,31 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  enable_global_pages ();
+}
+
+/* Flags in control register 4 and CPUID feature bits. */
+#define CR4_PGE      0x00000080 /* Page Global Enable. */
+#define CPUID_EDX_PGE 0x00002000 /* Processor supports PTE_G. */
+
+/* Turns on CR4.PGE if the processor supports it, so that the
+   PTE_G kernel mappings created by paging_init() are not flushed
+   on every process switch.  Without it PTE_G is simply ignored.
+   See [IA32-v3a] 2.5 "Control Registers" and 3.12 "Translation
+   Lookaside Buffers (TLBs)". */
+static void
+enable_global_pages (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint32_t cr4;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & CPUID_EDX_PGE) == 0)
+    return;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE) : "memory");
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -272,6 +318,21 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-evict"))
+        {
+          if (!evict_set_policy (value))
+            PANIC ("unknown eviction policy `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-zswap"))
+        zswap_percent = atoi (value);
+      else if (!strcmp (name, "-pff"))
+        pff_report = true;
+#ifdef FILESYS
+      else if (!strcmp (name, "-vmtrace"))
+        vm_trace = true;
+#endif
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -394,6 +455,16 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -evict=POLICY      Evict user frames by POLICY: car (default),\n"
+          "                     sca or random.\n"
+          "  -zswap=PERCENT     Keep up to PERCENT of user memory as compressed\n"
+          "                     swap (default 20, 0 disables).\n"
+          "  -pff               Print each process's resident set at exit.\n"
+#ifdef FILESYS
+          "  -vmtrace           Record page references on the scratch device.\n"
+#endif
 #endif
           );
   shutdown_power_off ();
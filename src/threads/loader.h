@@ -18,6 +18,11 @@
 #define LOADER_ARGS (LOADER_PARTS - LOADER_ARGS_LEN)   /* Command-line args. */
 #define LOADER_ARG_CNT (LOADER_ARGS - LOADER_ARG_CNT_LEN) /* Number of args. */
 
+/* Where start.S leaves the BIOS E820 memory map, and the most
+   entries it will store there.  Each entry is 20 bytes. */
+#define LOADER_E820_MAP 0x8000
+#define LOADER_E820_MAX 32
+
 /* Sizes of loader data structures. */
 #define LOADER_SIG_LEN 2
 #define LOADER_PARTS_LEN 64
@@ -33,8 +38,12 @@
 #ifndef __ASSEMBLER__
 #include <stdint.h>
 
-/* Amount of physical memory, in 4 kB pages. */
+/* Amount of directly mapped physical memory, in 4 kB pages. */
 extern uint32_t init_ram_pages;
+
+/* Number of entries in the E820 memory map at LOADER_E820_MAP,
+   or 0 if the BIOS does not support E820. */
+extern uint32_t init_e820_cnt;
 #endif
 
 #endif /* threads/loader.h */
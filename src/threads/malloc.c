@@ -66,6 +66,7 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_big (size_t size, enum palloc_flags flags);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -103,21 +104,7 @@ malloc (size_t size)
     if (d->block_size >= size)
       break;
   if (d == descs + desc_cnt) 
-    {
-      /* SIZE is too big for any descriptor.
-         Allocate enough pages to hold SIZE plus an arena. */
-      size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
-      if (a == NULL)
-        return NULL;
-
-      /* Initialize the arena to indicate a big block of PAGE_CNT
-         pages, and return it. */
-      a->magic = ARENA_MAGIC;
-      a->desc = NULL;
-      a->free_cnt = page_cnt;
-      return a + 1;
-    }
+    return malloc_big (size, 0);
 
   lock_acquire (&d->lock);
 
@@ -166,6 +153,11 @@ calloc (size_t a, size_t b)
   if (size < a || size < b)
     return NULL;
 
+  /* Big blocks come straight from the page allocator, which may
+     have pages zeroed in advance by the idle thread. */
+  if (size > descs[desc_cnt - 1].block_size)
+    return malloc_big (size, PAL_ZERO);
+
   /* Allocate and zero memory. */
   p = malloc (size);
   if (p != NULL)
@@ -174,6 +166,27 @@ calloc (size_t a, size_t b)
   return p;
 }
 
+/* Obtains a block of SIZE bytes, too big for any descriptor, by
+   allocating enough pages with FLAGS to hold SIZE plus an
+   arena.  Returns a null pointer if memory is not available. */
+static void *
+malloc_big (size_t size, enum palloc_flags flags)
+{
+  struct arena *a;
+  size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+
+  a = palloc_get_multiple (flags, page_cnt);
+  if (a == NULL)
+    return NULL;
+
+  /* Initialize the arena to indicate a big block of PAGE_CNT
+     pages, and return it. */
+  a->magic = ARENA_MAGIC;
+  a->desc = NULL;
+  a->free_cnt = page_cnt;
+  return a + 1;
+}
+
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) 
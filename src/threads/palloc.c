@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -15,37 +16,77 @@
    page-multiple) chunks.  See malloc.h for an allocator that
    hands out smaller chunks.
 
-   System memory is divided into two "pools" called the kernel
-   and user pools.  The user pool is for user (virtual) memory
-   pages, the kernel pool for everything else.  The idea here is
-   that the kernel needs to have memory for its own operations
-   even if user processes are swapping like mad.
-
-   By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   System memory is shared between kernel pages and user pages.
+   The user pages are for user (virtual) memory, the kernel pages
+   for everything else.  The idea here is that the kernel needs
+   to have memory for its own operations even if user processes
+   are swapping like mad.
+
+   All free memory lives in a single pool, and each side gets a
+   soft target instead of a fixed range.  By default half of the
+   free pages are the user target, or fewer with -ul, which also
+   caps user pages outright.  The kernel may always take a free
+   page, borrowing from the user share once it is past its own
+   target; user requests that fail because of that go through
+   eviction in vm/evict.c, which is how the user side reclaims
+   its frames.  The user side may grow past its target too, but
+   only while a quarter of the kernel's share stays free.
+   Kernel pages are searched for from the bottom of the pool and
+   user pages from the top, so the two rarely interleave.
+
+   The pool also remembers which of its free pages are known to
+   contain only zeros.  The idle thread fills that set through
+   palloc_zero_free_page(), and PAL_ZERO requests take pages from
+   it first so they can skip the memset on the critical path. */
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *user_map;            /* Pages allocated as PAL_USER. */
+    struct bitmap *zeroed_map;          /* Free pages known to be zero. */
+    size_t zeroed_cnt;                  /* Number of bits in zeroed_map. */
+    size_t zero_cursor;                 /* Where the idle zeroer resumes. */
+    size_t zero_pending;                /* Zeroed page not yet published. */
+    size_t page_cnt;                    /* Number of pages in the pool. */
+    size_t kernel_used;                 /* Pages allocated to the kernel. */
+    size_t user_used;                   /* Pages allocated as PAL_USER. */
+    size_t user_target;                 /* Soft target for user pages. */
+    size_t user_limit;                  /* Hard limit for user pages. */
+    size_t user_start;                  /* Where user searches begin. */
     uint8_t *base;                      /* Base of pool. */
   };
 
-/* Two pools: one for kernel data, one for user pages. */
-static struct pool kernel_pool, user_pool;
+/* The single pool all pages come from. */
+static struct pool pool;
+
+/* Free pages examined by one call to palloc_zero_free_page()
+   before it gives up and lets the idle thread halt. */
+#define ZERO_SCAN_MAX 64
+
+/* Statistics. */
+static long long zero_requests;  /* # of single PAL_ZERO pages requested. */
+static long long zero_hits;      /* # of those served already zeroed. */
+static long long idle_zeroed;    /* # of pages zeroed by the idle thread. */
+static size_t kernel_borrowed_max; /* Most pages the kernel borrowed. */
+static size_t user_over_max;       /* Most pages the user side went over. */
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
-
-/* Initialized in palloc_init */
-static void *user_pool_bottom;
-static void *user_pool_top;
-
-/* Initializes the page allocator.  At most USER_PAGE_LIMIT
-   pages are put into the user pool. */
+static bool user_may_allocate (const struct pool *, size_t page_cnt);
+static size_t scan_from (struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static void claim_pages (struct pool *, enum palloc_flags,
+                           size_t page_idx, size_t page_cnt);
+static void take_zeroed_pages (struct pool *, size_t page_idx,
+                               size_t page_cnt);
+static bool zero_free_page (struct pool *);
+
+/* Initializes the page allocator.  The user target is half of
+   the free pages, and at most USER_PAGE_LIMIT pages are ever
+   given out as user pages. */
 void
 palloc_init (size_t user_page_limit)
 {
@@ -53,74 +94,207 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_start = ptov (1024 * 1024);
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
-  if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
 
-  user_pool_bottom = free_start       + kernel_pages * PGSIZE;
-  user_pool_top    = user_pool_bottom + user_pages   * PGSIZE;
+  init_pool (&pool, free_start, free_pages, "unified pool");
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, user_pool_bottom, user_pages, "user pool");
+  pool.user_limit = user_page_limit;
+  pool.user_target = pool.page_cnt / 2;
+  if (pool.user_target > pool.user_limit)
+    pool.user_target = pool.user_limit;
+  pool.user_start = pool.page_cnt - pool.user_target;
+
+  printf ("Page targets: %zu kernel, %zu user.\n",
+          pool.page_cnt - pool.user_target, pool.user_target);
 }
 
-/* Used to determine the frame table poitner array size */
+/* Returns the lowest address a user page may be allocated at.
+   Used to determine the frame table pointer array size. */
 void *
 get_user_pool_bottom (void)
 {
-  return user_pool_bottom;
+  return pool.base;
 }
 
-/* Used to determine the frame table poitner array size */
+/* Returns the address just past the highest user page.
+   Used to determine the frame table pointer array size. */
 void *
 get_user_pool_top (void)
 {
-  return user_pool_top;
+  return pool.base + pool.page_cnt * PGSIZE;
+}
+
+/* Returns the number of pages that a PAL_USER request could
+   currently obtain without eviction. */
+size_t
+palloc_user_free_pages (void)
+{
+  size_t free_cnt = pool.page_cnt - pool.kernel_used - pool.user_used;
+  size_t headroom = pool.user_limit - pool.user_used;
+  return free_cnt < headroom ? free_cnt : headroom;
 }
 
-/* Updates the bitmap of a pool and returns the value of
-   bitmap_scan_and_flip. */
+/* Allocates PAGE_CNT contiguous pages for FLAGS from the pool
+   and returns the index of the first, or BITMAP_ERROR if not
+   enough pages are available to that side of the pool. */
 size_t
-update_pool_bitmap (enum palloc_flags flags, size_t page_cnt, bool value) 
+update_pool_bitmap (enum palloc_flags flags, size_t page_cnt, bool value)
 {
-  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  lock_acquire (&pool->lock);
-  size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, value);
-  lock_release (&pool->lock);
+  size_t page_idx = BITMAP_ERROR;
+
+  ASSERT (!value);
+
+  lock_acquire (&pool.lock);
+  if (!(flags & PAL_USER))
+    page_idx = bitmap_scan (pool.used_map, 0, page_cnt, false);
+  else if (user_may_allocate (&pool, page_cnt))
+    page_idx = scan_from (pool.used_map, pool.user_start, page_cnt, false);
+
+  if (page_idx != BITMAP_ERROR)
+    {
+      claim_pages (&pool, flags, page_idx, page_cnt);
+      take_zeroed_pages (&pool, page_idx, page_cnt);
+    }
+  lock_release (&pool.lock);
+  return page_idx;
+}
+
+/* Returns true if POOL may give PAGE_CNT more pages to the user
+   side.  Up to its target the user side competes for free pages
+   like the kernel; past it, it must leave a quarter of the
+   kernel's share free.  The hard limit always applies.
+   POOL's lock must be held. */
+static bool
+user_may_allocate (const struct pool *p, size_t page_cnt)
+{
+  size_t free_cnt = p->page_cnt - p->kernel_used - p->user_used;
+  size_t kernel_headroom = (p->page_cnt - p->user_target) / 4;
+
+  if (p->user_used + page_cnt > p->user_limit || free_cnt < page_cnt)
+    return false;
+  if (p->user_used + page_cnt <= p->user_target)
+    return true;
+  return free_cnt - page_cnt >= kernel_headroom;
+}
+
+/* Like bitmap_scan(), but starts looking at START and wraps
+   around to the beginning of B if nothing is found above it. */
+static size_t
+scan_from (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t idx = bitmap_scan (b, start, cnt, value);
+  if (idx == BITMAP_ERROR && start > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  return idx;
+}
+
+/* Marks the PAGE_CNT free pages at PAGE_IDX in use and counts
+   them as allocated with FLAGS.  POOL's lock must be held.  The
+   free path runs with interrupts off instead of taking the lock,
+   so interrupts are turned off here too while the bitmaps and
+   counters it shares are changed. */
+static void
+claim_pages (struct pool *p, enum palloc_flags flags,
+             size_t page_idx, size_t page_cnt)
+{
+  size_t kernel_target = p->page_cnt - p->user_target;
+  enum intr_level old_level = intr_disable ();
+
+  bitmap_set_multiple (p->used_map, page_idx, page_cnt, true);
+  if (flags & PAL_USER)
+    {
+      bitmap_set_multiple (p->user_map, page_idx, page_cnt, true);
+      p->user_used += page_cnt;
+      if (p->user_used > p->user_target
+          && p->user_used - p->user_target > user_over_max)
+        user_over_max = p->user_used - p->user_target;
+    }
+  else
+    {
+      p->kernel_used += page_cnt;
+      if (p->kernel_used > kernel_target
+          && p->kernel_used - kernel_target > kernel_borrowed_max)
+        kernel_borrowed_max = p->kernel_used - kernel_target;
+    }
+  intr_set_level (old_level);
+}
+
+/* Removes the pages PAGE_IDX...PAGE_IDX + PAGE_CNT - 1, which
+   are being allocated, from POOL's set of zeroed pages.
+   POOL's lock must be held. */
+static void
+take_zeroed_pages (struct pool *p, size_t page_idx, size_t page_cnt)
+{
+  size_t zeroed = bitmap_count (p->zeroed_map, page_idx, page_cnt, true);
+  if (zeroed > 0)
+    {
+      bitmap_set_multiple (p->zeroed_map, page_idx, page_cnt, false);
+      p->zeroed_cnt -= zeroed;
+    }
+}
+
+/* Allocates a single page for FLAGS from POOL's set of zeroed
+   free pages and returns its index, or BITMAP_ERROR if the set
+   is empty or that side of the pool may not grow. */
+static size_t
+get_zeroed_page (struct pool *p, enum palloc_flags flags)
+{
+  size_t page_idx = BITMAP_ERROR;
+
+  lock_acquire (&p->lock);
+  if (p->zeroed_cnt > 0
+      && (!(flags & PAL_USER) || user_may_allocate (p, 1)))
+    {
+      page_idx = scan_from (p->zeroed_map,
+                            flags & PAL_USER ? p->user_start : 0, 1, true);
+      ASSERT (page_idx != BITMAP_ERROR);
+      ASSERT (!bitmap_test (p->used_map, page_idx));
+      claim_pages (p, flags, page_idx, 1);
+      take_zeroed_pages (p, page_idx, 1);
+    }
+  lock_release (&p->lock);
+
   return page_idx;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
-   If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   If PAL_USER is set, the pages are counted as user pages,
+   otherwise as kernel pages.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
-  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
 
   if (page_cnt == 0)
     return NULL;
 
-  size_t page_idx = update_pool_bitmap (flags, page_cnt, false);
+  /* Single zeroed pages come from the idle thread's work first. */
+  bool prezeroed = false;
+  size_t page_idx = BITMAP_ERROR;
+  if ((flags & PAL_ZERO) && page_cnt == 1)
+    {
+      zero_requests++;
+      page_idx = get_zeroed_page (&pool, flags);
+      prezeroed = page_idx != BITMAP_ERROR;
+      if (prezeroed)
+        zero_hits++;
+    }
+  if (page_idx == BITMAP_ERROR)
+    page_idx = update_pool_bitmap (flags, page_cnt, false);
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    pages = pool.base + PGSIZE * page_idx;
   else
     pages = NULL;
 
-  if (pages != NULL) 
+  if (pages != NULL)
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !prezeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
-  else 
+  else
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
@@ -132,61 +306,162 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
 /* Obtains a single free page and returns its kernel virtual
    address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   If PAL_USER is set, the page is counted as a user page,
+   otherwise as a kernel page.  If PAL_ZERO is set in FLAGS,
    then the page is filled with zeros.  If no pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
-palloc_get_page (enum palloc_flags flags) 
+palloc_get_page (enum palloc_flags flags)
 {
   return palloc_get_multiple (flags, 1);
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+palloc_free_multiple (void *pages, size_t page_cnt)
 {
-  struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
+  size_t user_cnt;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
+  if (!page_from_pool (&pool, pages))
     NOT_REACHED ();
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  page_idx = pg_no (pages) - pg_no (pool.base);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  /* Pages may be freed by the scheduler with interrupts off, so
+     the pool lock cannot be taken here.  Turning interrupts off
+     instead excludes claim_pages(), which does the same while it
+     changes these bitmaps and counters, and zero_free_page() only
+     ever changes single bits of used_map, which is atomic. */
+  old_level = intr_disable ();
+  ASSERT (bitmap_all (pool.used_map, page_idx, page_cnt));
+  user_cnt = bitmap_count (pool.user_map, page_idx, page_cnt, true);
+  if (user_cnt > 0)
+    bitmap_set_multiple (pool.user_map, page_idx, page_cnt, false);
+  pool.user_used -= user_cnt;
+  pool.kernel_used -= page_cnt - user_cnt;
+  bitmap_set_multiple (pool.used_map, page_idx, page_cnt, false);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
 void
-palloc_free_page (void *page) 
+palloc_free_page (void *page)
 {
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page that is not yet known to be zero, so
+   that a later PAL_ZERO request can skip the work.  Meant to be
+   called by the idle thread with interrupts on: it never blocks,
+   and the page is marked in use while it is being zeroed.
+   Returns false if no such page was found. */
+bool
+palloc_zero_free_page (void)
+{
+  return zero_free_page (&pool);
+}
+
+/* Zeroes a free page of POOL for palloc_zero_free_page(). */
+static bool
+zero_free_page (struct pool *p)
+{
+  size_t page_idx = BITMAP_ERROR;
+  int probes;
+
+  /* The idle thread must not sleep on the pool lock.  No other
+     thread is ready when it runs, so the lock is almost always
+     free; if it is not, try again on the next idle period. */
+  if (p->page_cnt == 0 || !lock_try_acquire (&p->lock))
+    return false;
+
+  /* Publish a page zeroed last time but left claimed because the
+     lock was busy then. */
+  if (p->zero_pending != BITMAP_ERROR)
+    {
+      page_idx = p->zero_pending;
+      goto publish;
+    }
+
+  for (probes = 0; probes < ZERO_SCAN_MAX; probes++)
+    {
+      size_t idx = bitmap_scan (p->used_map, p->zero_cursor, 1, false);
+      if (idx == BITMAP_ERROR)
+        {
+          /* Wrap around, stopping if the whole pool is in use. */
+          if (p->zero_cursor == 0)
+            break;
+          p->zero_cursor = 0;
+          continue;
+        }
+      p->zero_cursor = idx + 1 < p->page_cnt ? idx + 1 : 0;
+      if (!bitmap_test (p->zeroed_map, idx))
+        {
+          page_idx = idx;
+          break;
+        }
+    }
+  if (page_idx == BITMAP_ERROR)
+    {
+      lock_release (&p->lock);
+      return false;
+    }
+
+  /* Claim the page so nobody allocates it while it is zeroed.
+     It is not counted against either side meanwhile. */
+  bitmap_mark (p->used_map, page_idx);
+  lock_release (&p->lock);
+
+  memset (p->base + PGSIZE * page_idx, 0, PGSIZE);
+  idle_zeroed++;
+
+  if (!lock_try_acquire (&p->lock))
+    {
+      p->zero_pending = page_idx;
+      return true;
+    }
+
+ publish:
+  p->zero_pending = BITMAP_ERROR;
+  bitmap_mark (p->zeroed_map, page_idx);
+  bitmap_reset (p->used_map, page_idx);
+  p->zeroed_cnt++;
+  lock_release (&p->lock);
+  return true;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Palloc: %lld zeroed pages requested, %lld served pre-zeroed, "
+          "%lld zeroed while idle\n",
+          zero_requests, zero_hits, idle_zeroed);
+  printf ("Palloc: kernel borrowed up to %zu user pages, "
+          "user went up to %zu pages over target\n",
+          kernel_borrowed_max, user_over_max);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map, user_map and zeroed_map at its
+     base.  Calculate the space needed for the bitmaps
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (3 * bm_size, PGSIZE);
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -195,18 +470,29 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 
   /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->user_map = bitmap_create_in_buf (page_cnt, (uint8_t *) base + bm_size,
+                                      bm_size);
+  p->zeroed_map = bitmap_create_in_buf (page_cnt,
+                                        (uint8_t *) base + 2 * bm_size,
+                                        bm_size);
+  p->zeroed_cnt = 0;
+  p->zero_cursor = 0;
+  p->zero_pending = BITMAP_ERROR;
+  p->page_cnt = page_cnt;
+  p->kernel_used = 0;
+  p->user_used = 0;
   p->base = base + bm_pages * PGSIZE;
 }
 
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+page_from_pool (const struct pool *p, void *page)
 {
   size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t start_page = pg_no (p->base);
+  size_t end_page = start_page + bitmap_size (p->used_map);
 
   return page_no >= start_page && page_no < end_page;
 }
@@ -21,7 +21,11 @@ size_t update_pool_bitmap (enum palloc_flags flags,
                            size_t page_cnt, 
                            bool value);
 
+bool palloc_zero_free_page (void);
+void palloc_print_stats (void);
+
 void *get_user_pool_bottom (void);
 void *get_user_pool_top    (void);
+size_t palloc_user_free_pages (void);
 
 #endif /* threads/palloc.h */
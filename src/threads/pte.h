@@ -66,6 +66,7 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_G 0x100             /* 1=global, survives CR3 loads (PTEs only). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -103,5 +104,14 @@ static inline void *pte_get_page (uint32_t pte) {
   return ptov (pte & PTE_ADDR);
 }
 
+/* Invalidates the TLB entry for virtual address VA, including a
+   global one.  Much cheaper than reloading CR3 when only a single
+   mapping changed, and it leaves every other cached translation
+   intact.  See [IA32-v2a] "INVLPG" and [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)". */
+static inline void invlpg (const void *va) {
+  asm volatile ("invlpg (%0)" : : "r" (va) : "memory");
+}
+
 #endif /* threads/pte.h */
 
@@ -18,6 +18,10 @@
 #ifdef VM
 #include "vm/spt.h"
 #include "vm/mmap.h"
+#include "vm/vma.h"
+#include "vm/reclaim.h"
+#include "vm/swap.h"
+#include "vm/pff.h"
 #endif
 
 /* Random value for struct thread's `magic' member.
@@ -59,6 +63,9 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Most free pages the idle thread zeroes between two halts. */
+#define IDLE_ZERO_PAGES 16
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-mlfqs". */
@@ -263,8 +270,11 @@ thread_create (const char *name, int priority,
 
 #ifdef VM
   if (!spt_init (&t->spt_ptr)) return TID_ERROR;
+  t->vma_root = NULL;
   list_init (&t->mmap_list);
   t->mid_cnt = 0;
+  t->swap_cluster_next = t->swap_cluster_end = 0;
+  pff_init_thread (t);
 #endif
 
   /* Add to run queue. */
@@ -401,10 +411,21 @@ thread_exit (void)
 
 #ifdef VM
 
-  if (t_ptr != initial_thread && !list_empty (&t_ptr->mmap_list))
+  /* Every thread but the initial one has a supplemental page table, and
+     destroying it is what hands the process's frames back, so it must
+     happen before the page directory goes. */
+  if (t_ptr != initial_thread)
     {
-      mmap_remove_all (&t_ptr->mmap_list);
+      if (!list_empty (&t_ptr->mmap_list))
+          mmap_remove_all (&t_ptr->mmap_list);
+      pff_report_exit ();
+      acquire_ft ();
       spt_destroy (t_ptr->spt_ptr);
+      swap_release_cluster (t_ptr->swap_cluster_next,
+                            t_ptr->swap_cluster_end);
+      release_ft ();
+      t_ptr->spt_ptr = NULL;
+      vma_destroy ();
     }
 
 
@@ -511,7 +532,12 @@ thread_get_recent_cpu (void)
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   special case when the ready list is empty.
+
+   Before halting, the idle thread zeroes up to IDLE_ZERO_PAGES
+   free pages, one at a time, stopping as soon as another thread
+   becomes ready, so that palloc_get_page(PAL_ZERO) can later
+   hand them out without zeroing them on the critical path. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
@@ -521,10 +547,29 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      int zeroed;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages in small chunks while nobody needs the
+         CPU.  The checks of the ready list are only hints; the
+         scheduler preempts us normally if a thread wakes up. */
+      intr_enable ();
+      for (zeroed = 0; zeroed < IDLE_ZERO_PAGES; zeroed++)
+        if (!list_empty (&ready_list) || !palloc_zero_free_page ())
+          break;
+#ifdef VM
+      /* With nothing else to do, let the reclaim daemon write back
+         dirty frames ahead of their eviction. */
+      if (list_empty (&ready_list))
+        reclaim_idle ();
+#endif
+      intr_disable ();
+      if (!list_empty (&ready_list))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -109,13 +109,27 @@ struct thread
     int fd_cnt;                      /* Unique file descriptor for hash_fd */
     struct hash *hash_fd_ptr;        /* Hashtable to map fds to file ptrs */
     struct file *executable;         /* Current executable file */
+    struct intr_frame *syscall_frame; /* Frame of the system call. */
+    int tlb_batch_depth;             /* Nesting of pagedir_batch_begin. */
+    int tlb_batch_cnt;               /* Invalidations in the open batch. */
 
 #endif
 #ifdef VM
-    struct hash *spt_ptr;
+    struct spt *spt_ptr;
+    struct vma *vma_root;               /* Tree of memory regions. */
     struct list mmap_list;
     int mid_cnt;
     void *esp;
+    int swap_cluster_next;              /* Swap slots reserved for this */
+    int swap_cluster_end;               /* process's evictions. */
+    size_t rss;                         /* Frames resident, see pff.c. */
+    size_t rss_peak;
+    size_t rss_allowance;               /* Set by fault frequency. */
+    size_t rss_limit;                   /* Hard limit, 0 if none. */
+    size_t exec_rss_limit;              /* Limit for processes we exec. */
+    int64_t pff_window_start;           /* Fault rate measurement. */
+    int pff_window_faults;
+    int pff_rate;                       /* Faults per second. */
 #endif
 
     /* Owned by thread.c. */
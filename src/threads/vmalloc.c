@@ -0,0 +1,147 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+
+/* Virtually contiguous kernel allocator.
+
+   palloc_get_multiple() needs a physically contiguous run of
+   pages, which gets harder to find the longer the system runs.
+   vmalloc() instead allocates each page on its own and maps the
+   pages next to each other in a region of kernel virtual memory
+   set aside for the purpose, so large tables only need free
+   memory, not contiguous free memory.
+
+   Every area is followed by an unmapped guard page, so running
+   off the end of one faults instead of corrupting its neighbour.
+   vfree() uses the guard page to find where the area ends.
+
+   The region's page tables are created by vmalloc_init() before
+   any process page directory is made.  pagedir_create() copies
+   the kernel part of init_page_dir, so every page directory
+   shares those page tables and sees mappings made later. */
+
+#define VMALLOC_PAGES (VMALLOC_SIZE / PGSIZE)
+
+static struct lock vmalloc_lock;
+static struct bitmap *vmalloc_map;      /* Reserved region pages. */
+
+static uint32_t *lookup_pte (const void *vaddr);
+
+/* Creates the page tables for the vmalloc region.  Must be
+   called after paging_init() and before any page directory is
+   created. */
+void
+vmalloc_init (void)
+{
+  uint8_t *vaddr;
+  size_t bm_size = bitmap_buf_size (VMALLOC_PAGES);
+
+  ASSERT (bm_size <= PGSIZE);
+  ASSERT (pg_ofs (VMALLOC_START) == 0);
+
+  for (vaddr = VMALLOC_START; vaddr < VMALLOC_END; vaddr += PGSIZE << 10)
+    {
+      uint32_t *pde = init_page_dir + pd_no (vaddr);
+      ASSERT (*pde == 0);
+      *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+    }
+
+  lock_init (&vmalloc_lock);
+  vmalloc_map = bitmap_create_in_buf (VMALLOC_PAGES,
+                                      palloc_get_page (PAL_ASSERT), bm_size);
+}
+
+/* Returns the page table entry for VADDR in the vmalloc region. */
+static uint32_t *
+lookup_pte (const void *vaddr)
+{
+  ASSERT (is_vmalloc_vaddr (vaddr));
+  return pde_get_pt (init_page_dir[pd_no (vaddr)]) + pt_no (vaddr);
+}
+
+/* Obtains and returns a new block of at least SIZE bytes that is
+   contiguous in kernel virtual memory but not necessarily in
+   physical memory.  The block is page-aligned.  Returns a null
+   pointer if the region or memory is exhausted. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t page_idx, i;
+  uint8_t *area;
+
+  if (page_cnt == 0)
+    return NULL;
+
+  /* Reserve the pages and the guard page after them. */
+  lock_acquire (&vmalloc_lock);
+  page_idx = bitmap_scan_and_flip (vmalloc_map, 0, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+  if (page_idx == BITMAP_ERROR)
+    return NULL;
+  area = VMALLOC_START + page_idx * PGSIZE;
+
+  /* The page table entries were not present before, so there is
+     nothing to flush from the TLB. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *kpage = palloc_get_page (0);
+      if (kpage == NULL)
+        goto fail;
+      *lookup_pte (area + i * PGSIZE) = pte_create_kernel (kpage, true)
+                                        | PTE_G;
+    }
+  return area;
+
+ fail:
+  while (i-- > 0)
+    {
+      uint32_t *pte = lookup_pte (area + i * PGSIZE);
+      palloc_free_page (pte_get_page (*pte));
+      *pte = 0;
+      invlpg (area + i * PGSIZE);
+    }
+  lock_acquire (&vmalloc_lock);
+  bitmap_set_multiple (vmalloc_map, page_idx, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+  return NULL;
+}
+
+/* Frees block P, which must have been previously allocated with
+   vmalloc().  If P is a null pointer, does nothing. */
+void
+vfree (void *p)
+{
+  uint8_t *vaddr = p;
+  size_t page_idx, page_cnt;
+
+  if (p == NULL)
+    return;
+
+  ASSERT (pg_ofs (p) == 0);
+  page_idx = (vaddr - VMALLOC_START) / PGSIZE;
+
+  /* Unmap pages up to the guard page. */
+  for (page_cnt = 0; ; page_cnt++, vaddr += PGSIZE)
+    {
+      uint32_t *pte = lookup_pte (vaddr);
+      if ((*pte & PTE_P) == 0)
+        break;
+      palloc_free_page (pte_get_page (*pte));
+      *pte = 0;
+      invlpg (vaddr);
+    }
+  ASSERT (page_cnt > 0);
+
+  lock_acquire (&vmalloc_lock);
+  ASSERT (bitmap_all (vmalloc_map, page_idx, page_cnt + 1));
+  bitmap_set_multiple (vmalloc_map, page_idx, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+}
@@ -0,0 +1,28 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Kernel virtual region for vmalloc(), above the direct map of
+   physical memory.  The direct map never reaches it because the
+   loader limits RAM to 64 MB. */
+#define VMALLOC_START ((uint8_t *) PHYS_BASE + 0x30000000)  /* 3.75 GB. */
+#define VMALLOC_SIZE  (64 * 1024 * 1024)
+#define VMALLOC_END   (VMALLOC_START + VMALLOC_SIZE)
+
+void vmalloc_init (void);
+void *vmalloc (size_t) __attribute__ ((malloc));
+void vfree (void *);
+
+/* Returns true if VADDR lies in the vmalloc region. */
+static inline bool
+is_vmalloc_vaddr (const void *vaddr)
+{
+  return (const uint8_t *) vaddr >= VMALLOC_START
+         && (const uint8_t *) vaddr < VMALLOC_END;
+}
+
+#endif /* threads/vmalloc.h */
@@ -1,5 +1,4 @@
 #include "userprog/exception.h"
-#include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
@@ -7,19 +6,40 @@
 #include "threads/vaddr.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
 #include "filesys/filesys.h"
 #include "vm/spt.h"
 #include "vm/ft.h"
+#include "vm/pff.h"
+#include "vm/trace.h"
+#include "vm/vmstat.h"
+#include "vm/vma.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Reads of zero pages given the shared zero frame, and writes that then
+   needed frames of their own. */
+static long long zero_map_cnt;
+static long long zero_cow_cnt;
+
+/* Writes to pages shared copy on write by fork. */
+static long long fork_cow_cnt;
+
+/* Resident file pages mapped along with a faulting one. */
+static long long fault_around_cnt;
+
+static inline uint64_t read_tsc (void);
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 /* Page fault handler helpers */
-static bool attempt_stack_growth (void *esp, const void *fault_addr);
-static bool attempt_frame_load (struct spte *spte_ptr, bool left_pinned);
+static bool attempt_stack_growth (void *esp, const void *fault_addr,
+                                  bool left_pinned);
+static bool attempt_frame_load (struct spte *spte_ptr, bool write, 
+                                bool left_pinned, bool counted,
+                                enum vmstat_fault *fault_ptr);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -72,6 +92,20 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  printf ("Zero page: %lld reads mapped it, %lld writes copied it\n",
+          zero_map_cnt, zero_cow_cnt);
+  printf ("Fork: %lld writes broke copy on write sharing\n", fork_cow_cnt);
+  printf ("Fault-around: %lld resident file pages mapped with faults\n",
+          fault_around_cnt);
+}
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+read_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -119,22 +153,27 @@ void
 page_fault_trigger (const void *fault_addr, void *esp, bool not_present, 
                     bool write, bool user, bool left_pinned)
 {
+  uint64_t start = read_tsc ();
+
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
   intr_enable ();
 
-  struct spte *spte_ptr = spt_find_entry (thread_current ()->spt_ptr, 
-                                          pg_round_down (fault_addr));
+  struct spte *spte_ptr = vma_get_entry (pg_round_down (fault_addr));
+  enum frame_type frame_type = STACK;
+  enum vmstat_fault fault = VMSTAT_FAULT_STACK;
 
   if (spte_ptr != NULL)
     {
+      frame_type = spte_ptr->frame_type;
       if ((write && !spte_ptr->writable) ||
-          !attempt_frame_load (spte_ptr, left_pinned))
+          !attempt_frame_load (spte_ptr, write, left_pinned, true, &fault))
         goto fail;
     }
-  else if (!attempt_stack_growth (esp, fault_addr)) 
+  else if (!attempt_stack_growth (esp, fault_addr, left_pinned)) 
       goto fail;
 
+  vmstat_count_fault (frame_type, fault, read_tsc () - start);
   return;
 
 fail:
@@ -149,6 +188,22 @@ fail:
   syscall_exit (-1);
 }
 
+/* Brings in the page at UPAGE, which must be in one of the current
+   thread's regions, as a fault on it would, but without counting it as
+   a fault. Writable pages are loaded as if written, so that they get
+   frames of their own. Returns false if the page could not be loaded,
+   leaving the process to carry on. */
+bool
+page_populate (void *upage)
+{
+  struct spte *spte_ptr = vma_get_entry (upage);
+  enum vmstat_fault fault;
+
+  return spte_ptr != NULL &&
+         attempt_frame_load (spte_ptr, spte_ptr->writable, false, false,
+                             &fault);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to task 2 may
    also require modifying this code.
@@ -182,16 +237,61 @@ page_fault (struct intr_frame *f_ptr)
   /* True: access by user, false: access by kernel. */
   bool user        = (f_ptr->error_code & PF_U) != 0;
 
+  /* vmalloc areas are mapped up front, so a fault there is the kernel
+     running into a guard page */
+  if (!user && is_vmalloc_vaddr (fault_addr))
+      PANIC ("Kernel fault in vmalloc guard page at %p", fault_addr);
+
   page_fault_trigger (fault_addr, f_ptr->esp, not_present, write, user, false);
 }
 
-/* Attempts to load the given frame from an spte entry */
+/* Attempts to load the given frame from an spte entry, setting FAULT_PTR
+   to how it was found. If COUNTED, a load that gives the page a frame
+   counts as a fault of the current thread for pff, under the hold of
+   ft_lock that installs the frame. Pages mapped to the zero frame bring
+   no frame in, and are not counted. */
 static bool
-attempt_frame_load (struct spte *spte_ptr, bool left_pinned)
+attempt_frame_load (struct spte *spte_ptr, bool write, bool left_pinned,
+                    bool counted, enum vmstat_fault *fault_ptr)
 {
-  /* Returns null if read failed, obtaining frame, or allocating fte failed */
+  *fault_ptr = VMSTAT_FAULT_MINOR;
+
+  /* A page of zeros that is only read is mapped to the shared zero frame.
+     Writing it then faults, and it gets a frame of its own. There is
+     nothing to pin, as the zero frame is never evicted. */
+  if (spte_ptr->zero_mapped)
+    {
+      if (!write)
+          return true;
+      ft_unmap_zero_page (spte_ptr);
+      zero_cow_cnt++;
+    }
+  else if (!write && spte_ptr->frame_type == ALL_ZERO && 
+           spte_ptr->fte_ptr == NULL)
+    {
+      if (!ft_map_zero_page (spte_ptr))
+          return false;
+      *fault_ptr = VMSTAT_FAULT_ZERO;
+      zero_map_cnt++;
+      return true;
+    }
+
+  /* A page shared with a process forked from or by this one faults when
+     it is written, whether mapped or not, and the writer takes a copy */
   acquire_ft ();
-  struct fte *fte_ptr = ft_get_frame (spte_ptr);
+  struct fte *fte_ptr = ft_stable_frame (spte_ptr);
+  if (write && fte_ptr != NULL && fte_ptr->cow)
+    {
+      bool success = ft_break_cow (spte_ptr, left_pinned);
+      if (success && counted)
+          pff_fault ();
+      release_ft ();
+      fork_cow_cnt++;
+      return success;
+    }
+
+  /* Returns null if read failed, obtaining frame, or allocating fte failed */
+  fte_ptr = ft_get_frame (spte_ptr, fault_ptr);
   release_ft ();
   if (fte_ptr == NULL) 
       goto fail_1;
@@ -200,6 +300,16 @@ attempt_frame_load (struct spte *spte_ptr, bool left_pinned)
   acquire_ft ();
   if (!ft_install_frame (spte_ptr, fte_ptr)) 
       goto fail_2;
+  trace_fault (fte_ptr);
+  if (counted)
+      pff_fault ();
+
+  /* A file page brings its resident neighbours with it, and a sequential
+     run of them the pages that follow. Pages scanned sequentially are
+     given up on once passed. */
+  fault_around_cnt += ft_fault_around (spte_ptr);
+  ft_readahead (spte_ptr);
+  ft_drop_behind (spte_ptr);
 
   /* Leave the frame pinned if left_pinned, for usage in syscall handlers */
   ASSERT (fte_ptr->pin_cnt >= 0);
@@ -213,9 +323,10 @@ attempt_frame_load (struct spte *spte_ptr, bool left_pinned)
   fail_1: return false;
 }
 
-/* Grows stack if fault_addr was a valid stack access, fails otherwise */
+/* Grows stack if fault_addr was a valid stack access, fails otherwise.
+   The new page's frame is left pinned if LEFT_PINNED. */
 static bool
-attempt_stack_growth (void *esp, const void *fault_addr)
+attempt_stack_growth (void *esp, const void *fault_addr, bool left_pinned)
 {
   /* Fault was a valid stack access, we need to bring in a new page */
   // DELETE: CERTAINLY WHERE FAILURE HAPPENS
@@ -231,10 +342,16 @@ attempt_stack_growth (void *esp, const void *fault_addr)
       fault_addr != esp - 32) 
       goto fail;
 
-  struct spte *spte_ptr = spt_add_entry (thread_current ()->spt_ptr, 
-      pg_round_down (fault_addr), STACK, NULL, 0, PGSIZE, true);
+  /* The stack region is extended down to the page, which then gets its
+     entry from it like any other */
+  void *upage = pg_round_down (fault_addr);
+  if (!vma_grow_stack (upage))
+      goto fail;
 
-  if (spte_ptr != NULL && attempt_frame_load (spte_ptr, false)) 
+  struct spte *spte_ptr = vma_get_entry (upage);
+  enum vmstat_fault fault;
+  if (spte_ptr != NULL && 
+      attempt_frame_load (spte_ptr, true, left_pinned, true, &fault))
       return true;
 
 fail:
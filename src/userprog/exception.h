@@ -12,5 +12,6 @@ void exception_print_stats (void);
 
 void page_fault_trigger (const void *fault_addr, void *esp, bool not_present, 
                          bool write, bool user, bool left_pinned);
+bool page_populate (void *upage);
 
 #endif /* userprog/exception.h */
@@ -1,6 +1,8 @@
 #include "userprog/fd_table.h"
 #include "userprog/syscall.h"
 #include "threads/malloc.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
 #include <hash.h>
 
 /* Initialises a fd_item and inserts it into the given thread's hash map */
@@ -81,3 +83,41 @@ fd_hash_free (struct hash_elem *e, void *aux UNUSED)
   free (fd_item_ptr);
 }
 
+/* Gives the current thread, a child forked from PARENT_PTR, the same file
+   descriptors as its parent. Each refers to a file of its own, reopened at
+   the same position. Returns false on any allocation failure */
+bool
+copy_fd_table (struct thread *parent_ptr)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  acquire_filesys ();
+  hash_first (&i, parent_ptr->hash_fd_ptr);
+  while (hash_next (&i))
+    {
+      struct fd_item *parent_item_ptr 
+          = hash_entry (hash_cur (&i), struct fd_item, hash_elem);
+      struct fd_item *fd_item_ptr = malloc (sizeof (struct fd_item));
+      struct file *fp = fd_item_ptr != NULL 
+                            ? file_reopen (parent_item_ptr->file_ptr) 
+                            : NULL;
+      if (fp == NULL)
+        {
+          free (fd_item_ptr);
+          success = false;
+          break;
+        }
+      file_seek (fp, file_tell (parent_item_ptr->file_ptr));
+
+      fd_item_ptr->fd = parent_item_ptr->fd;
+      fd_item_ptr->pid = (pid_t) t->tid;
+      fd_item_ptr->file_ptr = fp;
+      hash_insert (t->hash_fd_ptr, &fd_item_ptr->hash_elem);
+    }
+  release_filesys ();
+
+  t->fd_cnt = parent_ptr->fd_cnt;
+  return success;
+}
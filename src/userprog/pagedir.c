@@ -5,9 +5,18 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+
+/* Within a batch, the first TLB_BATCH_INVLPG_MAX invalidations
+   are done with invlpg as they happen.  Past that a single CR3
+   reload at the end of the batch is cheaper than more invlpgs,
+   and with global kernel mappings it only drops user entries. */
+#define TLB_BATCH_INVLPG_MAX 32
 
 uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vaddr);
+static void load_pagedir (uint32_t *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -33,15 +42,23 @@ pagedir_destroy (uint32_t *pd)
     return;
 
   ASSERT (pd != init_page_dir);
+  ASSERT (active_pd () != pd);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
         
+#ifndef VM
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
+#else
+        /* User frames belong to the frame table, which unmapped them
+           all when the supplemental page table was destroyed. */
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+          ASSERT ((*pte & PTE_P) == 0);
+#endif
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
@@ -97,13 +114,23 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
    failed. */
 bool
 pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
+
+  return pagedir_set_frame (pd, upage, vtop (kpage), writable);
+}
+
+/* Like pagedir_set_page(), but takes the physical address PADDR
+   of the frame, which need not be in the kernel's direct map. */
+bool
+pagedir_set_frame (uint32_t *pd, void *upage, uintptr_t paddr, bool writable)
 {
   uint32_t *pte;
 
   ASSERT (pg_ofs (upage) == 0);
-  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT ((paddr & PGMASK) == 0);
   ASSERT (is_user_vaddr (upage));
-  ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
   ASSERT (pd != init_page_dir);
 
   pte = lookup_page (pd, upage, true);
@@ -111,7 +138,7 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
   if (pte != NULL) 
     {
       ASSERT ((*pte & PTE_P) == 0);
-      *pte = pte_create_user (kpage, writable);
+      *pte = paddr | PTE_P | PTE_U | (writable ? PTE_W : 0);
       return true;
     }
   else
@@ -121,7 +148,9 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
-   UADDR is unmapped. */
+   UADDR is unmapped.  The page must be in the direct map; use
+   pagedir_is_mapped() to test pages that may be in high
+   memory. */
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
@@ -136,6 +165,53 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Returns true if user virtual address UADDR is mapped in PD. */
+bool
+pagedir_is_mapped (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pte;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  return pte != NULL && (*pte & PTE_P) != 0;
+}
+
+/* Returns true if user virtual address UADDR is mapped writable in
+   PD. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pte;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Sets the read/write bit of the PTE for user virtual page UPAGE
+   in PD to WRITABLE, if it is mapped.  The accessed and dirty bits
+   are preserved. */
+void
+pagedir_set_writable (uint32_t *pd, const void *upage, bool writable)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, upage);
+    }
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -152,7 +228,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +256,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,19 +285,76 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Clears BITS, any of PTE_P, PTE_A and PTE_D, in PTE, the page
+   table entry for user virtual page UPAGE in PD as returned by
+   lookup_page(), invalidating the TLB entry if any were set.
+   Returns which of BITS were set.  Callers that keep a pointer to
+   the PTE of a page use this to skip the page table walk. */
+uint32_t
+pagedir_pte_clear (uint32_t *pd, uint32_t *pte, const void *upage,
+                   uint32_t bits)
+{
+  uint32_t set = *pte & bits;
+
+  ASSERT ((bits & ~(uint32_t) (PTE_P | PTE_A | PTE_D)) == 0);
+
+  if (set != 0)
+    {
+      *pte &= ~set;
+      invalidate_page (pd, upage);
+    }
+  return set;
+}
+
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already loaded, in which case the TLB
+   entries cached for it are kept. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
 
+  if (active_pd () != pd)
+    load_pagedir (pd);
+}
+
+/* Opens a batch of page table changes in the running process's
+   page directory, such as unmapping a whole mmap region.
+   Batches nest; invalidations are finished off by the outermost
+   pagedir_batch_end(). */
+void
+pagedir_batch_begin (void)
+{
+  thread_current ()->tlb_batch_depth++;
+}
+
+/* Closes a batch opened by pagedir_batch_begin(), flushing the
+   TLB once if the batch deferred any invalidations. */
+void
+pagedir_batch_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->tlb_batch_depth > 0);
+  if (--t->tlb_batch_depth > 0)
+    return;
+
+  if (t->tlb_batch_cnt > TLB_BATCH_INVLPG_MAX && t->pagedir != NULL)
+    invalidate_pagedir (t->pagedir);
+  t->tlb_batch_cnt = 0;
+}
+
+/* Stores PD into CR3 unconditionally, which also flushes every
+   non-global TLB entry. */
+static void
+load_pagedir (uint32_t *pd)
+{
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -258,6 +391,26 @@ invalidate_pagedir (uint32_t *pd)
     {
       /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      load_pagedir (pd);
     } 
 }
+
+/* Invalidates the TLB entry for VADDR if PD is the active page
+   directory.  Inside a batch opened by the owner of PD, only the
+   first TLB_BATCH_INVLPG_MAX pages are invalidated one by one;
+   the rest are covered by the flush in pagedir_batch_end(). */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  struct thread *t;
+
+  if (active_pd () != pd)
+    return;
+
+  t = thread_current ();
+  if (t->pagedir == pd && t->tlb_batch_depth > 0
+      && t->tlb_batch_cnt++ >= TLB_BATCH_INVLPG_MAX)
+    return;
+
+  invlpg (vaddr);
+}
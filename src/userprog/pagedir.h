@@ -9,13 +9,21 @@ uint32_t *active_pd (void);
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_set_frame (uint32_t *pd, void *upage, uintptr_t paddr, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+bool pagedir_is_mapped (uint32_t *pd, const void *upage);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+uint32_t pagedir_pte_clear (uint32_t *pd, uint32_t *pte, const void *upage,
+                            uint32_t bits);
 void pagedir_activate (uint32_t *pd);
+void pagedir_batch_begin (void);
+void pagedir_batch_end (void);
 
 uint32_t *lookup_page (uint32_t *pd, const void *vaddr, bool create);
 
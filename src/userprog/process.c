@@ -23,8 +23,11 @@
 #include "threads/vaddr.h"
 #include "vm/ft.h"
 #include "vm/spt.h"
+#include "vm/mmap.h"
+#include "vm/vma.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static bool process_wait_for_load (tid_t child_tid);
 static bool test_overflow (int argc, char **argv, void *esp);
@@ -161,6 +164,89 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* What a child needs from the parent forking it, which waits for the child
+   to finish copying it */
+struct fork_args
+  {
+    struct thread *parent_ptr;  /* The forking thread */
+    struct intr_frame if_;      /* Its frame for the fork system call */
+  };
+
+/* Starts a new thread running a copy of the current user process, which
+   returns from the system call with frame F as well, but with a result of
+   0. Pages are not copied, but shared until either process writes them.
+   Returns the new process's thread id, or TID_ERROR if the thread cannot
+   be created or the copy fails. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct fork_args *args_ptr = malloc (sizeof (struct fork_args));
+  if (args_ptr == NULL)
+    return TID_ERROR;
+  args_ptr->parent_ptr = thread_current ();
+  args_ptr->if_        = *f;
+
+  tid_t tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, 
+                             args_ptr);
+  if (tid == TID_ERROR || !process_wait_for_load (tid))
+    tid = TID_ERROR;
+  free (args_ptr);
+  return tid;
+}
+
+/* A thread function that copies the process that forked it and starts it
+   running. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args_ptr = args_;
+  struct thread *parent_ptr  = args_ptr->parent_ptr;
+  struct thread *t           = thread_current ();
+  struct intr_frame if_      = args_ptr->if_;
+  bool success               = false;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL) 
+    goto done;
+  process_activate ();
+
+  if (!copy_fd_table (parent_ptr) || !mmap_fork (parent_ptr))
+    goto done;
+
+  if (!vma_fork (parent_ptr))
+    goto done;
+  t->rss_limit = parent_ptr->rss_limit;
+
+  acquire_ft ();
+  success = spt_fork (t->spt_ptr, parent_ptr);
+  release_ft ();
+  if (!success)
+    goto done;
+
+  acquire_filesys ();
+  t->executable = file_reopen (parent_ptr->executable);
+  if (t->executable != NULL)
+    file_deny_write (t->executable);
+  release_filesys ();
+  success = t->executable != NULL;
+
+ done:
+  /* The parent, and with it ARGS_PTR, may be gone once it is woken */
+  t->self_child_ptr->load_successful = success;
+  if (!success) 
+    {
+      t->self_child_ptr->tid = TID_ERROR;
+      sema_up (&t->self_child_ptr->load_sema);
+      thread_exit ();
+    }
+  sema_up (&t->self_child_ptr->load_sema);
+
+  /* The child sees fork return 0 */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 static struct child *
 find_child (struct thread *parent, tid_t child_tid)
 {
@@ -290,8 +376,13 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  Kernel-only threads have no
+     address space of their own and run on whichever page
+     directory is loaded, since the kernel half is shared by all
+     of them; skipping the CR3 load keeps the last process's TLB
+     entries warm for when it runs again. */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -366,6 +457,8 @@ static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
+static bool load_page_over (struct file *file, off_t ofs, uint8_t *upage,
+                            size_t page_read_bytes, bool writable);
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
@@ -552,49 +645,73 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
+  /* Segments may overlap those loaded before them, by a page where one
+     ends and the next starts, or by more in a binary that asks for it.
+     Pages already in a region get an entry of their own, taking on this
+     segment's contents, and each run of pages that are not becomes a 
+     region, whose pages are given entries as they are faulted in. */
+  while (read_bytes > 0 || zero_bytes > 0)
     {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-      
-      /* Check if virtual page already allocated */
-      struct thread *t = thread_current ();
-      struct spte *spte_ptr = spt_find_entry (t->spt_ptr, upage);
-
-      enum frame_type frame_type;
-
-      if   (writable)  frame_type = EXECUTABLE_DATA;
-      else             frame_type = EXECUTABLE_CODE;
-
-      if (spte_ptr == NULL) 
+      if (!vma_range_free (upage, 1))
         {
-          spt_add_entry (t->spt_ptr,
-                         upage,
-                         frame_type,
-                         (frame_type == ALL_ZERO) ? NULL : file->inode,
-                         (frame_type == ALL_ZERO) ? 0    : ofs,
-                         page_read_bytes,
-                         writable);
-        }
-      else
-        {
-          /* If either frame had type executable data, this one should too
-             to make it writable */
-          spte_ptr->writable       |= writable;
-          spte_ptr->amount_occupied = page_read_bytes;
-          spte_ptr->frame_type      = frame_type;
+          size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+          if (!load_page_over (file, ofs, upage, page_read_bytes, writable))
+              return false;
+          ofs        += page_read_bytes;
+          read_bytes -= page_read_bytes;
+          zero_bytes -= PGSIZE - page_read_bytes;
+          upage      += PGSIZE;
+          continue;
         }
 
+      size_t page_cnt = 1;
+      while (page_cnt * PGSIZE < read_bytes + zero_bytes &&
+             vma_range_free (upage + page_cnt * PGSIZE, 1))
+          page_cnt++;
+
+      size_t run_bytes      = page_cnt * PGSIZE;
+      size_t run_read_bytes = read_bytes < run_bytes ? read_bytes : run_bytes;
+      if (!vma_add (upage, page_cnt, 
+                    writable ? EXECUTABLE_DATA : EXECUTABLE_CODE,
+                    file->inode, ofs, run_read_bytes, writable))
+          return false;
+
+      ofs        += run_read_bytes;
+      read_bytes -= run_read_bytes;
+      zero_bytes -= run_bytes - run_read_bytes;
+      upage      += run_bytes;
+    }
+  return true;
+}
 
-      /* Advance. */
-      ofs        += page_read_bytes;
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage      += PGSIZE;
+/* Gives UPAGE, which is in a region loaded already, an entry of its own
+   with the contents of the segment being loaded over it: PAGE_READ_BYTES
+   from FILE at OFS, and zeros after them. Returns false if memory
+   allocation failed. */
+static bool
+load_page_over (struct file *file, off_t ofs, uint8_t *upage,
+                size_t page_read_bytes, bool writable)
+{
+  struct spte *spte_ptr = vma_get_entry (upage);
+  if (spte_ptr == NULL)
+      return false;
+
+  /* Pages with nothing to read, such as most of the BSS, are zeros
+     and are first mapped to the shared zero frame */
+  enum frame_type frame_type;
+  if      (page_read_bytes == 0) frame_type = ALL_ZERO;
+  else if (writable)             frame_type = EXECUTABLE_DATA;
+  else                           frame_type = EXECUTABLE_CODE;
+
+  /* If either frame had type executable data, this one should too
+     to make it writable */
+  spte_ptr->writable       |= writable;
+  spte_ptr->amount_occupied = page_read_bytes;
+  spte_ptr->frame_type      = frame_type;
+  if (page_read_bytes > 0)
+    {
+      spte_ptr->inode_ptr = file->inode;
+      spte_ptr->offset    = ofs;
     }
   return true;
 }
@@ -608,15 +725,19 @@ setup_stack (void **esp)
 
   uint8_t *uaddr = ((uint8_t *) PHYS_BASE) - PGSIZE;
   
-  /* attempt to add the new page to the supplemental page table */
-  struct spte *spte_ptr = spt_add_entry (t_ptr->spt_ptr, uaddr, 
-      STACK, NULL, 0, PGSIZE, true);
+  /* attempt to add the stack region, which grows down as the stack is 
+     used, and the entry of its first page. A segment of the executable
+     may already be there. */
+  if (!vma_range_free (uaddr, 1) ||
+      !vma_add (uaddr, 1, STACK, NULL, 0, 0, true))
+      goto fail_1;
+  struct spte *spte_ptr = vma_get_entry (uaddr);
   if (spte_ptr == NULL)
       goto fail_1;
 
   /* Get a frame that fits our description*/
   acquire_ft ();
-  struct fte *fte_ptr = ft_get_frame (spte_ptr);
+  struct fte *fte_ptr = ft_get_frame (spte_ptr, NULL);
   if (fte_ptr == NULL)
       goto fail_2;
   release_ft ();
@@ -647,11 +768,19 @@ setup_stack (void **esp)
    if memory allocation fails. */
 bool
 install_page (void *upage, void *kpage, bool writable)
+{
+  return install_frame (upage, vtop (kpage), writable);
+}
+
+/* Like install_page(), but takes the physical address PADDR of
+   the frame, which may be in high memory. */
+bool
+install_frame (void *upage, uintptr_t paddr, bool writable)
 {
   struct thread *t = thread_current ();
 
   /* Verify that there's not already a page at that virtual
      address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL &&
-          pagedir_set_page (t->pagedir, upage, kpage, writable));
+  return (!pagedir_is_mapped (t->pagedir, upage) &&
+          pagedir_set_frame (t->pagedir, upage, paddr, writable));
 }
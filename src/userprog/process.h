@@ -1,6 +1,7 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "vm/ft.h"
 
@@ -8,9 +9,11 @@
 #define MAX_CHARS (512)
 
 tid_t process_execute (const char *file_name);
+tid_t process_fork (const struct intr_frame *f);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 bool install_page (void *upage, void *kpage, bool writable);
+bool install_frame (void *upage, uintptr_t paddr, bool writable);
 
 #endif /* userprog/process.h */
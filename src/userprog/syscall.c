@@ -16,6 +16,10 @@
 #include "devices/shutdown.h"
 #include "devices/input.h"
 #include "vm/mmap.h"
+#include "vm/flush.h"
+#include "vm/vma.h"
+#include "vm/pin.h"
+#include "vm/vmstat.h"
 
 static void     syscall_handler (struct intr_frame *f);
 static uint32_t invoke_function (const void *syscall_ptr, 
@@ -25,11 +29,9 @@ static uint32_t invoke_function (const void *syscall_ptr,
 /* Pointer verification helpers */
 static bool verify_and_pin_ptr            (const void *ptr);
 static bool verify_and_pin_ptr_privileged (const void *ptr, bool write);
-static bool verify_and_pin_buffer         (const void *buffer, int size, 
-                                           bool write);
 static bool verify_args                   (int argc, const uint32_t *esp);
+static bool verify_page_range             (void *addr, unsigned length);
 static void try_unpin_ptr                 (const void *ptr);
-static void try_unpin_buffer              (const void *buffer, int size);
 
 /* System calls */
 static void     syscall_halt     (void);
@@ -47,6 +49,13 @@ static unsigned syscall_tell     (int fd);
 static void     syscall_close    (int fd);
 static mapid_t  syscall_mmap     (int fd, void *addr);
 static void     syscall_munmap   (mapid_t mapping);
+static pid_t    syscall_fork     (void);
+static bool     syscall_madvise  (void *addr, unsigned length, int advice);
+static mapid_t  syscall_mmap_ext (void **addr_ptr, unsigned length, int flags,
+                                  int fd, off_t offset);
+static bool     syscall_msync    (void *addr, unsigned length, int flags);
+static pid_t    syscall_exec_limit (const char *cmd_line, unsigned max_pages);
+static void     syscall_vmstat   (struct vmstat *stat_ptr);
 
 /* Filesystem interaction helpers */
 static int  read_from_console    (void *buffer, unsigned size);
@@ -73,6 +82,12 @@ syscall_func_map[] =
     {&syscall_close,    .argc = 1}, 
     {&syscall_mmap,     .argc = 2}, 
     {&syscall_munmap,   .argc = 1}, 
+    {&syscall_fork,     .argc = 0}, 
+    {&syscall_madvise,  .argc = 3}, 
+    {&syscall_mmap_ext, .argc = 5}, 
+    {&syscall_msync,    .argc = 3}, 
+    {&syscall_exec_limit, .argc = 2}, 
+    {&syscall_vmstat,   .argc = 1}, 
   };
 
 /* Initialisation of the syscall handler */
@@ -90,11 +105,12 @@ syscall_handler (struct intr_frame *f)
   /* Read the syscall number at the stack pointer (f->esp) */
   if (!verify_and_pin_ptr (f->esp)) syscall_exit (-1);
   int syscall_no = *((int *) f->esp);
-  /* Save the current stack pointer to the thread */
+  /* Save the current stack pointer and frame to the thread */
   thread_current ()->esp = f->esp;
+  thread_current ()->syscall_frame = f;
 
   /* Ensure our syscall_no refers to a defined system call */
-  ASSERT (SYS_HALT <= syscall_no && syscall_no <= SYS_MUNMAP);
+  ASSERT (SYS_HALT <= syscall_no && syscall_no <= SYS_VMSTAT);
 
   /* Read the argc and function_ptr values from our syscall_func_map */
   int   argc        = syscall_func_map[syscall_no].argc;
@@ -116,6 +132,26 @@ verify_args (int argc, const uint32_t *esp)
   return true;
 }
 
+/* Checks that ADDR is page aligned and that every page of the LENGTH
+   bytes from it is in a memory region */
+static bool
+verify_page_range (void *addr, unsigned length)
+{
+  if (addr != pg_round_down (addr) || !is_user_vaddr (addr) ||
+      length > (uintptr_t) PHYS_BASE - (uintptr_t) addr)
+      return false;
+
+  void *end = pg_round_up (addr + length);
+  for (void *loc = addr; loc < end; )
+    {
+      struct vma *vma_ptr = vma_find (loc);
+      if (vma_ptr == NULL)
+          return false;
+      loc = vma_ptr->end;
+    }
+  return true;
+}
+
 /* Verifies the given pointer, additionally if write is true but the page is 
    not writable we will return false. */
 static bool 
@@ -125,7 +161,10 @@ verify_and_pin_ptr_privileged (const void *ptr, bool write)
   if (ptr != NULL && 
       is_user_vaddr (ptr))
     {
-      if (pagedir_get_page (active_pd (), ptr) == NULL) 
+      /* Pages mapped read only to the zero frame are faulted in to be
+         written, so the kernel does not fault on them holding locks */
+      if (!pagedir_is_mapped (active_pd (), ptr) ||
+          (write && !pagedir_is_writable (active_pd (), ptr)))
         {
           /* Frame is left pinned, each syscall should unpin the frame
              before termination */
@@ -149,21 +188,12 @@ verify_and_pin_ptr_privileged (const void *ptr, bool write)
 static void
 try_unpin_ptr (const void *ptr)
 {
-  int *pin_cnt = &spt_find_entry (thread_current ()->spt_ptr, 
-                                  pg_round_down (ptr))->fte_ptr->pin_cnt;
+  struct fte *fte_ptr = spt_find_entry (thread_current ()->spt_ptr, 
+                                        pg_round_down (ptr))->fte_ptr;
 
-  *pin_cnt = (*pin_cnt > 0) ? *pin_cnt - 1 : 0;
-}
-
-/* Unpin all frames assocated with a buffer being used by a system call */
-static void
-try_unpin_buffer (const void *buffer, int size) 
-{
-  const void *buffer_top = buffer + size * sizeof (char);
-  for (void *loc = (void *) buffer; 
-       loc <= buffer_top; 
-       loc = pg_round_up(loc) + 1) 
-    try_unpin_ptr (loc);
+  /* Pages mapped to the zero frame have no frame to unpin */
+  if (fte_ptr != NULL)
+      fte_ptr->pin_cnt = (fte_ptr->pin_cnt > 0) ? fte_ptr->pin_cnt - 1 : 0;
 }
 
 /* Checks whether a given pointer is valid for use */
@@ -173,26 +203,6 @@ verify_and_pin_ptr (const void *ptr)
   return verify_and_pin_ptr_privileged (ptr, false);
 }
 
-/* Checks that the entire buffer (up to size) is in valid memory and returns 
-   false if not */
-static bool
-verify_and_pin_buffer (const void *buffer, int size, bool write) 
-{
-  /* Check that the first memory location in the buffer is valid, and that 
-     every memory location on the end of a page + 1 (i.e. the next page over) 
-     is also valid */
-  const void *buffer_top = buffer + size * sizeof (char);
-  for (void *loc = (void *) buffer; 
-       loc <= buffer_top; 
-       loc = pg_round_up(loc) + 1) 
-  {
-    if (!verify_and_pin_ptr_privileged (loc, write)) {
-      return false;
-    }
-  }
-  return true;
-}
-
 static uint32_t 
 invoke_function (const void *syscall_ptr, int argc, const uint32_t *esp) 
 {
@@ -202,6 +212,8 @@ invoke_function (const void *syscall_ptr, int argc, const uint32_t *esp)
       case 1: return ((syscall_1_args) syscall_ptr) (esp[1]); 
       case 2: return ((syscall_2_args) syscall_ptr) (esp[1], esp[2]); 
       case 3: return ((syscall_3_args) syscall_ptr) (esp[1], esp[2], esp[3]); 
+      case 5: return ((syscall_5_args) syscall_ptr) (esp[1], esp[2], esp[3], 
+                                                     esp[4], esp[5]); 
       default: NOT_REACHED (); 
     }
 }
@@ -366,10 +378,11 @@ syscall_read (int fd, void *buffer, unsigned size)
   /* Additional sanity check to verify the buffer, check if the fd value
      is below the maximum range of open files, and check if the fd value
      is not equal to 1 (STDOUT_FILENO) for syscall_read */
+  struct pinned_range pinned;
   if (buffer == NULL       || 
       fd >= MAX_OPEN_FILES ||
       fd == STDOUT_FILENO  ||
-      !verify_and_pin_buffer (buffer, size, false)) syscall_exit (-1);
+      !pin_user_range (buffer, size, true, &pinned)) syscall_exit (-1);
 
   unsigned bytes_read;
 
@@ -382,7 +395,7 @@ syscall_read (int fd, void *buffer, unsigned size)
 
   release_filesys ();
 
-  try_unpin_buffer (buffer, size);
+  unpin_user_range (&pinned);
   /* Returns the total count of bytes read */
   return bytes_read;
 }
@@ -420,10 +433,11 @@ syscall_write (int fd, const void *buffer, unsigned size)
   /* Additional sanity check to verify the buffer, check if the fd value
      is below the maximum range of open files, and check if the fd value
      is not equal to 0 (STDIN_FILENO) for syscall_write */
+  struct pinned_range pinned;
   if (buffer == NULL       || 
       fd >= MAX_OPEN_FILES || 
       fd == STDIN_FILENO   ||
-      !verify_and_pin_buffer (buffer, size, true)) syscall_exit (-1);
+      !pin_user_range (buffer, size, false, &pinned)) syscall_exit (-1);
 
 
   unsigned bytes_written;
@@ -437,7 +451,7 @@ syscall_write (int fd, const void *buffer, unsigned size)
 
   release_filesys ();
 
-  try_unpin_buffer (buffer, size);
+  unpin_user_range (&pinned);
 
   /* Returns the total count of bytes written */
   return bytes_written;
@@ -546,69 +560,153 @@ syscall_mmap (int fd, void *addr)
       fd == STDIN_FILENO  ||
       fd == STDOUT_FILENO || 
       addr != pg_round_down (addr))
-      goto fail_1;
-
-  struct thread *t_ptr = thread_current ();
+      return MAP_FAILED;
 
   /* Fail if the file is not mapped to a file descriptor */
-  struct file *file_ptr = get_file (t_ptr->hash_fd_ptr, fd);
+  struct file *file_ptr = get_file (thread_current ()->hash_fd_ptr, fd);
   if (file_ptr == NULL) 
-      goto fail_1;
+      return MAP_FAILED;
 
-  /* Fail if the file has length equal to 0 */
-  off_t filesize = file_length (file_ptr);
-  if (filesize == 0) 
-      goto fail_1;
+  /* The whole file is shared from its start */
+  return mmap_create (file_ptr, &addr, 0, 0, MAP_SHARED);
+}
 
-  /* Fail if the mmapped file will overflow the stack */
-  void *mmap_top = addr + filesize;
-  if ((uint32_t) mmap_top >= (uint32_t) STACK_LIMIT) 
-      goto fail_1;
-  
-  /* Fail if the reopened file is empty */
-  if (file_reopen (file_ptr) == NULL)
-      goto fail_1;
-  
-  /* Fail if mmapped file will overwrite any supplemental pages */
-  for (void *loc = addr; 
-       loc <= mmap_top; 
-       loc = pg_round_up(loc) + 1) 
-  {
-    if (spt_find_entry (t_ptr->spt_ptr, loc) != NULL)
-        goto fail_1;
-  }
-
-  /* Add the mmapped file pages to our SPT */
-  off_t bytes_remaining = filesize;
-  off_t offset = 0;
-  void *loc = addr;
-  for (loc = addr; loc <= mmap_top; 
-       loc             += PGSIZE, 
-       bytes_remaining -= PGSIZE, 
-       offset          += PGSIZE) 
-  {
-    int amount_occupied = (bytes_remaining > PGSIZE) ? PGSIZE
-                                                     : bytes_remaining;
-    if (spt_add_entry (t_ptr->spt_ptr, loc, MMAP, file_ptr->inode, offset, 
-        amount_occupied, true)== NULL) 
-        goto fail_2;
-  }
+static void 
+syscall_munmap (mapid_t mapping)
+{
+  mmap_remove_entry (mapping);
+}
+
+/* SYS_FORK */
+static pid_t
+syscall_fork (void)
+{
+  return (pid_t) process_fork (thread_current ()->syscall_frame);
+}
+
+/* SYS_MADVISE 
+ * Gives ADVICE for the pages from ADDR, which must be page aligned, 
+ * covering LENGTH bytes. Fails, doing nothing, if any of them is not
+ * in use. */
+static bool
+syscall_madvise (void *addr, unsigned length, int advice)
+{
+  struct thread *t_ptr = thread_current ();
+
+  if (advice < MADV_NORMAL || advice > MADV_DONTNEED ||
+      !verify_page_range (addr, length))
+      return false;
 
-  if (!mmap_add_entry (&t_ptr->mmap_list, (t_ptr->mid_cnt)++, addr, filesize))
-      goto fail_2;
+  void *end = pg_round_up (addr + length);
+  pagedir_batch_begin ();
+  acquire_ft ();
+  for (void *loc = addr; loc < end; loc += PGSIZE)
+    {
+      /* Pages not used yet have nothing to give up, but take other advice
+         in an entry of their own */
+      struct spte *spte_ptr = advice == MADV_DONTNEED 
+                                  ? spt_find_entry (t_ptr->spt_ptr, loc)
+                                  : vma_get_entry (loc);
+      if (spte_ptr != NULL)
+          ft_madvise (spte_ptr, advice);
+    }
+  release_ft ();
+  pagedir_batch_end ();
+  return true;
+}
 
-  return 0;
+/* SYS_MMAP_EXT
+ * Maps LENGTH bytes of file FD from OFFSET, or anonymous memory, as
+ * mmap_create does. The address is read from ADDR_PTR, NULL letting the
+ * kernel choose, and the address used written back to it. */
+static mapid_t
+syscall_mmap_ext (void **addr_ptr, unsigned length, int flags, int fd, 
+                  off_t offset)
+{
+  struct pinned_range pinned;
+  if (!pin_user_range (addr_ptr, sizeof *addr_ptr, true, &pinned)) 
+      syscall_exit (-1);
 
-fail_2: /* Remove all allocated spt entries associated with the mmapped file */
-        acquire_ft ();
-        while (loc > mmap_top) 
-            spt_propagate_removal (t_ptr->spt_ptr, loc -= PGSIZE);
-        release_ft ();
-fail_1: return -1;
+  struct file *file_ptr = NULL;
+  mapid_t mid = MAP_FAILED;
+  if (!(flags & MAP_ANONYMOUS))
+    {
+      if (fd == STDIN_FILENO || fd == STDOUT_FILENO ||
+          (file_ptr = get_file (thread_current ()->hash_fd_ptr, fd)) == NULL)
+          goto done;
+    }
+
+  void *addr = *addr_ptr;
+  mid = mmap_create (file_ptr, &addr, offset, length, flags);
+  if (mid != MAP_FAILED)
+      *addr_ptr = addr;
+
+done:
+  unpin_user_range (&pinned);
+  return mid;
 }
 
-static void 
-syscall_munmap (mapid_t mapping)
+/* SYS_MSYNC
+ * Writes back the dirty shared file pages from ADDR, which must be page
+ * aligned, covering LENGTH bytes. MS_SYNC writes them before returning,
+ * and fails if any write fails. MS_ASYNC leaves them to the flusher.
+ * Fails, writing nothing, if any of the pages is not in use. */
+static bool
+syscall_msync (void *addr, unsigned length, int flags)
 {
-  mmap_remove_entry (mapping);
+  struct thread *t_ptr = thread_current ();
+
+  if ((flags != MS_SYNC && flags != MS_ASYNC) ||
+      !verify_page_range (addr, length))
+      return false;
+
+  if (flags == MS_ASYNC)
+    {
+      flush_request ();
+      return true;
+    }
+
+  bool success = true;
+  void *end = pg_round_up (addr + length);
+  acquire_ft ();
+  for (void *loc = addr; loc < end; loc += PGSIZE)
+    {
+      /* Pages not used yet have nothing to write */
+      struct spte *spte_ptr = spt_find_entry (t_ptr->spt_ptr, loc);
+      if (spte_ptr != NULL && !flush_page (spte_ptr))
+          success = false;
+    }
+  release_ft ();
+  return success;
+}
+
+/* SYS_EXEC_LIMIT
+ * Runs CMD_LINE as exec does, with its resident set held to at most
+ * MAX_PAGES frames, or unlimited if 0. The limit applies to the new
+ * process and the processes it forks, but not those it execs. */
+static pid_t
+syscall_exec_limit (const char *cmd_line, unsigned max_pages)
+{
+  struct thread *t_ptr = thread_current ();
+
+  t_ptr->exec_rss_limit = max_pages;
+  pid_t pid = syscall_exec (cmd_line);
+  t_ptr->exec_rss_limit = 0;
+  return pid;
+}
+
+/* SYS_VMSTAT
+ * Writes a snapshot of the virtual memory statistics to STAT_PTR, which is
+ * faulted in and pinned first so that copying it out cannot fault. */
+static void
+syscall_vmstat (struct vmstat *stat_ptr)
+{
+  struct pinned_range pinned;
+  struct vmstat stat;
+
+  if (!pin_user_range (stat_ptr, sizeof *stat_ptr, true, &pinned))
+      syscall_exit (-1);
+  vmstat_snapshot (&stat);
+  memcpy (stat_ptr, &stat, sizeof stat);
+  unpin_user_range (&pinned);
 }
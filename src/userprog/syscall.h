@@ -11,6 +11,8 @@ typedef uint32_t (*syscall_0_args) (void);
 typedef uint32_t (*syscall_1_args) (uint32_t);
 typedef uint32_t (*syscall_2_args) (uint32_t, uint32_t);
 typedef uint32_t (*syscall_3_args) (uint32_t, uint32_t, uint32_t);
+typedef uint32_t (*syscall_5_args) (uint32_t, uint32_t, uint32_t, uint32_t,
+                                    uint32_t);
 
 void syscall_exit (int status);
 
@@ -0,0 +1,920 @@
+/* vmsim: replays a page reference trace recorded by the kernel's
+   -vmtrace option against several page replacement policies, and
+   reports the page faults each takes for a number of frame counts.
+
+   usage: vmsim TRACE [FRAMES...]
+
+   TRACE is either the disk the trace was recorded on, in which case
+   the Pintos scratch partition is found from its partition table, or
+   the contents of the scratch partition alone.  For example:
+
+     pintos --make-disk=trace.dsk --scratch-size=4 -- -q -vmtrace run X
+     vmsim trace.dsk 64 128 256
+
+   FRAMES defaults to the number of user frames the kernel had, and
+   half and a quarter of that.
+
+   Faults and the accessed bits the kernel samples every few ticks
+   both count as references, so references to resident pages are
+   only seen at the granularity of the sampling. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../vm/trace.h"
+
+#define SECTOR_SIZE 512
+#define PART_SCRATCH 0x22
+#define NIL (-1L)
+
+/* A reference, to a page numbered densely from 0. */
+struct ref
+  {
+    long page;
+    int type;                   /* enum trace_type */
+  };
+
+static struct ref *refs;
+static size_t ref_cnt;
+static size_t page_cnt;
+
+/* A replacement policy under simulation.  ref() returns true if
+   the reference to PAGE, which is the REF_IDX'th, faults. */
+struct policy
+  {
+    const char *name;
+    void (*init) (size_t frames);
+    bool (*ref) (long page, size_t ref_idx);
+    void (*free) (long page);
+  };
+
+static void *
+xcalloc (size_t n, size_t size)
+{
+  void *p = calloc (n, size);
+  if (p == NULL && n != 0)
+    {
+      fprintf (stderr, "vmsim: out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  return p;
+}
+
+/* Doubly linked lists of pages, most recent at the head.  A page
+   is on at most one list at a time, as recorded in where[]. */
+struct dlist
+  {
+    long head, tail;
+    size_t size;
+  };
+
+static long *lprev, *lnext;
+static int *where;
+
+static void
+dlist_init (struct dlist *l)
+{
+  l->head = l->tail = NIL;
+  l->size = 0;
+}
+
+static void
+dlist_push_head (struct dlist *l, long x)
+{
+  lprev[x] = NIL;
+  lnext[x] = l->head;
+  if (l->head != NIL)
+    lprev[l->head] = x;
+  else
+    l->tail = x;
+  l->head = x;
+  l->size++;
+}
+
+static void
+dlist_unlink (struct dlist *l, long x)
+{
+  if (lprev[x] != NIL)
+    lnext[lprev[x]] = lnext[x];
+  else
+    l->head = lnext[x];
+  if (lnext[x] != NIL)
+    lprev[lnext[x]] = lprev[x];
+  else
+    l->tail = lprev[x];
+  l->size--;
+}
+
+static long
+dlist_pop_tail (struct dlist *l)
+{
+  long x = l->tail;
+  dlist_unlink (l, x);
+  return x;
+}
+
+/* Resets the per-page list state. */
+static void
+lists_reset (void)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    where[i] = 0;
+}
+
+/* LRU. */
+
+static struct dlist lru;
+static size_t lru_frames;
+
+static void
+lru_init (size_t frames)
+{
+  lists_reset ();
+  dlist_init (&lru);
+  lru_frames = frames;
+}
+
+static bool
+lru_ref (long page, size_t ref_idx)
+{
+  (void) ref_idx;
+  if (where[page])
+    {
+      dlist_unlink (&lru, page);
+      dlist_push_head (&lru, page);
+      return false;
+    }
+  if (lru.size >= lru_frames)
+    where[dlist_pop_tail (&lru)] = 0;
+  dlist_push_head (&lru, page);
+  where[page] = 1;
+  return true;
+}
+
+static void
+lru_free (long page)
+{
+  if (where[page])
+    {
+      dlist_unlink (&lru, page);
+      where[page] = 0;
+    }
+}
+
+/* Second chance clock, as in the kernel's -evict=sca.  New pages
+   start referenced, as their accessed bit is set by the access
+   that faulted them in. */
+
+static long *slot_page, *page_slot, *free_slots;
+static unsigned char *refbit;
+static size_t slot_cnt, free_slot_cnt, sca_hand;
+
+static void
+sca_init (size_t frames)
+{
+  size_t i;
+
+  free (slot_page);
+  free (free_slots);
+  slot_page = xcalloc (frames, sizeof *slot_page);
+  free_slots = xcalloc (frames, sizeof *free_slots);
+  slot_cnt = free_slot_cnt = frames;
+  for (i = 0; i < frames; i++)
+    {
+      slot_page[i] = NIL;
+      free_slots[i] = frames - 1 - i;
+    }
+  for (i = 0; i < page_cnt; i++)
+    {
+      page_slot[i] = NIL;
+      refbit[i] = 0;
+    }
+  sca_hand = 0;
+}
+
+static bool
+sca_ref (long page, size_t ref_idx)
+{
+  long slot;
+
+  (void) ref_idx;
+  if (page_slot[page] != NIL)
+    {
+      refbit[page] = 1;
+      return false;
+    }
+
+  if (free_slot_cnt > 0)
+    slot = free_slots[--free_slot_cnt];
+  else
+    for (;;)
+      {
+        long victim = slot_page[sca_hand];
+        if (refbit[victim])
+          refbit[victim] = 0;
+        else
+          {
+            page_slot[victim] = NIL;
+            slot = sca_hand;
+            sca_hand = (sca_hand + 1) % slot_cnt;
+            break;
+          }
+        sca_hand = (sca_hand + 1) % slot_cnt;
+      }
+
+  slot_page[slot] = page;
+  page_slot[page] = slot;
+  refbit[page] = 1;
+  return true;
+}
+
+static void
+sca_free (long page)
+{
+  long slot = page_slot[page];
+
+  if (slot != NIL)
+    {
+      slot_page[slot] = NIL;
+      free_slots[free_slot_cnt++] = slot;
+      page_slot[page] = NIL;
+    }
+}
+
+/* ARC (Megiddo and Modha, FAST '03).  T1 and T2 hold resident pages
+   seen once and more than once recently, B1 and B2 the ghosts of
+   pages evicted from them, and p is the target size of T1. */
+
+enum { ARC_NONE, ARC_T1, ARC_T2, ARC_B1, ARC_B2 };
+
+static struct dlist arc_lists[5];
+static size_t arc_c, arc_p;
+
+#define T1 (&arc_lists[ARC_T1])
+#define T2 (&arc_lists[ARC_T2])
+#define B1 (&arc_lists[ARC_B1])
+#define B2 (&arc_lists[ARC_B2])
+
+static void
+arc_init (size_t frames)
+{
+  int i;
+
+  lists_reset ();
+  for (i = 0; i < 5; i++)
+    dlist_init (&arc_lists[i]);
+  arc_c = frames;
+  arc_p = 0;
+}
+
+static void
+arc_move (long page, int to)
+{
+  if (where[page] != ARC_NONE)
+    dlist_unlink (&arc_lists[where[page]], page);
+  where[page] = to;
+  if (to != ARC_NONE)
+    dlist_push_head (&arc_lists[to], page);
+}
+
+/* Evicts a page to make room, if the cache is full. */
+static void
+arc_replace (bool in_b2)
+{
+  if (T1->size + T2->size < arc_c)
+    return;
+  if (T1->size > 0
+      && (T1->size > arc_p || (in_b2 && T1->size == arc_p) || T2->size == 0))
+    arc_move (T1->tail, ARC_B1);
+  else
+    arc_move (T2->tail, ARC_B2);
+}
+
+static bool
+arc_ref (long page, size_t ref_idx)
+{
+  size_t delta;
+
+  (void) ref_idx;
+  switch (where[page])
+    {
+    case ARC_T1:
+    case ARC_T2:
+      arc_move (page, ARC_T2);
+      return false;
+
+    case ARC_B1:
+      delta = B2->size > B1->size ? B2->size / B1->size : 1;
+      arc_p = arc_p + delta < arc_c ? arc_p + delta : arc_c;
+      arc_replace (false);
+      arc_move (page, ARC_T2);
+      return true;
+
+    case ARC_B2:
+      delta = B1->size > B2->size ? B1->size / B2->size : 1;
+      arc_p = arc_p > delta ? arc_p - delta : 0;
+      arc_replace (true);
+      arc_move (page, ARC_T2);
+      return true;
+    }
+
+  if (T1->size + B1->size >= arc_c)
+    {
+      if (T1->size < arc_c)
+        {
+          arc_move (B1->tail, ARC_NONE);
+          arc_replace (false);
+        }
+      else
+        arc_move (T1->tail, ARC_NONE);
+    }
+  else if (T1->size + T2->size + B1->size + B2->size >= arc_c)
+    {
+      if (T1->size + T2->size + B1->size + B2->size >= 2 * arc_c
+          && B2->size > 0)
+        arc_move (B2->tail, ARC_NONE);
+      arc_replace (false);
+    }
+  arc_move (page, ARC_T1);
+  return true;
+}
+
+static void
+arc_free (long page)
+{
+  arc_move (page, ARC_NONE);
+}
+
+/* CLOCK-Pro (Jiang, Chen and Zhang, USENIX '05).  All pages are on
+   one clock: resident hot pages, resident cold pages, and cold
+   pages that were evicted during their test period.  A cold page
+   referenced during its test period becomes hot.  HAND_cold evicts
+   cold pages, HAND_hot demotes hot pages and ends test periods,
+   and HAND_test ends test periods to bound the non-resident pages.
+   mc, the target number of resident cold pages, grows when a
+   non-resident test page is referenced and shrinks when a test
+   period runs out. */
+
+static long *cnext, *cprev;
+static unsigned char *cp_hot, *cp_ref, *cp_test, *cp_resident, *cp_listed;
+static long hand_hot, hand_cold, hand_test;
+static size_t cp_m, cp_mc, cp_hot_cnt, cp_cold_cnt, cp_nonres_cnt;
+
+static void cp_hand_hot (void);
+static void cp_hand_test (void);
+
+static void
+cp_init (size_t frames)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    cp_hot[i] = cp_ref[i] = cp_test[i] = cp_resident[i] = cp_listed[i] = 0;
+  hand_hot = hand_cold = hand_test = NIL;
+  cp_m = frames;
+  cp_mc = 1;
+  cp_hot_cnt = cp_cold_cnt = cp_nonres_cnt = 0;
+}
+
+/* Takes X off the clock, moving any hand on it along. */
+static void
+cp_remove (long x)
+{
+  long next = cnext[x] != x ? cnext[x] : NIL;
+
+  if (hand_hot == x)
+    hand_hot = next;
+  if (hand_cold == x)
+    hand_cold = next;
+  if (hand_test == x)
+    hand_test = next;
+  cnext[cprev[x]] = cnext[x];
+  cprev[cnext[x]] = cprev[x];
+  cp_listed[x] = 0;
+}
+
+/* Puts X at the head of the clock, just behind HAND_hot, so that
+   it is the last page the hands come to. */
+static void
+cp_insert_head (long x)
+{
+  cp_listed[x] = 1;
+  if (hand_hot == NIL)
+    {
+      cnext[x] = cprev[x] = x;
+      hand_hot = hand_cold = hand_test = x;
+      return;
+    }
+  cnext[x] = hand_hot;
+  cprev[x] = cprev[hand_hot];
+  cnext[cprev[hand_hot]] = x;
+  cprev[hand_hot] = x;
+  if (hand_cold == NIL)
+    hand_cold = x;
+  if (hand_test == NIL)
+    hand_test = x;
+}
+
+static void
+cp_to_head (long x)
+{
+  cp_remove (x);
+  cp_insert_head (x);
+}
+
+/* Ends the test period of cold page X, which HAND is on, and moves
+   the hand along.  A non-resident page leaves the clock. */
+static void
+cp_end_test (long x, long *hand)
+{
+  cp_test[x] = 0;
+  if (!cp_resident[x])
+    {
+      cp_remove (x);
+      cp_nonres_cnt--;
+      if (cp_mc > 1)
+        cp_mc--;
+    }
+  else
+    *hand = cnext[x];
+}
+
+/* Turns HAND_hot until it has demoted one hot page to cold. */
+static void
+cp_hand_hot (void)
+{
+  while (cp_hot_cnt > 0)
+    {
+      long x = hand_hot;
+
+      if (cp_hot[x] && cp_ref[x])
+        {
+          cp_ref[x] = 0;
+          hand_hot = cnext[x];
+        }
+      else if (cp_hot[x])
+        {
+          cp_hot[x] = 0;
+          cp_hot_cnt--;
+          cp_cold_cnt++;
+          hand_hot = cnext[x];
+          return;
+        }
+      else if (cp_test[x])
+        cp_end_test (x, &hand_hot);
+      else
+        hand_hot = cnext[x];
+    }
+}
+
+/* Turns HAND_test until it has dropped one non-resident page. */
+static void
+cp_hand_test (void)
+{
+  while (cp_nonres_cnt > 0)
+    {
+      long x = hand_test;
+
+      if (!cp_hot[x] && cp_test[x])
+        {
+          bool dropped = !cp_resident[x];
+          cp_end_test (x, &hand_test);
+          if (dropped)
+            return;
+        }
+      else
+        hand_test = cnext[x];
+    }
+}
+
+/* Turns HAND_cold until it has evicted one resident cold page. */
+static void
+cp_hand_cold (void)
+{
+  for (;;)
+    {
+      long x = hand_cold;
+
+      if (cp_hot[x] || !cp_resident[x])
+        hand_cold = cnext[x];
+      else if (cp_ref[x])
+        {
+          /* Referenced: promote if in its test period, otherwise
+             start one. */
+          cp_ref[x] = 0;
+          if (cp_test[x])
+            {
+              cp_test[x] = 0;
+              cp_hot[x] = 1;
+              cp_cold_cnt--;
+              cp_hot_cnt++;
+              cp_to_head (x);
+              if (cp_hot_cnt > cp_m - cp_mc)
+                cp_hand_hot ();
+            }
+          else
+            {
+              cp_test[x] = 1;
+              cp_to_head (x);
+            }
+        }
+      else
+        {
+          cp_resident[x] = 0;
+          cp_cold_cnt--;
+          if (cp_test[x])
+            {
+              cp_nonres_cnt++;
+              hand_cold = cnext[x];
+              if (cp_nonres_cnt > cp_m)
+                cp_hand_test ();
+            }
+          else
+            cp_remove (x);
+          return;
+        }
+    }
+}
+
+static bool
+cp_ref_page (long page, size_t ref_idx)
+{
+  (void) ref_idx;
+  if (cp_resident[page])
+    {
+      cp_ref[page] = 1;
+      return false;
+    }
+
+  if (cp_hot_cnt + cp_cold_cnt >= cp_m)
+    cp_hand_cold ();
+
+  cp_resident[page] = 1;
+  cp_ref[page] = 0;
+  if (cp_listed[page])
+    {
+      /* Non-resident page referenced during its test period: cold
+         pages deserve more room, and this one comes back hot. */
+      if (cp_mc < cp_m - 1)
+        cp_mc++;
+      cp_nonres_cnt--;
+      cp_test[page] = 0;
+      cp_hot[page] = 1;
+      cp_hot_cnt++;
+      cp_to_head (page);
+      if (cp_hot_cnt > cp_m - cp_mc)
+        cp_hand_hot ();
+    }
+  else
+    {
+      cp_test[page] = 1;
+      cp_cold_cnt++;
+      cp_insert_head (page);
+    }
+  return true;
+}
+
+static void
+cp_free (long page)
+{
+  if (!cp_listed[page])
+    return;
+  if (!cp_resident[page])
+    cp_nonres_cnt--;
+  else if (cp_hot[page])
+    cp_hot_cnt--;
+  else
+    cp_cold_cnt--;
+  cp_remove (page);
+  cp_hot[page] = cp_ref[page] = cp_test[page] = cp_resident[page] = 0;
+}
+
+/* Belady's OPT: evicts the page whose next reference is furthest
+   away, found with a max-heap on the index of each resident page's
+   next reference. */
+
+#define NEVER ((size_t) -1)
+
+static size_t *next_use;        /* Per reference. */
+static size_t *opt_key;         /* Per page. */
+static long *heap, *heap_pos;
+static size_t heap_cnt, opt_frames;
+
+static void
+heap_swap (size_t a, size_t b)
+{
+  long t = heap[a];
+  heap[a] = heap[b];
+  heap[b] = t;
+  heap_pos[heap[a]] = a;
+  heap_pos[heap[b]] = b;
+}
+
+static void
+heap_fix (size_t i)
+{
+  while (i > 0 && opt_key[heap[(i - 1) / 2]] < opt_key[heap[i]])
+    {
+      heap_swap (i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  for (;;)
+    {
+      size_t l = 2 * i + 1, r = l + 1, big = i;
+      if (l < heap_cnt && opt_key[heap[l]] > opt_key[heap[big]])
+        big = l;
+      if (r < heap_cnt && opt_key[heap[r]] > opt_key[heap[big]])
+        big = r;
+      if (big == i)
+        break;
+      heap_swap (i, big);
+      i = big;
+    }
+}
+
+static void
+heap_remove (long page)
+{
+  size_t i = heap_pos[page];
+
+  heap_pos[page] = NIL;
+  if (i == --heap_cnt)
+    return;
+  heap[i] = heap[heap_cnt];
+  heap_pos[heap[i]] = i;
+  heap_fix (i);
+}
+
+static void
+opt_init (size_t frames)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    heap_pos[i] = NIL;
+  heap_cnt = 0;
+  opt_frames = frames;
+}
+
+static bool
+opt_ref (long page, size_t ref_idx)
+{
+  bool fault = heap_pos[page] == NIL;
+
+  if (fault)
+    {
+      if (heap_cnt >= opt_frames)
+        heap_remove (heap[0]);
+      heap[heap_cnt] = page;
+      heap_pos[page] = heap_cnt++;
+    }
+  opt_key[page] = next_use[ref_idx];
+  heap_fix (heap_pos[page]);
+  return fault;
+}
+
+static void
+opt_free (long page)
+{
+  if (heap_pos[page] != NIL)
+    heap_remove (page);
+}
+
+/* Works out next_use[] for OPT.  A page that is freed before it is
+   referenced again is never used again. */
+static void
+opt_prepare (void)
+{
+  size_t *last = xcalloc (page_cnt, sizeof *last);
+  size_t i;
+
+  next_use = xcalloc (ref_cnt, sizeof *next_use);
+  for (i = 0; i < page_cnt; i++)
+    last[i] = NEVER;
+  for (i = ref_cnt; i-- > 0; )
+    {
+      long page = refs[i].page;
+      if (refs[i].type == TRACE_FREE)
+        last[page] = NEVER;
+      else
+        {
+          next_use[i] = last[page];
+          last[page] = i;
+        }
+    }
+  free (last);
+}
+
+static const struct policy policies[] =
+  {
+    { "LRU", lru_init, lru_ref, lru_free },
+    { "SCA", sca_init, sca_ref, sca_free },
+    { "CLOCK-Pro", cp_init, cp_ref_page, cp_free },
+    { "ARC", arc_init, arc_ref, arc_free },
+    { "OPT", opt_init, opt_ref, opt_free },
+  };
+#define POLICY_CNT (sizeof policies / sizeof *policies)
+
+/* Replays the trace against P with FRAMES frames, returning the
+   number of faults. */
+static size_t
+simulate (const struct policy *p, size_t frames)
+{
+  size_t faults = 0;
+  size_t i;
+
+  p->init (frames);
+  for (i = 0; i < ref_cnt; i++)
+    if (refs[i].type == TRACE_FREE)
+      p->free (refs[i].page);
+    else if (p->ref (refs[i].page, i))
+      faults++;
+  return faults;
+}
+
+/* Maps trace page names to dense page numbers. */
+
+static uint32_t *id_keys;
+static long *id_vals;
+static size_t id_cap;
+
+static long
+page_number (uint32_t id)
+{
+  size_t i;
+
+  if (page_cnt * 2 >= id_cap)
+    {
+      uint32_t *old_keys = id_keys;
+      long *old_vals = id_vals;
+      size_t old_cap = id_cap;
+
+      id_cap = id_cap ? id_cap * 2 : 1024;
+      id_keys = xcalloc (id_cap, sizeof *id_keys);
+      id_vals = xcalloc (id_cap, sizeof *id_vals);
+      for (i = 0; i < id_cap; i++)
+        id_vals[i] = NIL;
+      for (i = 0; i < old_cap; i++)
+        if (old_vals[i] != NIL)
+          {
+            size_t j = old_keys[i] * 2654435761u % id_cap;
+            while (id_vals[j] != NIL)
+              j = (j + 1) % id_cap;
+            id_keys[j] = old_keys[i];
+            id_vals[j] = old_vals[i];
+          }
+      free (old_keys);
+      free (old_vals);
+    }
+
+  for (i = id * 2654435761u % id_cap; id_vals[i] != NIL; i = (i + 1) % id_cap)
+    if (id_keys[i] == id)
+      return id_vals[i];
+  id_keys[i] = id;
+  id_vals[i] = page_cnt;
+  return page_cnt++;
+}
+
+static uint32_t
+get_le32 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/* Finds the start of the scratch partition if FILE is a partitioned
+   disk, returning 0 if it is not. */
+static long
+scratch_offset (FILE *file)
+{
+  unsigned char mbr[SECTOR_SIZE];
+  int i;
+
+  if (fread (mbr, SECTOR_SIZE, 1, file) != 1
+      || mbr[510] != 0x55 || mbr[511] != 0xaa)
+    return 0;
+  for (i = 0; i < 4; i++)
+    {
+      const unsigned char *entry = mbr + 446 + 16 * i;
+      if (entry[4] == PART_SCRATCH)
+        return (long) get_le32 (entry + 8) * SECTOR_SIZE;
+    }
+  return 0;
+}
+
+/* Reads the trace in FILE_NAME, returning the number of frames it
+   was recorded with. */
+static size_t
+read_trace (const char *file_name)
+{
+  unsigned char sector[SECTOR_SIZE];
+  FILE *file = fopen (file_name, "rb");
+  size_t i;
+
+  if (file == NULL)
+    {
+      fprintf (stderr, "vmsim: %s: %s\n", file_name, strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  if (fseek (file, scratch_offset (file), SEEK_SET) != 0
+      || fread (sector, SECTOR_SIZE, 1, file) != 1
+      || get_le32 (sector) != TRACE_MAGIC
+      || get_le32 (sector + 4) != TRACE_VERSION)
+    {
+      fprintf (stderr, "vmsim: %s: no trace found\n", file_name);
+      exit (EXIT_FAILURE);
+    }
+
+  ref_cnt = get_le32 (sector + 8);
+  refs = xcalloc (ref_cnt, sizeof *refs);
+  for (i = 0; i < ref_cnt; i++)
+    {
+      unsigned char rec[8];
+      uint32_t info;
+
+      if (fread (rec, sizeof rec, 1, file) != 1)
+        {
+          fprintf (stderr, "vmsim: %s: trace cut short at record %zu\n",
+                   file_name, i);
+          ref_cnt = i;
+          break;
+        }
+      info = get_le32 (rec + 4);
+      refs[i].page = page_number (get_le32 (rec));
+      refs[i].type = info >> TRACE_TYPE_SHIFT;
+    }
+  fclose (file);
+  return get_le32 (sector + 12);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t default_frames[3];
+  size_t *frames;
+  size_t frame_cnt;
+  size_t i, j;
+
+  if (argc < 2)
+    {
+      fprintf (stderr, "usage: %s TRACE [FRAMES...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  default_frames[0] = read_trace (argv[1]);
+  default_frames[1] = default_frames[0] / 2;
+  default_frames[2] = default_frames[0] / 4;
+  if (argc > 2)
+    {
+      frame_cnt = argc - 2;
+      frames = xcalloc (frame_cnt, sizeof *frames);
+      for (i = 0; i < frame_cnt; i++)
+        frames[i] = strtoul (argv[i + 2], NULL, 10);
+    }
+  else
+    {
+      frame_cnt = 3;
+      frames = default_frames;
+    }
+
+  lprev = xcalloc (page_cnt, sizeof *lprev);
+  lnext = xcalloc (page_cnt, sizeof *lnext);
+  where = xcalloc (page_cnt, sizeof *where);
+  page_slot = xcalloc (page_cnt, sizeof *page_slot);
+  refbit = xcalloc (page_cnt, 1);
+  cnext = xcalloc (page_cnt, sizeof *cnext);
+  cprev = xcalloc (page_cnt, sizeof *cprev);
+  cp_hot = xcalloc (page_cnt, 1);
+  cp_ref = xcalloc (page_cnt, 1);
+  cp_test = xcalloc (page_cnt, 1);
+  cp_resident = xcalloc (page_cnt, 1);
+  cp_listed = xcalloc (page_cnt, 1);
+  opt_key = xcalloc (page_cnt, sizeof *opt_key);
+  heap = xcalloc (page_cnt, sizeof *heap);
+  heap_pos = xcalloc (page_cnt, sizeof *heap_pos);
+  opt_prepare ();
+
+  printf ("%zu references to %zu pages\n", ref_cnt, page_cnt);
+  printf ("%8s", "frames");
+  for (j = 0; j < POLICY_CNT; j++)
+    printf (" %10s", policies[j].name);
+  printf ("\n");
+  for (i = 0; i < frame_cnt; i++)
+    {
+      if (frames[i] < 2)
+        {
+          fprintf (stderr, "vmsim: need at least 2 frames\n");
+          return EXIT_FAILURE;
+        }
+      printf ("%8zu", frames[i]);
+      for (j = 0; j < POLICY_CNT; j++)
+        printf (" %10zu", simulate (&policies[j], frames[i]));
+      printf ("\n");
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,360 @@
+#include "vm/car.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "vm/evict.h"
+#include "vm/ft.h"
+#include "vm/reclaim.h"
+
+/* CAR, Clock with Adaptive Replacement (Bansal and Modha, FAST '04).
+
+   Resident frames are kept on two clocks: T1 holds pages that have
+   been referenced once since they came in, T2 pages referenced
+   again since. A page found referenced in T1 moves to T2, so a
+   sequential scan, which touches each page once, only ever churns
+   T1 and cannot push the working set out of T2.
+
+   How big T1 should be is learnt from ghosts, which remember pages
+   recently evicted from T1 (B1) and T2 (B2) without their contents.
+   A fault on a B1 ghost means T1 was too small, and grows its
+   target p; a fault on a B2 ghost shrinks it.
+
+   A ghost names a page by (inode, offset) if it is read back from a
+   file, or by its fte if it lives in swap, as swapped ftes are kept
+   until their owners are done with them. Pages that are recreated
+   as zeros have nothing to name them by and get no ghost.
+
+   The capacity c in the paper is taken to be the frames in use plus
+   those free, as user frames share a pool with the kernel. */
+
+/* Values of frame->policy_list */
+enum car_list
+  {
+    CAR_NONE,
+    CAR_T1,
+    CAR_T2
+  };
+
+/* A page that was recently evicted */
+struct ghost
+  {
+    const void *key_ptr;            /* Inode or fte */
+    off_t offset;
+    bool in_b2;                     /* Evicted from T2 rather than T1 */
+    struct list_elem list_elem;     /* In b1 or b2 */
+    struct hash_elem hash_elem;     /* In ghosts */
+  };
+
+/* Resident frames, with the clock hand at the front */
+static struct list t1;
+static struct list t2;
+static size_t t1_cnt;
+static size_t t2_cnt;
+
+/* Ghosts, least recently evicted at the front, and all of them by key */
+static struct list b1;
+static struct list b2;
+static size_t b1_cnt;
+static size_t b2_cnt;
+static struct hash ghosts;
+
+/* Target size of T1 */
+static size_t p;
+
+static unsigned ghost_hash_func (const struct hash_elem *e_ptr, 
+                                 void *aux UNUSED);
+static bool     ghost_less_func (const struct hash_elem *a_ptr,
+                                 const struct hash_elem *b_ptr,
+                                 void *aux UNUSED);
+
+static bool          ghost_key      (struct fte *fte_ptr, bool to_swap,
+                                     const void **key_ptr, off_t *offset);
+static struct ghost *ghost_find     (const void *key_ptr, off_t offset);
+static void          ghost_add      (struct fte *fte_ptr, bool in_b2);
+static void          ghost_remove   (struct ghost *ghost_ptr);
+static void          ghost_drop_lru (struct list *list_ptr);
+static size_t        car_capacity   (void);
+
+static bool        car_init        (void);
+static void        car_frame_in    (struct fte *fte_ptr);
+static void        car_frame_out   (struct fte *fte_ptr);
+static void        car_forget      (struct fte *fte_ptr);
+static void        car_deactivate  (struct fte *fte_ptr);
+static struct fte *car_find_victim (void);
+
+const struct evict_policy car_policy =
+  {
+    .name        = "car",
+    .init        = car_init,
+    .on_fault    = car_frame_in,
+    .pick_victim = car_find_victim,
+    .on_free     = car_frame_out,
+    .on_forget   = car_forget,
+    .on_deactivate = car_deactivate
+  };
+
+static bool
+car_init (void)
+{
+  list_init (&t1);
+  list_init (&t2);
+  list_init (&b1);
+  list_init (&b2);
+  return hash_init (&ghosts, &ghost_hash_func, &ghost_less_func, NULL);
+}
+
+/* Puts a frame that has just come in on T1, or on T2 if it was evicted
+   recently enough to have a ghost, adapting the target size of T1 by
+   which list the ghost was on. */
+static void
+car_frame_in (struct fte *fte_ptr)
+{
+  const void *key_ptr;
+  off_t offset;
+  struct ghost *ghost_ptr = NULL;
+  size_t c = car_capacity ();
+
+  struct frame *frame_ptr = ft_frame (fte_ptr);
+  ASSERT (frame_ptr->policy_list == CAR_NONE);
+
+  if (ghost_key (fte_ptr, false, &key_ptr, &offset))
+      ghost_ptr = ghost_find (key_ptr, offset);
+
+  if (ghost_ptr == NULL)
+    {
+      /* Keep the ghosts to the sizes the paper allows, T1 + B1 <= c and 
+         T1 + T2 + B1 + B2 <= 2c */
+      if (t1_cnt + b1_cnt >= c && b1_cnt > 0)
+          ghost_drop_lru (&b1);
+      else if (t1_cnt + t2_cnt + b1_cnt + b2_cnt >= 2 * c && b2_cnt > 0)
+          ghost_drop_lru (&b2);
+
+      list_push_back (&t1, &frame_ptr->policy_elem);
+      frame_ptr->policy_list = CAR_T1;
+      t1_cnt++;
+      return;
+    }
+
+  if (!ghost_ptr->in_b2)
+    {
+      size_t delta = b2_cnt > b1_cnt ? b2_cnt / b1_cnt : 1;
+      p = p + delta < c ? p + delta : c;
+    }
+  else
+    {
+      size_t delta = b1_cnt > b2_cnt ? b1_cnt / b2_cnt : 1;
+      p = p > delta ? p - delta : 0;
+    }
+  ghost_remove (ghost_ptr);
+
+  list_push_back (&t2, &frame_ptr->policy_elem);
+  frame_ptr->policy_list = CAR_T2;
+  t2_cnt++;
+}
+
+/* Takes a frame off the clocks, if it is on one, as it loses its frame */
+static void
+car_frame_out (struct fte *fte_ptr)
+{
+  struct frame *frame_ptr = ft_frame (fte_ptr);
+  if (frame_ptr->policy_list == CAR_NONE)
+      return;
+
+  list_remove (&frame_ptr->policy_elem);
+  if (frame_ptr->policy_list == CAR_T1)
+      t1_cnt--;
+  else
+      t2_cnt--;
+  frame_ptr->policy_list = CAR_NONE;
+}
+
+/* Drops the ghost of a swapped page whose fte is about to be freed */
+static void
+car_forget (struct fte *fte_ptr)
+{
+  struct ghost *ghost_ptr = ghost_find (fte_ptr, 0);
+  if (ghost_ptr != NULL)
+      ghost_remove (ghost_ptr);
+}
+
+/* Moves a frame whose page will not be used again soon under the T1 hand,
+   whichever clock it was on, so that it goes before any frame that has
+   not been given up on */
+static void
+car_deactivate (struct fte *fte_ptr)
+{
+  struct frame *frame_ptr = ft_frame (fte_ptr);
+  if (frame_ptr->policy_list == CAR_NONE)
+      return;
+
+  list_remove (&frame_ptr->policy_elem);
+  if (frame_ptr->policy_list == CAR_T2)
+    {
+      frame_ptr->policy_list = CAR_T1;
+      t2_cnt--;
+      t1_cnt++;
+    }
+  list_push_front (&t1, &frame_ptr->policy_elem);
+}
+
+/* Chooses a frame to evict, taking it off its clock and leaving a ghost
+   in its place. Turns the T1 hand while T1 is above its target size and
+   the T2 hand otherwise; referenced frames under the T1 hand move to T2,
+   and those under the T2 hand go round again. Pinned frames are passed
+   over. Returns NULL if every frame was passed over twice. */
+static struct fte *
+car_find_victim (void)
+{
+  size_t probes = 2 * (t1_cnt + t2_cnt) + 1;
+
+  while (probes-- > 0 && t1_cnt + t2_cnt > 0)
+    {
+      bool from_t1 = t1_cnt > 0 && (t1_cnt >= (p > 0 ? p : 1) || t2_cnt == 0);
+      struct list *list_ptr = from_t1 ? &t1 : &t2;
+      struct frame *frame_ptr = list_entry (list_pop_front (list_ptr),
+                                            struct frame, policy_elem);
+      struct fte *fte_ptr = frame_ptr->fte_ptr;
+
+      if (fte_ptr->pin_cnt > 0)
+          list_push_back (list_ptr, &frame_ptr->policy_elem);
+      else if (frame_unset_accessed_ptes (fte_ptr))
+        {
+          list_push_back (&t2, &frame_ptr->policy_elem);
+          if (from_t1)
+            {
+              frame_ptr->policy_list = CAR_T2;
+              t1_cnt--;
+              t2_cnt++;
+            }
+        }
+      else
+        {
+          if (from_t1)
+              t1_cnt--;
+          else
+              t2_cnt--;
+          frame_ptr->policy_list = CAR_NONE;
+          ghost_add (fte_ptr, !from_t1);
+          return fte_ptr;
+        }
+    }
+
+  return NULL;
+}
+
+/* Works out the name a page's ghost goes by. TO_SWAP says that the page 
+   is about to be written to swap. Returns false if the page has no name,
+   being made of zeros. */
+static bool
+ghost_key (struct fte *fte_ptr, bool to_swap, 
+           const void **key_ptr, off_t *offset)
+{
+  if (to_swap || fte_ptr->eviction_method == SWAP)
+    {
+      *key_ptr = fte_ptr;
+      *offset  = 0;
+      return true;
+    }
+  if (fte_ptr->inode_ptr == NULL)
+      return false;
+
+  *key_ptr = fte_ptr->inode_ptr;
+  *offset  = fte_ptr->offset;
+  return true;
+}
+
+static struct ghost *
+ghost_find (const void *key_ptr, off_t offset)
+{
+  struct ghost ghost;
+  ghost.key_ptr = key_ptr;
+  ghost.offset  = offset;
+
+  struct hash_elem *e_ptr = hash_find (&ghosts, &ghost.hash_elem);
+  return e_ptr != NULL ? hash_entry (e_ptr, struct ghost, hash_elem) : NULL;
+}
+
+/* Leaves a ghost for a frame about to be evicted, at the most recent end
+   of B2 if IN_B2, otherwise of B1. Evict only swaps dirty SWAP_IF_DIRTY
+   frames, so whether the page will live in swap is known now. */
+static void
+ghost_add (struct fte *fte_ptr, bool in_b2)
+{
+  bool to_swap = fte_ptr->eviction_method == SWAP_IF_DIRTY 
+                 && frame_dirty (fte_ptr);
+  const void *key_ptr;
+  off_t offset;
+
+  if (!ghost_key (fte_ptr, to_swap, &key_ptr, &offset) ||
+      ghost_find (key_ptr, offset) != NULL)
+      return;
+
+  /* Losing a ghost only loses a hint */
+  struct ghost *ghost_ptr = malloc (sizeof (struct ghost));
+  if (ghost_ptr == NULL)
+      return;
+
+  ghost_ptr->key_ptr = key_ptr;
+  ghost_ptr->offset  = offset;
+  ghost_ptr->in_b2   = in_b2;
+  hash_insert (&ghosts, &ghost_ptr->hash_elem);
+  if (in_b2)
+    {
+      list_push_back (&b2, &ghost_ptr->list_elem);
+      b2_cnt++;
+    }
+  else
+    {
+      list_push_back (&b1, &ghost_ptr->list_elem);
+      b1_cnt++;
+    }
+
+  /* The daemon evicts ahead of faults, so also bound the ghosts here */
+  while (b1_cnt + b2_cnt > car_capacity ())
+      ghost_drop_lru (b1_cnt > b2_cnt ? &b1 : &b2);
+}
+
+static void
+ghost_remove (struct ghost *ghost_ptr)
+{
+  list_remove (&ghost_ptr->list_elem);
+  hash_delete (&ghosts, &ghost_ptr->hash_elem);
+  if (ghost_ptr->in_b2)
+      b2_cnt--;
+  else
+      b1_cnt--;
+  free (ghost_ptr);
+}
+
+static void
+ghost_drop_lru (struct list *list_ptr)
+{
+  ghost_remove (list_entry (list_front (list_ptr), struct ghost, list_elem));
+}
+
+/* Returns the number of frames user pages could have right now */
+static size_t
+car_capacity (void)
+{
+  return t1_cnt + t2_cnt + reclaim_free_frames ();
+}
+
+static unsigned
+ghost_hash_func (const struct hash_elem *e_ptr, void *aux UNUSED)
+{
+  const struct ghost *ghost_ptr = hash_entry (e_ptr, struct ghost, hash_elem);
+  return hash_int ((int) ghost_ptr->key_ptr) ^ hash_int (ghost_ptr->offset);
+}
+
+static bool
+ghost_less_func (const struct hash_elem *a_ptr,
+                 const struct hash_elem *b_ptr,
+                 void *aux UNUSED)
+{
+  const struct ghost *a = hash_entry (a_ptr, struct ghost, hash_elem);
+  const struct ghost *b = hash_entry (b_ptr, struct ghost, hash_elem);
+  if (a->key_ptr != b->key_ptr)
+      return a->key_ptr < b->key_ptr;
+  return a->offset < b->offset;
+}
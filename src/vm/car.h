@@ -0,0 +1,8 @@
+#ifndef VM_CAR_H
+#define VM_CAR_H
+
+#include "vm/evict.h"
+
+extern const struct evict_policy car_policy;
+
+#endif
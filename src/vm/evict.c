@@ -1,29 +1,179 @@
 #include <debug.h>
 #include <stdio.h>
+#include <string.h>
 #include <random.h>
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "userprog/pagedir.h"
 #include "vm/evict.h"
+#include "vm/car.h"
 #include "vm/ft.h"
+#include "vm/pff.h"
+#include "vm/trace.h"
+#include "vm/vmstat.h"
 
-static int evict_find_victim_random (void);
-
-static int  evict_find_victim_sca      (void);
-static bool frame_unset_accessed_ptes  (struct fte *fte_ptr);
-static bool pagedir_unset_accessed_pte (struct owner owner);
+static struct fte *evict_find_victim_random (void);
+static struct fte *evict_find_victim_sca    (void);
+static struct fte *evict_find_victim_owned  (struct thread *t_ptr);
+static void evict_frame                     (struct fte *fte_ptr);
+static bool ptes_unset_accessed        (struct fte *fte_ptr);
 
 static int sca_victim_candidate_index = 0;
+static size_t owned_victim_index;
 struct fte *sca_victim_candidate_ptr;
 
-int
+/* Policies that need nothing beyond the frame descriptors */
+static const struct evict_policy sca_policy = 
+  {
+    .name        = "sca",
+    .pick_victim = evict_find_victim_sca
+  };
+
+static const struct evict_policy random_policy = 
+  {
+    .name        = "random",
+    .pick_victim = evict_find_victim_random
+  };
+
+/* Replacement policies, chosen with the -evict kernel option. The first
+   is the default. */
+static const struct evict_policy *const evict_policies[] = 
+  {
+    &car_policy,
+    &sca_policy,
+    &random_policy
+  };
+#define EVICT_POLICY_CNT (sizeof evict_policies / sizeof *evict_policies)
+
+static const struct evict_policy *evict_policy = &car_policy;
+
+/* Selects the replacement policy by NAME, returning false if there is no
+   such policy. Must be called before ft_init (). */
+bool
+evict_set_policy (const char *name)
+{
+  if (name == NULL)
+      return false;
+
+  for (size_t i = 0; i < EVICT_POLICY_CNT; i++)
+      if (!strcmp (name, evict_policies[i]->name))
+        {
+          evict_policy = evict_policies[i];
+          return true;
+        }
+  return false;
+}
+
+/* Initializes the replacement policy. Returns false on allocation
+   failure. */
+bool
+evict_init (void)
+{
+  return evict_policy->init == NULL || evict_policy->init ();
+}
+
+/* Tells the replacement policy that FTE_PTR has just been given a frame,
+   either newly or coming back from swap. ft_lock must be held. */
+void
+evict_frame_in (struct fte *fte_ptr)
+{
+  if (evict_policy->on_fault != NULL)
+      evict_policy->on_fault (fte_ptr);
+}
+
+/* Tells the replacement policy that FTE_PTR is about to lose its frame,
+   whether it is being evicted or its owners are done with it. ft_lock 
+   must be held. */
+void
+evict_frame_out (struct fte *fte_ptr)
+{
+  if (evict_policy->on_free != NULL)
+      evict_policy->on_free (fte_ptr);
+}
+
+/* Tells the replacement policy that FTE_PTR, which has no frame, is about
+   to be freed, so that it forgets anything it remembers about it. ft_lock
+   must be held. */
+void
+evict_frame_forget (struct fte *fte_ptr)
+{
+  if (evict_policy->on_forget != NULL)
+      evict_policy->on_forget (fte_ptr);
+}
+
+/* Tells the replacement policy that FTE_PTR's page will not be used again
+   soon, its owner having scanned past it, and forgets that it was
+   accessed, so that it is among the next frames evicted. ft_lock must be
+   held. */
+void
+evict_frame_deactivate (struct fte *fte_ptr)
+{
+  frame_unset_accessed_ptes (fte_ptr);
+  if (evict_policy->on_deactivate != NULL)
+      evict_policy->on_deactivate (fte_ptr);
+}
+
+/* Samples the accessed bits of every resident frame, clearing them. A
+   frame found accessed is marked referenced, for the policy to see when
+   it next looks at the bits, and reported to the policy and the trace.
+   ft_lock must be held. */
+void
+evict_sample_access (void)
+{
+  for (size_t i = 0; i < frame_cnt; i++)
+    {
+      struct fte *fte_ptr = frame_arr[i].fte_ptr;
+
+      /* Pinned frames may not have owners yet */
+      if (fte_ptr == NULL || fte_ptr->pin_cnt > 0 || 
+          !ptes_unset_accessed (fte_ptr))
+          continue;
+
+      frame_arr[i].referenced = true;
+      if (evict_policy->on_access_sample != NULL)
+          evict_policy->on_access_sample (fte_ptr);
+      trace_access (fte_ptr);
+    }
+}
+
+/* Evicts a frame so that its page can be reused, taking it from a process
+   over its allowance if there is one, and otherwise as the policy chooses.
+   Called with ft_lock held, which is released while the victim is written
+   out and held again on return. Returns false if no frame could be
+   evicted. */
+bool
 evict (void)
 {
-  /* Obtain a random int from 0 to frame_index_size (exclusive) */
-  /* Keep trying until we find a frame that is not pinned to evict */
+  struct fte *fte_ptr = NULL;
+  if (pff_any_over () && (fte_ptr = evict_find_victim_owned (NULL)) != NULL)
+      pff_count_trim (false);
+  else if ((fte_ptr = evict_policy->pick_victim ()) == NULL)
+      return false;
 
-  int victim_index    = evict_find_victim_sca ();
-  struct fte *fte_ptr = frame_index_arr[victim_index];
+  evict_frame (fte_ptr);
+  return true;
+}
+
+/* Evicts a frame of T_PTR alone, for a thread at its hard limit, as evict
+   does. Returns false if it has none that can go. */
+bool
+evict_own (struct thread *t_ptr)
+{
+  struct fte *fte_ptr = evict_find_victim_owned (t_ptr);
+  if (fte_ptr == NULL)
+      return false;
+
+  pff_count_trim (true);
+  evict_frame (fte_ptr);
+  return true;
+}
 
+/* Writes out or drops a frame chosen for eviction, as its eviction method
+   says */
+static void
+evict_frame (struct fte *fte_ptr)
+{
+  vmstat_count_evict (fte_ptr->eviction_method);
   switch (fte_ptr->eviction_method)
     {
       case SWAP:
@@ -49,7 +199,7 @@ evict (void)
           if (dirty) frame_swap (fte_ptr);
           else 
             {
-              frame_remove_owners (fte_ptr, !dirty);
+              frame_remove_owners (fte_ptr, true);
               frame_delete (fte_ptr);
             }
 
@@ -57,98 +207,124 @@ evict (void)
         }
       case WRITE_IF_DIRTY:
         {
+          /* Unmap the page before writing it back so that it cannot be
+             dirtied again; owners that fault wait for the write. */
           bool dirty = frame_dirty (fte_ptr);
-          if (dirty) frame_write (fte_ptr);
+          frame_remove_owners (fte_ptr, true);
 
           if (dirty) debugf("Eviction by writing as dirty. \n");
           else       debugf("Eviction by deletion as not dirty.");
 
-          frame_remove_owners (fte_ptr, true);
-          frame_delete        (fte_ptr);
+          /* A failed write, to a file that denies writes, drops the
+             changes as the file could never have been written anyway */
+          if (dirty) frame_write (fte_ptr);
+          frame_delete (fte_ptr);
           break;
         }
       default: NOT_REACHED ();
     }
-
-  frame_index_arr[victim_index] = NULL;
-  return victim_index;
 }
 
-/* Random eviction. */
-static int
+/* Random eviction. Gives up, returning NULL, after as many tries as there
+   are frames. */
+static struct fte *
 evict_find_victim_random (void)
 {
-  int i = (int) (random_ulong () % frame_index_size);
-
-  while (true)
+  for (size_t tries = 0; tries < frame_cnt; tries++)
     {
-      if (frame_index_arr[i]->pin_cnt == 0) break;
-      i = (int) (random_ulong () % frame_index_size);
+      struct fte *fte_ptr = frame_arr[random_ulong () % frame_cnt].fte_ptr;
+      if (fte_ptr != NULL && fte_ptr->pin_cnt == 0)
+          return fte_ptr;
     }
 
-  ASSERT (frame_index_arr[i]->pin_cnt == 0);
-  return i;
+  return NULL;
 }
 
-/* Second chance eviction. */
-static int
+/* Second chance eviction. The frame descriptors span the whole page pool,
+   so pages currently held by the kernel show up as empty descriptors and
+   are skipped. Two passes give every accessed frame its second chance; if
+   none turns up, every user frame is pinned (or there are none) and NULL
+   is returned. */
+static struct fte *
 evict_find_victim_sca (void)
 {
-  for (int i = sca_victim_candidate_index; true;
-       i = (i + 1) % frame_index_size)
+  size_t i = sca_victim_candidate_index % frame_cnt;
+
+  for (size_t probes = 0; probes < 2 * frame_cnt;
+       probes++, i = (i + 1) % frame_cnt)
     {
-      sca_victim_candidate_ptr = frame_index_arr[i];
-      if (sca_victim_candidate_ptr->pin_cnt > 0)
+      sca_victim_candidate_ptr = frame_arr[i].fte_ptr;
+      if (sca_victim_candidate_ptr == NULL)
+          continue;
+      else if (sca_victim_candidate_ptr->pin_cnt > 0)
           continue;
       else if (frame_unset_accessed_ptes (sca_victim_candidate_ptr))
           continue;
       else
         {
-          sca_victim_candidate_index = i + 1;
-          return i;
+          sca_victim_candidate_index = (i + 1) % frame_cnt;
+          return sca_victim_candidate_ptr;
         }
     }
+
+  return NULL;
 }
 
-/* Returns true if the frame was accessed, all access bits of owners will
-   be set to 0 in this case. Otherwise returns false. */
-static bool
-frame_unset_accessed_ptes (struct fte *fte_ptr)
+/* Second chance over the frames with a single owner: T_PTR, or if it is
+   NULL any process over its allowance. The victim leaves the policy's
+   lists as it is evicted. Returns NULL if none turns up in two passes. */
+static struct fte *
+evict_find_victim_owned (struct thread *t_ptr)
 {
-  bool accessed = false;
-  if (fte_ptr->shared)
-    {
-      struct list *owner_list_ptr = fte_ptr->owners.owner_list_ptr;
+  size_t i = owned_victim_index % frame_cnt;
 
-      for (struct list_elem *e = list_begin (owner_list_ptr); 
-           e != list_end (owner_list_ptr);
-           e  = list_next (e))
-        {
-          accessed |= pagedir_unset_accessed_pte (
-              list_entry (e, struct owner_list_elem, elem)->owner);
-        }
-    }
-  else
+  for (size_t probes = 0; probes < 2 * frame_cnt;
+       probes++, i = (i + 1) % frame_cnt)
     {
-      accessed = pagedir_unset_accessed_pte (fte_ptr->owners.owner_single);
+      struct fte *fte_ptr = frame_arr[i].fte_ptr;
+      if (fte_ptr == NULL || fte_ptr->pin_cnt > 0 || 
+          fte_ptr->owners.cnt != 1)
+          continue;
+
+      struct thread *owner_ptr = rmap_owner (&fte_ptr->owners, 0)->owner_ptr;
+      if (t_ptr != NULL ? owner_ptr != t_ptr 
+                        : !pff_over_allowance (owner_ptr))
+          continue;
+      if (frame_unset_accessed_ptes (fte_ptr))
+          continue;
+
+      owned_victim_index = (i + 1) % frame_cnt;
+      return fte_ptr;
     }
 
+  return NULL;
+}
+
+/* Returns true if the frame was accessed, all access bits of owners, and
+   any access found by evict_sample_access, will be cleared in this case. 
+   Otherwise returns false. */
+bool
+frame_unset_accessed_ptes (struct fte *fte_ptr)
+{
+  struct frame *frame_ptr = ft_frame (fte_ptr);
+  bool accessed = ptes_unset_accessed (fte_ptr) || frame_ptr->referenced;
+  frame_ptr->referenced = false;
   return accessed;
 }
 
-/* Returns true if a PTE is accessed and unsets it's access bit. 
-   Returns false otherwise */
+/* As frame_unset_accessed_ptes, looking only at the owners' page table
+   entries */
 static bool
-pagedir_unset_accessed_pte (struct owner owner)
+ptes_unset_accessed (struct fte *fte_ptr)
 {
-  if (pagedir_is_accessed (owner.owner_ptr->pagedir,
-                           owner.upage_ptr))
+  bool accessed = false;
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
     {
-      pagedir_set_accessed (owner.owner_ptr->pagedir, 
-                            owner.upage_ptr,
-                            false);
-      return true;
+      struct owner *owner_ptr = rmap_owner (&fte_ptr->owners, i);
+      accessed |= pagedir_pte_clear (owner_ptr->owner_ptr->pagedir,
+                                     owner_ptr->pte_ptr, 
+                                     owner_ptr->upage_ptr, PTE_A) != 0;
     }
 
-  return false;
+  return accessed;
 }
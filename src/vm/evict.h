@@ -1,8 +1,33 @@
 #ifndef VM_EVICT_H
 #define VM_EVICT_H
 
+#include <stdbool.h>
 #include "vm/ft.h"
 
-int evict (void);
+/* A replacement policy for user frames. Only pick_victim is required.
+   All are called with ft_lock held. */
+struct evict_policy
+  {
+    const char *name;                           /* For -evict=NAME */
+    bool (*init) (void);
+    void (*on_fault) (struct fte *);            /* Frame just came in */
+    void (*on_access_sample) (struct fte *);    /* Found accessed */
+    struct fte *(*pick_victim) (void);          /* NULL if none */
+    void (*on_free) (struct fte *);             /* Frame going out */
+    void (*on_forget) (struct fte *);           /* Swapped fte freed */
+    void (*on_deactivate) (struct fte *);       /* Scanned past */
+  };
+
+bool evict_set_policy       (const char *name);
+bool evict_init             (void);
+bool evict                  (void);
+bool evict_own              (struct thread *t_ptr);
+void evict_frame_in         (struct fte *fte_ptr);
+void evict_frame_out        (struct fte *fte_ptr);
+void evict_frame_forget     (struct fte *fte_ptr);
+void evict_frame_deactivate (struct fte *fte_ptr);
+void evict_sample_access    (void);
+
+bool frame_unset_accessed_ptes (struct fte *fte_ptr);
 
 #endif
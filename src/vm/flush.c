@@ -0,0 +1,173 @@
+#include "vm/flush.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "vm/ft.h"
+
+/* Periodic write back of shared file pages.
+
+   Dirty MMAP frames are otherwise only written when they are evicted
+   or unmapped, so a long lived mapping can build up any amount of
+   dirty data, all of which munmap or exit then writes at once. A
+   daemon thread wakes every FLUSH_INTERVAL ticks, or sooner when
+   msync asks it to, and writes back every dirty shared file frame.
+   Frames are gathered FLUSH_BATCH at a time and written in order of
+   inode and offset, so each file is written front to back. The
+   frames stay mapped, with their owners' dirty bits cleared, so
+   unmapping them later writes only what was dirtied since. */
+
+/* Ticks between flushes, and between checks for a request to flush. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+#define FLUSH_POLL     (TIMER_FREQ / 10)
+
+/* Frames gathered and sorted before they are written. */
+#define FLUSH_BATCH 64
+
+/* A frame to write back, remembered by its index in frame_arr and
+   by what it holds, as it may be freed while ft_lock is released. */
+struct flush_item
+{
+  size_t index;
+  struct inode *inode_ptr;
+  off_t offset;
+};
+
+/* Set by msync to flush before the interval is up. */
+static bool flush_requested;
+
+/* Statistics. */
+static long long flush_cnt;
+static long long sync_cnt;
+
+static void flush_daemon     (void *aux UNUSED);
+static void flush_all        (void);
+static bool flushable        (struct fte *fte_ptr);
+static int  flush_item_cmp   (const void *a_ptr, const void *b_ptr);
+
+/* Starts the flusher. Must be called before any user process runs. */
+void
+flush_init (void)
+{
+  if (thread_create ("flushd", PRI_DEFAULT, flush_daemon, NULL) 
+      == TID_ERROR)
+      PANIC ("Could not start the flusher");
+}
+
+/* Writes back the page of SPTE_PTR now if it is a dirty shared file page,
+   leaving it mapped. ft_lock must be held, and is released for the write.
+   Returns false if the write failed. */
+bool
+flush_page (struct spte *spte_ptr)
+{
+  if (spte_ptr->frame_type != MMAP)
+      return true;
+
+  struct fte *fte_ptr = ft_stable_frame (spte_ptr);
+  if (fte_ptr == NULL || fte_ptr->swapped || !frame_dirty (fte_ptr))
+      return true;
+
+  if (!frame_launder (fte_ptr))
+      return false;
+  sync_cnt++;
+  return true;
+}
+
+/* Asks the flusher to write back every dirty shared file page soon,
+   without waiting for it. */
+void
+flush_request (void)
+{
+  flush_requested = true;
+}
+
+/* Prints flusher statistics. */
+void
+flush_print_stats (void)
+{
+  printf ("Flush: %lld shared file pages written back by the flusher, "
+          "%lld by msync\n", flush_cnt, sync_cnt);
+}
+
+static void
+flush_daemon (void *aux UNUSED)
+{
+  int64_t last_flush = timer_ticks ();
+
+  for (;;)
+    {
+      timer_sleep (FLUSH_POLL);
+      if (!flush_requested && timer_elapsed (last_flush) < FLUSH_INTERVAL)
+          continue;
+      flush_requested = false;
+      last_flush = timer_ticks ();
+
+      acquire_ft ();
+      flush_all ();
+      release_ft ();
+    }
+}
+
+/* Writes back every dirty shared file frame, a sorted batch at a time.
+   ft_lock must be held, and is released for each write and between
+   batches. */
+static void
+flush_all (void)
+{
+  struct flush_item batch[FLUSH_BATCH];
+  size_t index = 0;
+
+  while (index < frame_cnt)
+    {
+      size_t batch_cnt = 0;
+      for (; index < frame_cnt && batch_cnt < FLUSH_BATCH; index++)
+        {
+          struct fte *fte_ptr = frame_arr[index].fte_ptr;
+          if (flushable (fte_ptr))
+              batch[batch_cnt++] = (struct flush_item) 
+                  { index, fte_ptr->inode_ptr, fte_ptr->offset };
+        }
+      qsort (batch, batch_cnt, sizeof *batch, flush_item_cmp);
+
+      /* Frames freed or reused during an earlier write are skipped */
+      for (size_t i = 0; i < batch_cnt; i++)
+        {
+          struct fte *fte_ptr = frame_arr[batch[i].index].fte_ptr;
+          if (flushable (fte_ptr) && 
+              fte_ptr->inode_ptr == batch[i].inode_ptr &&
+              fte_ptr->offset    == batch[i].offset &&
+              frame_launder (fte_ptr))
+              flush_cnt++;
+        }
+
+      release_ft ();
+      thread_yield ();
+      acquire_ft ();
+    }
+}
+
+/* Returns true if FTE_PTR is a dirty shared file frame the flusher may
+   write. Pinned frames are in transit or not installed yet. */
+static bool
+flushable (struct fte *fte_ptr)
+{
+  return fte_ptr != NULL && 
+         !fte_ptr->swapped &&
+         fte_ptr->transit == FRAME_STABLE &&
+         fte_ptr->pin_cnt == 0 &&
+         fte_ptr->eviction_method == WRITE_IF_DIRTY &&
+         frame_dirty (fte_ptr);
+}
+
+/* Orders flush items by inode, then by offset within it */
+static int
+flush_item_cmp (const void *a_ptr, const void *b_ptr)
+{
+  const struct flush_item *a = a_ptr;
+  const struct flush_item *b = b_ptr;
+
+  if (a->inode_ptr != b->inode_ptr)
+      return a->inode_ptr < b->inode_ptr ? -1 : 1;
+  return a->offset < b->offset ? -1 : a->offset > b->offset;
+}
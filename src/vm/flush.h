@@ -0,0 +1,12 @@
+#ifndef VM_FLUSH_H
+#define VM_FLUSH_H
+
+#include <stdbool.h>
+#include "vm/spt.h"
+
+void flush_init        (void);
+bool flush_page        (struct spte *spte_ptr);
+void flush_request     (void);
+void flush_print_stats (void);
+
+#endif
@@ -3,7 +3,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <round.h>
 #include "threads/malloc.h"
+#include "threads/vmalloc.h"
+#include "threads/pte.h"
+#include "threads/highmem.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/palloc.h"
@@ -17,6 +21,12 @@
 #include "vm/spt.h"
 #include "vm/swap.h"
 #include "vm/evict.h"
+#include "vm/reclaim.h"
+#include "vm/pagein.h"
+#include "vm/trace.h"
+#include "vm/vma.h"
+#include "vm/pff.h"
+#include "vm/vmstat.h"
 
 /* Frame table globals */
 static struct hash  ft;
@@ -32,7 +42,6 @@ static void     fte_deallocate_func (struct hash_elem *e_ptr,
                                      void *aux UNUSED);
 
 /* Frame table entry helpers */
-static void        fte_insert      (struct fte *fte_ptr);
 static struct fte *construct_fte   (union Frame_location loc,
                                     enum eviction_method eviction_method,
                                     struct inode *inode_ptr,
@@ -41,21 +50,47 @@ static struct fte *construct_fte   (union Frame_location loc,
 static struct fte *construct_frame (enum frame_type frame_type, 
                                     struct inode *inode_ptr,
                                     off_t offset, 
-                                    int amount_occupied);
+                                    int amount_occupied,
+                                    bool *raced_ptr);
 
 static struct fte *ft_find_frame   (struct inode *inode_ptr, off_t offset);
 
-static bool fte_add_owner_shared       (struct fte *fte_ptr, 
-                                        struct thread *t_ptr, 
-                                        void *upage);
-static bool fte_add_owner_newly_shared (struct fte *fte_ptr, 
-                                        struct thread *t_ptr, 
-                                        void *upage);
-static void convert_fte_to_non_shared  (struct fte *fte_ptr);
+static bool fte_add_owner (struct fte *fte_ptr, 
+                           struct thread *t_ptr, 
+                           void *upage);
+static bool fte_has_owner (struct fte *fte_ptr,
+                           struct thread *t_ptr,
+                           void *upage);
+
+/* Reverse map helpers */
+static bool rmap_add       (struct rmap *rmap_ptr, struct owner owner);
+static void rmap_remove_at (struct rmap *rmap_ptr, int i);
+static void rmap_clear     (struct rmap *rmap_ptr);
+
+/* Helpers for frames undergoing I/O with the ft_lock released */
+static void frame_begin_transit (struct fte *fte_ptr, 
+                                 enum frame_transit transit);
+static void frame_end_transit   (struct fte *fte_ptr);
+static bool frame_swap_in       (struct fte *fte_ptr);
+static bool frame_read_swapped  (struct fte *fte_ptr, uintptr_t frame_paddr);
+static int  frame_swap_slot     (struct fte *fte_ptr);
+static int  readahead_begin     (struct fte *fte_ptr,
+                                 struct fte **ahead_ptrs,
+                                 uintptr_t *ahead_paddrs);
+static void frame_clean_ptes    (struct fte *fte_ptr);
+static void frame_charge_owners (struct fte *fte_ptr, int delta);
 
 /* Helper to obtain eviction methods by frame type */
 static enum eviction_method get_eviction_method (enum frame_type frame_type);
 
+/* Helpers for pages read from a file */
+static bool is_file_backed (const struct spte *spte_ptr);
+static bool spte_follows   (const struct spte *spte_ptr, 
+                            const struct spte *prev_ptr);
+static bool file_page_resident  (struct spte *spte_ptr);
+static struct spte *resident_entry (void *upage);
+static bool frame_page_in_async (struct spte *spte_ptr);
+
 /* Helper for reading from inode when creating frame */
 static off_t read_from_inode (void *frame_ptr, 
                               struct inode *inode_ptr, 
@@ -67,17 +102,33 @@ static off_t write_to_inode  (void *frame_ptr,
                               off_t offset,
                               off_t bytes_to_write);
 
-/* Helpers for converting between frame indices and frame_ptrs */
-static int   index_from_frame_ptr (void *frame_ptr);
-static void *frame_ptr_from_index (int frame_index);
+/* Helpers for converting from frame addresses to frame indices, and for
+   recording which page a frame holds */
+static int  index_from_frame (uintptr_t frame_paddr);
+static void frame_attach     (struct fte *fte_ptr);
+static void frame_detach     (uintptr_t frame_paddr);
+
+/* Helpers for obtaining and releasing physical frames */
+static uintptr_t frame_alloc          (enum palloc_flags flags);
+static uintptr_t frame_alloc_evicting (enum palloc_flags flags);
+static void      frame_free           (uintptr_t frame_paddr);
+
+/* Pages mapped with a file page fault, in the aligned block around it,
+   if their frames are already resident */
+#define FAULT_AROUND_PAGES 16
+
+/* A frame of zeros, mapped read only for first reads of ALL_ZERO pages
+   in place of frames of their own. It is never written or freed. */
+static uintptr_t zero_paddr;
 
-static void *user_pool_top;
-static void *user_pool_bottom;
+static void  *user_pool_top;
+static void  *user_pool_bottom;
+static size_t lowmem_frame_cnt;
 
 bool debug;
 
-struct fte** frame_index_arr;
-size_t       frame_index_size;
+struct frame *frame_arr;
+size_t        frame_cnt;
 
 /* Initilizes the frame table as a hash map of struct ftes */
 bool 
@@ -88,18 +139,26 @@ ft_init (void)
   if (!hash_init (&ft, &fte_hash_func, &fte_less_func, NULL)) 
       goto fail_1;
   lock_init (&ft_lock);
-  /* Frame index is used for eviction to store which ftes correspond to
-     which frames */
+  /* The frame descriptors record which ftes correspond to which frames,
+     for eviction. User pages may come from anywhere in the page pool, so
+     they cover all of it, with empty descriptors for pages the kernel
+     holds, followed by all of high memory. */
   user_pool_top    = get_user_pool_top ();
   user_pool_bottom = get_user_pool_bottom ();
-  frame_index_size = (user_pool_top - user_pool_bottom) / PGSIZE;
+  lowmem_frame_cnt = (user_pool_top - user_pool_bottom) / PGSIZE;
+  frame_cnt        = lowmem_frame_cnt + highmem_page_cnt ();
 
-  frame_index_arr  = malloc (frame_index_size * sizeof (struct fte *));
-  if (frame_index_arr == NULL)
+  frame_arr = vmalloc (frame_cnt * sizeof (struct frame));
+  if (frame_arr == NULL || !evict_init ())
       goto fail_2;
 
-  /* Zero initialize the frame index as the user pool is initially empty */
-  memset (frame_index_arr, 0, frame_index_size * sizeof (struct fte *));
+  /* Zero initialize the descriptors as the user pool is initially empty */
+  memset (frame_arr, 0, frame_cnt * sizeof (struct frame));
+
+  void *zero_page = palloc_get_page (PAL_ZERO);
+  if (zero_page == NULL)
+      goto fail_2;
+  zero_paddr = vtop (zero_page);
 
   return true;
 
@@ -117,67 +176,428 @@ ft_destroy (void)
   lock_acquire (&ft_lock);
   hash_destroy (&ft, &fte_deallocate_func);
   lock_release (&ft_lock);
-  free (frame_index_arr);
+  vfree (frame_arr);
 }
 
 bool
 ft_install_frame (struct spte *spte_ptr, struct fte *fte_ptr)
 {
   ASSERT (!fte_ptr->swapped);
-  void *upage   = spte_ptr->uaddr;
-  void *kpage   = fte_ptr->loc.frame_ptr;
-  bool writable = spte_ptr->writable;
+  void *upage     = spte_ptr->uaddr;
+  uintptr_t paddr = fte_ptr->loc.frame_paddr;
+  bool writable   = spte_ptr->writable && !fte_ptr->cow;
 
-  if (!install_page (upage, kpage, writable))
+  if (!install_frame (upage, paddr, writable))
       goto fail_install_page;
 
-  /* Get the existing page directory entry */
-  struct thread *t_ptr = thread_current ();
+  if (!fte_add_owner (fte_ptr, thread_current (), upage))
+      goto fail_add_pde;
+
+  /* Unpin the frame and associate SPTE with FTE */
+  spte_ptr->fte_ptr = fte_ptr;
+  ASSERT (fte_ptr->pin_cnt > 0);
+  fte_ptr->pin_cnt--;
+  return true;
+
+  fail_add_pde:      pagedir_clear_page (thread_current ()->pagedir, upage);
+  fail_install_page: return false;
+}
 
-  /* If the frame already shared, try and add the new pde to it's
-     pde list, otherwise, either add the new non-list pde,
-     or make a newly shared pde list with the new and old pde. */
+/* Makes CHILD_SPTE_PTR, in the current thread's SPT, share the frame of
+   SPTE_PTR in PARENT_PTR's, if it has one. Pages either may write become
+   copy on write, and are mapped read only in the parent until one of them
+   does; ft_break_cow then gives the writer a copy of its own. Mapped files
+   stay shared writable. The child is mapped lazily, on its first fault.
+   ft_lock must be held. Returns false on any allocation failure. */
+bool
+ft_fork_frame (struct thread *parent_ptr, struct spte *spte_ptr,
+               struct spte *child_spte_ptr)
+{
+  struct fte *fte_ptr = ft_stable_frame (spte_ptr);
+  if (fte_ptr == NULL)
+      return true;
 
-  if (fte_ptr->shared)
+  if (spte_ptr->writable && spte_ptr->frame_type != MMAP)
     {
-      /* If the frame is already shared, attempt to add another owner */
-      if (!fte_add_owner_shared (fte_ptr, t_ptr, upage))
-          goto fail_add_pde;
+      fte_ptr->cow = true;
+      pagedir_set_writable (parent_ptr->pagedir, spte_ptr->uaddr, false);
     }
-  else
+
+  if (!fte_add_owner (fte_ptr, thread_current (), spte_ptr->uaddr))
+      return false;
+  child_spte_ptr->fte_ptr = fte_ptr;
+  return true;
+}
+
+/* Gives the current thread write access to the copy on write frame of
+   SPTE_PTR, which must be stable, swapping it in first if needed. The last
+   owner of such a frame just has its mapping made writable, the others get
+   a copy of their own. The frame is left pinned if LEFT_PINNED. ft_lock
+   must be held, and is released for the copy. Returns false if no frame
+   could be obtained. */
+bool
+ft_break_cow (struct spte *spte_ptr, bool left_pinned)
+{
+  struct fte *fte_ptr = spte_ptr->fte_ptr;
+  void *upage         = spte_ptr->uaddr;
+  uint32_t *pd        = thread_current ()->pagedir;
+
+  ASSERT (fte_ptr->cow && fte_ptr->transit == FRAME_STABLE);
+  if (fte_ptr->swapped && !frame_swap_in (fte_ptr))
+      goto fail_1;
+  fte_ptr->pin_cnt++;
+
+  if (fte_ptr->owners.cnt <= 1)
     {
-      /* Not shared case */
-      if (fte_ptr->owners.owner_single.owner_ptr != NULL)
+      fte_ptr->cow = false;
+      if (pagedir_is_mapped (pd, upage))
         {
-          /* If the frame has a single current owner, attempt to add the
-             new owner and make the frame shared */
-          if (fte_add_owner_newly_shared (fte_ptr, t_ptr, upage))
-              fte_ptr->shared = true;
-          else
-              goto fail_add_pde;
+          pagedir_set_writable (pd, upage, true);
+          fte_ptr->pin_cnt--;
         }
+      else if (!ft_install_frame (spte_ptr, fte_ptr))
+          goto fail_2;
+      if (left_pinned)
+          fte_ptr->pin_cnt++;
+      return true;
+    }
+
+  /* Eviction may release ft_lock, but the frame is pinned, and as every
+     owner maps it read only nobody writes to it while we copy it */
+  uintptr_t copy_paddr = frame_alloc_evicting (PAL_USER);
+  if (copy_paddr == 0)
+      goto fail_2;
+
+  release_ft ();
+  void *frame_ptr = kmap (fte_ptr->loc.frame_paddr);
+  void *copy_ptr  = kmap (copy_paddr);
+  memcpy (copy_ptr, frame_ptr, PGSIZE);
+  kunmap (copy_ptr);
+  kunmap (frame_ptr);
+  acquire_ft ();
+
+  /* The copy is anonymous, whatever the original was read from */
+  struct fte *copy_fte_ptr = construct_fte (
+      (union Frame_location) { .frame_paddr = copy_paddr }, SWAP, NULL, 0,
+      PGSIZE);
+  if (copy_fte_ptr == NULL)
+      goto fail_3;
+  copy_fte_ptr->pin_cnt = 1;
+  frame_attach (copy_fte_ptr);
+  evict_frame_in (copy_fte_ptr);
+
+  /* The other owners may have gone meanwhile, leaving us the last */
+  ft_remove_owner (fte_ptr, upage);
+  fte_ptr->pin_cnt--;
+  ft_remove_frame_if_necessary (fte_ptr);
+
+  spte_ptr->fte_ptr = NULL;
+  if (!ft_install_frame (spte_ptr, copy_fte_ptr))
+    {
+      frame_delete (copy_fte_ptr);
+      goto fail_1;
+    }
+  if (left_pinned)
+      copy_fte_ptr->pin_cnt++;
+  return true;
+
+  fail_3: frame_free (copy_paddr);
+  fail_2: fte_ptr->pin_cnt--;
+  fail_1: return false;
+}
+
+/* Maps the pages around the file page of SPTE_PTR, which has just been
+   faulted in, that are not mapped but whose frames are resident, either
+   already ours or in the frame table hash. Mapping them now saves a fault
+   on each if they are used, and pages mapped without being used are not
+   marked accessed, so are still the first to be evicted. Nothing is mapped
+   around pages advised to be used randomly, nor beyond the thread's hard
+   limit. ft_lock must be held. Returns the number of pages mapped. */
+int
+ft_fault_around (struct spte *spte_ptr)
+{
+  struct thread *t_ptr = thread_current ();
+  void *block = (void *) ROUND_DOWN ((uintptr_t) spte_ptr->uaddr, 
+                                     FAULT_AROUND_PAGES * PGSIZE);
+  int mapped = 0;
+
+  if (!is_file_backed (spte_ptr) || spte_ptr->advice == MADV_RANDOM)
+      return 0;
+
+  for (int i = 0; i < FAULT_AROUND_PAGES && pff_has_room (t_ptr, 1); i++)
+    {
+      void *upage = block + i * PGSIZE;
+      if (pagedir_is_mapped (t_ptr->pagedir, upage))
+          continue;
+      struct spte *near_ptr = resident_entry (upage);
+      if (near_ptr == NULL || !is_file_backed (near_ptr))
+          continue;
+
+      struct fte *fte_ptr = near_ptr->fte_ptr;
+      if (fte_ptr == NULL && near_ptr->frame_type != EXECUTABLE_DATA)
+          fte_ptr = ft_find_frame (near_ptr->inode_ptr, near_ptr->offset);
+      if (fte_ptr == NULL || fte_ptr->swapped || 
+          fte_ptr->transit != FRAME_STABLE)
+          continue;
+
+      fte_ptr->pin_cnt++;
+      if (ft_install_frame (near_ptr, fte_ptr))
+          mapped++;
       else
-          /* If the frame has no current owner, add the owner */
-          fte_ptr->owners.owner_single = (struct owner) { t_ptr, upage };
+          fte_ptr->pin_cnt--;
     }
 
-  /* Unpin the frame and associate SPTE with FTE */
+  return mapped;
+}
+
+/* If the file page of SPTE_PTR, which has just been faulted in, follows a
+   resident page of the same file, or was advised to be used sequentially,
+   starts reading up to PAGEIN_READAHEAD of the pages after it that have
+   no frame, stopping where the file's pages stop. Nothing is read ahead
+   for pages advised to be used randomly, or when frames are short.
+   ft_lock must be held. Returns the number of pages being read ahead. */
+int
+ft_readahead (struct spte *spte_ptr)
+{
+  struct thread *t_ptr = thread_current ();
+  struct spte *prev_ptr = spt_find_entry (t_ptr->spt_ptr, 
+                                          spte_ptr->uaddr - PGSIZE);
+  int ahead_cnt = 0;
+
+  if (!is_file_backed (spte_ptr) || spte_ptr->advice == MADV_RANDOM)
+      return 0;
+  if (spte_ptr->advice != MADV_SEQUENTIAL &&
+      (prev_ptr == NULL || !spte_follows (spte_ptr, prev_ptr) || 
+       prev_ptr->fte_ptr == NULL))
+      return 0;
+
+  struct spte *last_ptr = spte_ptr;
+  for (int i = 1; i <= PAGEIN_READAHEAD; i++)
+    {
+      void *upage = spte_ptr->uaddr + i * PGSIZE;
+      struct spte *near_ptr = vma_get_entry (upage);
+      if (near_ptr == NULL || !spte_follows (near_ptr, last_ptr))
+          break;
+      last_ptr = near_ptr;
+
+      if (file_page_resident (near_ptr))
+          continue;
+      if (!frame_page_in_async (near_ptr))
+          break;
+      ahead_cnt++;
+    }
+
+  return ahead_cnt;
+}
+
+/* Forgets that the pages just behind that of SPTE_PTR, which has just
+   been faulted in, were used, if they were advised to be used
+   sequentially, so that they are evicted before pages still in use.
+   Frames other processes share are left alone. ft_lock must be held. */
+void
+ft_drop_behind (struct spte *spte_ptr)
+{
+  struct thread *t_ptr = thread_current ();
+
+  if (spte_ptr->advice != MADV_SEQUENTIAL)
+      return;
+
+  for (int i = 1; i <= PAGEIN_READAHEAD; i++)
+    {
+      struct spte *behind_ptr = spt_find_entry (t_ptr->spt_ptr, 
+                                                spte_ptr->uaddr - i * PGSIZE);
+      if (behind_ptr == NULL || behind_ptr->advice != MADV_SEQUENTIAL)
+          break;
+
+      struct fte *fte_ptr = behind_ptr->fte_ptr;
+      if (fte_ptr != NULL && !fte_ptr->swapped && fte_ptr->owners.cnt <= 1)
+          evict_frame_deactivate (fte_ptr);
+    }
+}
+
+/* Acts on ADVICE, given with madvise, for the page of SPTE_PTR in the
+   current thread. MADV_WILLNEED starts a file page being read in by the
+   page in daemon, and brings a swapped page back in. MADV_DONTNEED gives
+   up the page's frame, writing it back first if it is the last mapping
+   of a dirty file page, so that the page is faulted in afresh: from its
+   file, or as zeros if it has none. Other advice is kept for the fault
+   handler. ft_lock must be held, and may be released for I/O. */
+void
+ft_madvise (struct spte *spte_ptr, int advice)
+{
+  struct fte *fte_ptr;
+
+  switch (advice)
+    {
+      case MADV_WILLNEED:
+        fte_ptr = ft_stable_frame (spte_ptr);
+        if (fte_ptr == NULL && is_file_backed (spte_ptr) && 
+            !file_page_resident (spte_ptr))
+            frame_page_in_async (spte_ptr);
+        else if (fte_ptr != NULL && fte_ptr->swapped && reclaim_has_spare ())
+            frame_swap_in (fte_ptr);
+        break;
+
+      case MADV_DONTNEED:
+        if (spte_ptr->zero_mapped)
+            ft_unmap_zero_page (spte_ptr);
+        fte_ptr = ft_stable_frame (spte_ptr);
+        if (fte_ptr != NULL)
+          {
+            trace_free (fte_ptr);
+            ft_remove_owner (fte_ptr, spte_ptr->uaddr);
+            spte_ptr->fte_ptr = NULL;
+            ft_remove_frame_if_necessary (fte_ptr);
+          }
+        break;
+
+      default:
+        spte_ptr->advice = advice;
+    }
+}
+
+/* Returns true if the file page of SPTE_PTR has a frame, either its own or
+   one it could share from the frame table hash */
+static bool
+file_page_resident (struct spte *spte_ptr)
+{
+  return spte_ptr->fte_ptr != NULL ||
+         (spte_ptr->frame_type != EXECUTABLE_DATA &&
+          ft_find_frame (spte_ptr->inode_ptr, spte_ptr->offset) != NULL);
+}
+
+/* Returns the current thread's entry for UPAGE if it has one. Otherwise,
+   if UPAGE's region would give it a file page whose frame is resident in
+   the frame table hash, makes the entry and returns it. Returns NULL if
+   neither. */
+static struct spte *
+resident_entry (void *upage)
+{
+  struct spte *spte_ptr = spt_find_entry (thread_current ()->spt_ptr, upage);
+  if (spte_ptr != NULL)
+      return spte_ptr;
+
+  struct vma *vma_ptr = vma_find (upage);
+  if (vma_ptr == NULL || 
+      (vma_ptr->frame_type != EXECUTABLE_CODE && 
+       vma_ptr->frame_type != MMAP) ||
+      ft_find_frame (vma_ptr->inode_ptr, 
+                     vma_ptr->offset + (upage - vma_ptr->start)) == NULL)
+      return NULL;
+  return vma_get_entry (upage);
+}
+
+/* Gives the file page of SPTE_PTR, which has no frame, a new frame owned
+   by the current thread but not mapped, and queues it to be read by the
+   page in daemon. Returns false if there was no frame to spare, the thread
+   is at its hard limit, or there is no room in the daemon's queue. */
+static bool
+frame_page_in_async (struct spte *spte_ptr)
+{
+  if (!pagein_has_room () || !reclaim_has_spare () ||
+      !pff_has_room (thread_current (), 1))
+      return false;
+
+  uintptr_t frame_paddr = frame_alloc (PAL_USER);
+  if (frame_paddr == 0)
+      return false;
+
+  enum frame_type frame_type = spte_ptr->frame_type;
+  struct fte *fte_ptr = construct_fte (
+      (union Frame_location) { .frame_paddr = frame_paddr },
+      get_eviction_method (frame_type), spte_ptr->inode_ptr, 
+      spte_ptr->offset, spte_ptr->amount_occupied);
+  if (fte_ptr == NULL)
+    {
+      frame_free (frame_paddr);
+      return false;
+    }
+
+  if (!fte_add_owner (fte_ptr, thread_current (), spte_ptr->uaddr))
+    {
+      free (fte_ptr);
+      frame_free (frame_paddr);
+      return false;
+    }
+
+  if (frame_type != EXECUTABLE_DATA)
+      fte_ptr->shareable = hash_insert (&ft, &fte_ptr->hash_elem) == NULL;
   spte_ptr->fte_ptr = fte_ptr;
-  ASSERT (fte_ptr->pin_cnt > 0);
-  fte_ptr->pin_cnt--;
+  frame_attach (fte_ptr);
+  evict_frame_in (fte_ptr);
+
+  frame_begin_transit (fte_ptr, PAGING_IN);
+  pagein_submit (fte_ptr);
   return true;
+}
 
-  fail_add_pde:      pagedir_clear_page (thread_current ()->pagedir, upage);
-  fail_install_page: return false;
+/* Reads in a frame queued by ft_readahead, for the page in daemon. If the
+   read fails the frame is dropped, and its owner reads the page itself
+   when it faults on it. ft_lock must be held, and is released for the
+   read. */
+void
+ft_finish_readahead (struct fte *fte_ptr)
+{
+  ASSERT (fte_ptr->transit == PAGING_IN);
+  release_ft ();
+
+  void *frame_ptr = kmap (fte_ptr->loc.frame_paddr);
+  int amount_occupied = fte_ptr->amount_occupied;
+  bool success = read_from_inode (frame_ptr, fte_ptr->inode_ptr, 
+                                  fte_ptr->offset, amount_occupied)
+                 == amount_occupied;
+  if (success)
+      memset (frame_ptr + amount_occupied, 0, PGSIZE - amount_occupied);
+  kunmap (frame_ptr);
+
+  acquire_ft ();
+  frame_end_transit (fte_ptr);
+  if (!success)
+    {
+      frame_remove_owners (fte_ptr, true);
+      frame_delete (fte_ptr);
+    }
+}
+
+/* Maps the page of SPTE_PTR, which must read as zeros and have no frame,
+   read only to the shared zero frame in the current thread. A write to
+   it faults, and ft_unmap_zero_page makes way for a frame of its own.
+   Returns false if the mapping could not be made. */
+bool
+ft_map_zero_page (struct spte *spte_ptr)
+{
+  ASSERT (spte_ptr->fte_ptr == NULL && !spte_ptr->zero_mapped);
+  if (!install_frame (spte_ptr->uaddr, zero_paddr, false))
+      return false;
+  spte_ptr->zero_mapped = true;
+  return true;
+}
+
+/* Removes the current thread's mapping of SPTE_PTR's page to the zero
+   frame */
+void
+ft_unmap_zero_page (struct spte *spte_ptr)
+{
+  ASSERT (spte_ptr->zero_mapped);
+  pagedir_clear_page (thread_current ()->pagedir, spte_ptr->uaddr);
+  spte_ptr->zero_mapped = false;
 }
 
 /* Obtains a user pool page and constructs a pinned frame table entry
-   to go with it. Returns NULL if either failed.
+   to go with it. Returns NULL if either failed. If FAULT_PTR is not null
+   it is set to how the page was found, for vmstat.
    Returned frames must be unpinned after they have been installed to a page
    table */
 struct fte *
-ft_get_frame (struct spte *spte_ptr)
+ft_get_frame (struct spte *spte_ptr, enum vmstat_fault *fault_ptr)
 {
+  /* A thread at its hard limit makes way by evicting a frame of its own,
+     which may release ft_lock. If none of them can go, as they are all
+     pinned or shared, it is let over the limit rather than failing. */
+  struct thread *t_ptr = thread_current ();
+  if (!pff_has_room (t_ptr, 1))
+      evict_own (t_ptr);
+
   switch (spte_ptr->frame_type)
   {
     case EXECUTABLE_DATA: debugf("Getting EXECUTABLE_DATA page. \n"); break;
@@ -192,110 +612,404 @@ ft_get_frame (struct spte *spte_ptr)
   off_t offset               = spte_ptr->offset;
   int amount_occupied        = spte_ptr->amount_occupied;
   
-  // TODO: Remove free index return value from eviction
-  // TODO: Use palloc get page here
-
-  /* Set the fte_ptr to what the SPT entry refers to, null if no frame yet. */
-  struct fte *fte_ptr = spte_ptr->fte_ptr;
-
-  /* If this failed look for a shared frame. */
-  if ((fte_ptr == NULL) &&
-      (frame_type == EXECUTABLE_CODE || frame_type == MMAP))
-      fte_ptr = ft_find_frame (inode_ptr, offset);
+  struct fte *fte_ptr;
+  enum vmstat_fault fault = VMSTAT_FAULT_MINOR;
+
+  /* Set the fte_ptr to what the SPT entry refers to, null if no frame yet,
+     and if this failed look for a shared frame. If the frame is being paged
+     in or out, wait for that to finish; it may be gone by then, so look 
+     again. */
+ look_up:
+  for (;;)
+    {
+      fte_ptr = spte_ptr->fte_ptr;
+      if ((fte_ptr == NULL) &&
+          (frame_type == EXECUTABLE_CODE || frame_type == MMAP))
+          fte_ptr = ft_find_frame (inode_ptr, offset);
+
+      if (fte_ptr == NULL || fte_ptr->transit == FRAME_STABLE)
+          break;
+      vmstat_count_pin_wait ();
+      cond_wait (&fte_ptr->transit_done, &ft_lock);
+    }
 
   /* If we found a frame, bring it in from swap if necessary. */
   if (fte_ptr != NULL)
     {
-      debugf("Swapping back in. \n");
-
-      if (fte_ptr->swapped) 
+      if (fte_ptr->swapped)
         {
-          evict ();
-          // TODO: Check if there is free space
-          swap_in (fte_ptr, palloc_get_page (PAL_USER));
+          if (!frame_swap_in (fte_ptr))
+              return NULL;
+          fault = VMSTAT_FAULT_SWAP;
+        }
+      if (ft_frame (fte_ptr)->readahead)
+        {
+          ft_frame (fte_ptr)->readahead = false;
+          swap_count_readahead (true);
         }
     }
   else
     {
-      /* Otherwise construct a new frame */
+      /* Otherwise construct a new frame, unless another process got
+         there first while eviction had ft_lock released */
+      bool raced = false;
       fte_ptr = construct_frame (frame_type, inode_ptr, offset, 
-          amount_occupied);
+          amount_occupied, &raced);
+      if (raced) goto look_up;
       if (fte_ptr == NULL) return NULL;
+      fault = frame_type == STACK || frame_type == ALL_ZERO 
+                  ? VMSTAT_FAULT_ZERO : VMSTAT_FAULT_FILE;
     }
 
   ASSERT (fte_ptr->pin_cnt >= 0);
   fte_ptr->pin_cnt++;
 
-  /* Associate the new frame location in the user pool with the fte */
-  int frame_index = index_from_frame_ptr (fte_ptr->loc.frame_ptr);
-  frame_index_arr[frame_index] = fte_ptr;
-
   /* Associate the supplemental page table entry with the frame */
   spte_ptr->fte_ptr = fte_ptr;
+  if (fault_ptr != NULL)
+      *fault_ptr = fault;
   return fte_ptr;
 }
 
-/* Obtains the index in the frame_index_arr from a frame_ptr */
+/* Returns the frame SPTE_PTR refers to once it is not being paged in or
+   out, or NULL if by then it has none. ft_lock must be held, and is 
+   released while waiting. */
+struct fte *
+ft_stable_frame (struct spte *spte_ptr)
+{
+  struct fte *fte_ptr;
+
+  while ((fte_ptr = spte_ptr->fte_ptr) != NULL && 
+         fte_ptr->transit != FRAME_STABLE)
+    {
+      vmstat_count_pin_wait ();
+      cond_wait (&fte_ptr->transit_done, &ft_lock);
+    }
+
+  return fte_ptr;
+}
+
+/* Marks a frame as undergoing I/O, pinning it so that it is not chosen for
+   eviction, before ft_lock is released for the I/O */
+static void
+frame_begin_transit (struct fte *fte_ptr, enum frame_transit transit)
+{
+  ASSERT (fte_ptr->transit == FRAME_STABLE);
+  fte_ptr->transit = transit;
+  fte_ptr->pin_cnt++;
+}
+
+/* Marks a frame's I/O as complete, with ft_lock held again, and wakes any
+   threads that were waiting for it */
+static void
+frame_end_transit (struct fte *fte_ptr)
+{
+  ASSERT (fte_ptr->transit != FRAME_STABLE);
+  fte_ptr->transit = FRAME_STABLE;
+  fte_ptr->pin_cnt--;
+  cond_broadcast (&fte_ptr->transit_done, &ft_lock);
+}
+
+/* Brings a swapped frame back into memory. Returns false if no frame could
+   be obtained for it. */
+static bool
+frame_swap_in (struct fte *fte_ptr)
+{
+  debugf("Swapping back in. \n");
+  frame_begin_transit (fte_ptr, PAGING_IN);
+
+  /* A page that was all zeros when it was swapped out has no slot, and
+     only needs a zeroed frame */
+  bool zero = fte_ptr->loc.swap_index == SWAP_ZERO;
+  uintptr_t frame_paddr = frame_alloc_evicting (zero ? PAL_USER | PAL_ZERO 
+                                                     : PAL_USER);
+  if (frame_paddr == 0)
+    {
+      frame_end_transit (fte_ptr);
+      return false;
+    }
+
+  bool kept = !zero && frame_read_swapped (fte_ptr, frame_paddr);
+
+  fte_ptr->swap_slot       = kept ? fte_ptr->loc.swap_index : -1;
+  fte_ptr->swapped         = false;
+  fte_ptr->loc.frame_paddr = frame_paddr;
+  frame_charge_owners (fte_ptr, 1);
+  frame_attach (fte_ptr);
+  evict_frame_in (fte_ptr);
+  frame_end_transit (fte_ptr);
+  return true;
+}
+
+/* Reads the page of FTE_PTR, which is paging in, from its slot into the
+   frame at FRAME_PADDR, along with any pages read ahead with it. Returns
+   true if the page kept its slot. ft_lock is released for the I/O. */
+static bool
+frame_read_swapped (struct fte *fte_ptr, uintptr_t frame_paddr)
+{
+  /* Pages in the slots that follow were most likely swapped out by the
+     same process just after this one, and so are read in with it. */
+  struct fte *ahead_ptrs[SWAP_READAHEAD];
+  uintptr_t ahead_paddrs[SWAP_READAHEAD];
+  int ahead_cnt = readahead_begin (fte_ptr, ahead_ptrs, ahead_paddrs);
+
+  /* The slots cannot be freed under us, as the owners wait for the transit
+     before removing themselves */
+  int swap_index = fte_ptr->loc.swap_index;
+  bool ahead_kept[SWAP_READAHEAD];
+  release_ft ();
+  bool kept = swap_in (swap_index, frame_paddr);
+  for (int i = 0; i < ahead_cnt; i++)
+      ahead_kept[i] = swap_in (ahead_ptrs[i]->loc.swap_index, 
+                               ahead_paddrs[i]);
+  acquire_ft ();
+
+  /* Pages keep the slot they were read from if swap_in let them, so they
+     need no write if evicted again while clean */
+  for (int i = 0; i < ahead_cnt; i++)
+    {
+      struct fte *ahead_ptr = ahead_ptrs[i];
+      ahead_ptr->swap_slot       = ahead_kept[i] ? ahead_ptr->loc.swap_index 
+                                                 : -1;
+      ahead_ptr->swapped         = false;
+      ahead_ptr->loc.frame_paddr = ahead_paddrs[i];
+      frame_charge_owners (ahead_ptr, 1);
+      frame_attach (ahead_ptr);
+      ft_frame (ahead_ptr)->readahead = true;
+      evict_frame_in (ahead_ptr);
+      frame_end_transit (ahead_ptr);
+      swap_count_readahead (false);
+    }
+  return kept;
+}
+
+/* Finds up to SWAP_READAHEAD swapped frames in the slots just after that
+   of FTE_PTR which belong to the same process, stopping at the first that
+   does not, and starts paging each of them in to a free frame. Nothing is
+   read ahead when frames are short, as that would only evict pages that
+   are in use for ones that may not be, nor beyond the process's hard
+   limit. Returns how many were found. */
+static int
+readahead_begin (struct fte *fte_ptr, struct fte **ahead_ptrs,
+                 uintptr_t *ahead_paddrs)
+{
+  if (fte_ptr->owners.cnt != 1)
+      return 0;
+
+  struct thread *t_ptr = rmap_owner (&fte_ptr->owners, 0)->owner_ptr;
+  int swap_index       = fte_ptr->loc.swap_index;
+  int ahead_cnt;
+
+  for (ahead_cnt = 0; ahead_cnt < SWAP_READAHEAD; ahead_cnt++)
+    {
+      int slot = swap_index + ahead_cnt + 1;
+      if ((size_t) slot >= swap_slot_cnt () || !reclaim_has_spare () ||
+          !pff_has_room (t_ptr, ahead_cnt + 2))
+          break;
+
+      struct fte *ahead_ptr = swap_slot_fte (slot);
+      if (ahead_ptr == NULL || !ahead_ptr->swapped || 
+          ahead_ptr->loc.swap_index != slot ||
+          ahead_ptr->transit != FRAME_STABLE || ahead_ptr->owners.cnt != 1 ||
+          rmap_owner (&ahead_ptr->owners, 0)->owner_ptr != t_ptr)
+          break;
+
+      uintptr_t frame_paddr = frame_alloc (PAL_USER);
+      if (frame_paddr == 0)
+          break;
+
+      frame_begin_transit (ahead_ptr, PAGING_IN);
+      ahead_ptrs[ahead_cnt]   = ahead_ptr;
+      ahead_paddrs[ahead_cnt] = frame_paddr;
+    }
+
+  return ahead_cnt;
+}
+
+/* Chooses the swap slot a frame is written to, from the cluster of its 
+   owner if it has just one, and records the frame as its occupant. 
+   Returns -1 if swap is full. */
 static int
-index_from_frame_ptr (void *frame_ptr)
+frame_swap_slot (struct fte *fte_ptr)
+{
+  struct thread *t_ptr = fte_ptr->owners.cnt == 1 
+                             ? rmap_owner (&fte_ptr->owners, 0)->owner_ptr
+                             : NULL;
+  int swap_index = t_ptr != NULL
+                       ? swap_alloc_clustered (&t_ptr->swap_cluster_next,
+                                               &t_ptr->swap_cluster_end)
+                       : swap_reserve ();
+  if (swap_index >= 0)
+      swap_set_slot_fte (swap_index, fte_ptr);
+  return swap_index;
+}
+
+/* Obtains the index in frame_arr from a frame address. High memory frames
+   come after those of the page pool. */
+static int
+index_from_frame (uintptr_t frame_paddr)
+{
+  if (is_highmem_paddr (frame_paddr))
+      return lowmem_frame_cnt + highmem_page_no (frame_paddr);
+  return (ptov (frame_paddr) - user_pool_bottom) / PGSIZE;
+}
+
+/* Returns the descriptor of the frame holding FTE_PTR's page, which must
+   be resident */
+struct frame *
+ft_frame (struct fte *fte_ptr)
+{
+  ASSERT (!fte_ptr->swapped);
+  return &frame_arr[index_from_frame (fte_ptr->loc.frame_paddr)];
+}
+
+/* Records that FTE_PTR's page has just been put in the frame it names,
+   starting its descriptor afresh */
+static void
+frame_attach (struct fte *fte_ptr)
+{
+  struct frame *frame_ptr = ft_frame (fte_ptr);
+  ASSERT (frame_ptr->fte_ptr == NULL);
+  *frame_ptr = (struct frame) { .fte_ptr = fte_ptr };
+}
+
+/* Records that the frame at FRAME_PADDR no longer holds a page. The
+   replacement policy must have let go of it already. */
+static void
+frame_detach (uintptr_t frame_paddr)
+{
+  struct frame *frame_ptr = &frame_arr[index_from_frame (frame_paddr)];
+  ASSERT (frame_ptr->policy_list == 0);
+  *frame_ptr = (struct frame) { .fte_ptr = NULL };
+}
+
+/* Obtains a physical frame for a user page, preferring high memory so
+   that the direct map is left to the kernel. Returns 0 if there is none
+   free, which is never a valid frame as the page pool starts at 1 MB. 
+   Wakes the reclaim daemon if free frames are running low. */
+static uintptr_t
+frame_alloc (enum palloc_flags flags)
+{
+  uintptr_t frame_paddr = highmem_get_page (flags & PAL_ZERO);
+  if (frame_paddr == 0)
+    {
+      void *kpage = palloc_get_page (flags | PAL_USER);
+      frame_paddr = kpage != NULL ? vtop (kpage) : 0;
+    }
+
+  reclaim_poke ();
+  return frame_paddr;
+}
+
+/* Obtains a frame as frame_alloc does, evicting frames until one is free.
+   This is only needed when the reclaim daemon has fallen behind. Eviction
+   may release ft_lock for I/O. Returns 0 if there was nothing left to 
+   evict. */
+static uintptr_t
+frame_alloc_evicting (enum palloc_flags flags)
 {
-  return (frame_ptr - user_pool_bottom) / PGSIZE;
+  uintptr_t frame_paddr;
+
+  /* The page may be held by the kernel rather than by another user frame,
+     in which case eviction finds nothing and we fail. Another thread may
+     also take the frame we evicted while ft_lock was released. */
+  while ((frame_paddr = frame_alloc (flags)) == 0)
+      if (!reclaim_direct ())
+          break;
+
+  return frame_paddr;
 }
 
-/* Obtains the frame_ptr from an index used by the frame_index_arr */
-static void *
-frame_ptr_from_index (int frame_index)
+/* Releases a frame obtained from frame_alloc */
+static void
+frame_free (uintptr_t frame_paddr)
 {
-  return (frame_index * PGSIZE) + user_pool_bottom;
+  if (is_highmem_paddr (frame_paddr))
+      highmem_free_page (frame_paddr);
+  else
+      palloc_free_page (ptov (frame_paddr));
 }
 
+/* Constructs a frame for a page that has none yet, reading it in if it
+   is backed by a file. Returns NULL on failure. If eviction released
+   ft_lock and another process brought in the same shareable page 
+   meanwhile, sets *RACED_PTR and returns NULL, so the caller looks the
+   page up again and shares that frame instead. */
 struct fte *
 construct_frame (enum frame_type frame_type, 
                  struct inode *inode_ptr,
                  off_t offset, 
-                 int amount_occupied)
+                 int amount_occupied,
+                 bool *raced_ptr)
 {
-  enum palloc_flags flags = frame_type == STACK 
+  enum palloc_flags flags = frame_type == STACK || frame_type == ALL_ZERO
                                 ? PAL_USER | PAL_ZERO 
                                 : PAL_USER;
-  /* Gets a page from the user pool, zeroed if stack page */
-  void *frame_ptr = palloc_get_page (flags);
-  if (frame_ptr == NULL) 
+  /* Gets a user frame, zeroed if stack or zero page, which the idle
+     thread has usually done for us in advance for pool pages */
+  uintptr_t frame_paddr = frame_alloc_evicting (flags);
+  if (frame_paddr == 0) 
+      return NULL;
+
+  bool shareable = frame_type == EXECUTABLE_CODE || frame_type == MMAP;
+  if (shareable && ft_find_frame (inode_ptr, offset) != NULL)
     {
-      evict ();
-      frame_ptr = palloc_get_page (flags);
+      frame_free (frame_paddr);
+      *raced_ptr = true;
+      return NULL;
     }
 
   enum eviction_method eviction_method = get_eviction_method (frame_type);
 
-  /* Constructs a pinned frame (unpinned when installed in page table) */
+  /* Constructs a frame table entry, pinned by the caller until installed
+     in page table */
   struct fte *fte_ptr = construct_fte (
-      (union Frame_location) { .frame_ptr = frame_ptr }, eviction_method, 
+      (union Frame_location) { .frame_paddr = frame_paddr }, eviction_method, 
       inode_ptr, offset, amount_occupied);
 
-  
   if (fte_ptr == NULL) 
-      goto fail;
-  
-  /* Read in the necessary data from the filesystem if frame type requires */
-  if (frame_type == EXECUTABLE_CODE  || 
-      frame_type == EXECUTABLE_DATA  ||
-      frame_type == MMAP)
     {
-      if (read_from_inode (frame_ptr, inode_ptr, offset, amount_occupied) 
-              != amount_occupied)
-          goto fail;
+      frame_free (frame_paddr);
+      return NULL;
+    }
+
+  /* Frames that other processes may share go in the hash, which has
+     had no entry for this page since the check above */
+  if (shareable)
+    {
+      fte_ptr->shareable = true;
+      hash_insert (&ft, &fte_ptr->hash_elem);
     }
+  frame_attach (fte_ptr);
+  evict_frame_in (fte_ptr);
+
+  if (frame_type != EXECUTABLE_CODE  && 
+      frame_type != EXECUTABLE_DATA  &&
+      frame_type != MMAP)
+      return fte_ptr;
+  
+  /* Read in the necessary data from the filesystem, with the frame table
+     unlocked. Threads sharing the frame wait for us through the hash. */
+  frame_begin_transit (fte_ptr, PAGING_IN);
+  release_ft ();
+
+  void *frame_ptr = kmap (frame_paddr);
+  bool success = read_from_inode (frame_ptr, inode_ptr, offset, 
+                                  amount_occupied) == amount_occupied;
 
   /* Zero pad the remaining bits */
-  memset (frame_ptr + amount_occupied, 0, PGSIZE - amount_occupied);
+  if (success)
+      memset (frame_ptr + amount_occupied, 0, PGSIZE - amount_occupied);
+  kunmap (frame_ptr);
 
-  /* Coarse grained insertion to the frame / swap table */
-  fte_insert (fte_ptr);
+  acquire_ft ();
+  frame_end_transit (fte_ptr);
+  if (!success)
+    {
+      frame_delete (fte_ptr);
+      return NULL;
+    }
   return fte_ptr;
-
-  fail: palloc_free_page (frame_ptr);
-        return NULL;
 }
 
 static struct fte *
@@ -311,61 +1025,99 @@ ft_find_frame (struct inode *inode_ptr, off_t offset)
   return hash_entry (e_ptr, struct fte, hash_elem);
 }
 
-/* Add a PDE to a frame table entry that was previously being shared 
-   Return false on any allocation failure */
+/* Adds the given thread's mapping of upage to the owners of a frame, if it
+   is not one already, making the frame shared if it had an owner. Returns
+   false on any allocation failure */
 static bool
-fte_add_owner_shared (struct fte *fte_ptr, struct thread *t_ptr, void *upage)
+fte_add_owner (struct fte *fte_ptr, struct thread *t_ptr, void *upage)
 {
-  /* Add the pde to the existing list of pdes on the fte */
-  struct owner_list_elem *e_ptr = malloc (sizeof (struct owner_list_elem));
-  if (e_ptr == NULL) return false;
-  e_ptr->owner = (struct owner) { t_ptr, upage };
-  list_push_front (fte_ptr->owners.owner_list_ptr, &e_ptr->elem);
+  /* Swapped frames keep their owners, so coming back in from swap we
+     may already be one */
+  if (fte_has_owner (fte_ptr, t_ptr, upage))
+      return true;
+
+  /* Makes the page table for upage if there is none yet, so that the
+     entry can be kept with the owner */
+  uint32_t *pte_ptr = lookup_page (t_ptr->pagedir, upage, true);
+  if (pte_ptr == NULL ||
+      !rmap_add (&fte_ptr->owners, (struct owner) { t_ptr, upage, pte_ptr }))
+      return false;
+
+  /* Swapped frames are charged to their owners when they come back in */
+  if (!fte_ptr->swapped)
+      pff_charge (t_ptr, 1);
   return true;
 }
 
-/* Add a PDE to a frame table entry that was not previously being shared 
-   Return false on any allocation failure*/
+/* Returns true if the given thread maps upage to the frame */
 static bool
-fte_add_owner_newly_shared (struct fte *fte_ptr, 
-                            struct thread *t_ptr, 
-                            void *upage)
-{
-  /* Allocate a new list for storage of multiple owners that 
-     reference the frame */
-  struct list *owner_list_ptr = malloc (sizeof (struct list));
-  if (owner_list_ptr == NULL) 
-      goto fail_1;
-  list_init (owner_list_ptr);
-
-  /* Set up two new owner_list_elems, one for the old owner and one
-     for the one we are adding to the referencers of the frame*/
-  struct owner_list_elem *owner_initial_elem_ptr 
-      = malloc (sizeof (struct owner_list_elem));
-  if (owner_initial_elem_ptr == NULL)
-      goto fail_2;
-
-  struct owner_list_elem *owner_new_elem_ptr 
-      = malloc (sizeof (struct owner_list_elem));
-  if (owner_new_elem_ptr == NULL)
-      goto fail_3;
+fte_has_owner (struct fte *fte_ptr, struct thread *t_ptr, void *upage)
+{
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
+    {
+      struct owner *owner_ptr = rmap_owner (&fte_ptr->owners, i);
+      if (owner_ptr->owner_ptr == t_ptr && owner_ptr->upage_ptr == upage)
+          return true;
+    }
+  return false;
+}
 
-  owner_initial_elem_ptr->owner = fte_ptr->owners.owner_single;
-  owner_new_elem_ptr->owner     = (struct owner) { t_ptr, upage };
+/* Returns the Ith owner in the reverse map */
+struct owner *
+rmap_owner (struct rmap *rmap_ptr, int i)
+{
+  ASSERT (i >= 0 && i < rmap_ptr->cnt);
+  return i < RMAP_INLINE ? &rmap_ptr->inline_owners[i]
+                         : &rmap_ptr->spill_ptr[i - RMAP_INLINE];
+}
 
-  list_push_front (fte_ptr->owners.owner_list_ptr, 
-                   &owner_initial_elem_ptr->elem);
-  list_push_front (fte_ptr->owners.owner_list_ptr, 
-                   &owner_new_elem_ptr->elem);
+/* Adds an owner to the reverse map, spilling past the inline owners to
+   an array. Returns false on allocation failure. */
+static bool
+rmap_add (struct rmap *rmap_ptr, struct owner owner)
+{
+  int spill_cnt = rmap_ptr->cnt - RMAP_INLINE;
+  if (spill_cnt >= rmap_ptr->spill_capacity)
+    {
+      if (rmap_ptr->spill_capacity == UINT16_MAX)
+          return false;
+      int capacity = rmap_ptr->spill_capacity == 0 
+                         ? RMAP_INLINE : rmap_ptr->spill_capacity * 2;
+      if (capacity > UINT16_MAX)
+          capacity = UINT16_MAX;
+      struct owner *spill_ptr 
+          = realloc (rmap_ptr->spill_ptr, capacity * sizeof (struct owner));
+      if (spill_ptr == NULL)
+          return false;
+      rmap_ptr->spill_ptr      = spill_ptr;
+      rmap_ptr->spill_capacity = capacity;
+    }
 
-  /* If all was successful, associate the frame with the newly created
-     list of owners */
-  fte_ptr->owners.owner_list_ptr = owner_list_ptr;
+  rmap_ptr->cnt++;
+  *rmap_owner (rmap_ptr, rmap_ptr->cnt - 1) = owner;
   return true;
+}
 
-  fail_3: free (owner_initial_elem_ptr);
-  fail_2: free (owner_list_ptr);
-  fail_1: return false;
+/* Removes the Ith owner from the reverse map, moving the last owner into
+   its place, and frees the spill array once it is empty */
+static void
+rmap_remove_at (struct rmap *rmap_ptr, int i)
+{
+  *rmap_owner (rmap_ptr, i) = *rmap_owner (rmap_ptr, rmap_ptr->cnt - 1);
+  if (--rmap_ptr->cnt <= RMAP_INLINE && rmap_ptr->spill_ptr != NULL)
+    {
+      free (rmap_ptr->spill_ptr);
+      rmap_ptr->spill_ptr      = NULL;
+      rmap_ptr->spill_capacity = 0;
+    }
+}
+
+/* Removes every owner from the reverse map */
+static void
+rmap_clear (struct rmap *rmap_ptr)
+{
+  free (rmap_ptr->spill_ptr);
+  *rmap_ptr = (struct rmap) { .cnt = 0 };
 }
 
 /* Locks the filesystem whilst reading bytes_to_read bytes from the inode 
@@ -408,104 +1160,92 @@ get_eviction_method (enum frame_type frame_type)
       case     EXECUTABLE_DATA: return SWAP_IF_DIRTY;
       case     MMAP:            return WRITE_IF_DIRTY;
       case     EXECUTABLE_CODE: return DELETE;
-      case     ALL_ZERO:        return DELETE;
+      case     ALL_ZERO:        return SWAP_IF_DIRTY;
       default: NOT_REACHED ();
     }
 }
 
-/* Remove a single owner from an FTE, converting the FTE to non-shared if
-   necessary. Remove the referencing page table entry. Then return the 
-   owner. */
-struct owner 
-ft_remove_owner (struct fte *fte_ptr)
+/* Returns true if the page of SPTE_PTR is read from a file */
+static bool
+is_file_backed (const struct spte *spte_ptr)
 {
-  struct owner owner;
-  if (fte_ptr->shared) 
-    {
-      /* loop through the list of owners in the fte until the 
-         list entry correspoding to the current thread is found
-         and then call list_remove on this element and save the 
-         owner to owner */
-      struct list *owner_list_ptr = fte_ptr->owners.owner_list_ptr;
-      struct thread *t_ptr = thread_current ();
-      for (struct list_elem *e = list_begin (owner_list_ptr); 
-            e != list_end (owner_list_ptr);
-            e  = list_next (e))
-        {
-          struct owner_list_elem *owner_e_ptr 
-              = list_entry (e, struct owner_list_elem, elem);
-          owner = owner_e_ptr->owner;
-
-          if (owner.owner_ptr == t_ptr)
-            {
-              list_remove (e);
-              free (owner_e_ptr);
-              break;
-            }
-        }
-
-      frame_remove_pte (owner);
+  return spte_ptr->frame_type == EXECUTABLE_CODE ||
+         spte_ptr->frame_type == EXECUTABLE_DATA ||
+         spte_ptr->frame_type == MMAP;
+}
 
-      /* If the owner list became a singleton, convert the FTE to non shared */
-      if (list_front (owner_list_ptr) == list_back (owner_list_ptr))
-          convert_fte_to_non_shared (fte_ptr);
-    } 
-  else 
-    {
-      /* Non-shared case: remove the page table entry and NULL the owner */
-      owner = fte_ptr->owners.owner_single;
-      frame_remove_pte (owner);
-      fte_ptr->owners.owner_single = (struct owner) { NULL, NULL };
-    }
-  return owner;
+/* Returns true if the page of SPTE_PTR is read from the page of the same
+   file, in the same way, just after that of PREV_PTR */
+static bool
+spte_follows (const struct spte *spte_ptr, const struct spte *prev_ptr)
+{
+  return spte_ptr->frame_type == prev_ptr->frame_type &&
+         spte_ptr->inode_ptr  == prev_ptr->inode_ptr &&
+         spte_ptr->offset     == prev_ptr->offset + PGSIZE;
 }
 
-/* Converts a shared frame table entry to a non-shared entry
-   in the case that it's owner list becomes a singleton after owner removal */
-static void
-convert_fte_to_non_shared (struct fte *fte_ptr)
+/* Remove the current thread's mapping of UPAGE from the owners of an FTE,
+   and the page table entry it maps the frame with. A thread may map the
+   same frame at more than one page, so both must match. Nothing is done
+   if the mapping is not an owner, as when installing the frame failed. */
+void
+ft_remove_owner (struct fte *fte_ptr, void *upage)
 {
-  struct list *owner_list_ptr = fte_ptr->owners.owner_list_ptr;
+  struct thread *t_ptr = thread_current ();
+  int i;
 
-  /* Defensive assertions */
-  ASSERT (fte_ptr->shared);
-  ASSERT (list_front (owner_list_ptr) == list_back (owner_list_ptr));
+  for (i = 0; i < fte_ptr->owners.cnt; i++)
+    {
+      struct owner *owner_ptr = rmap_owner (&fte_ptr->owners, i);
+      if (owner_ptr->owner_ptr == t_ptr && owner_ptr->upage_ptr == upage)
+          break;
+    }
+  if (i == fte_ptr->owners.cnt)
+      return;
 
-  struct owner_list_elem *owner_e_ptr 
-      = list_entry (list_front (owner_list_ptr), 
-                    struct owner_list_elem, 
-                    elem);
-  
-  struct owner new_owner = owner_e_ptr->owner;
-  
-  free (owner_e_ptr);
-  free (owner_list_ptr);
-  
-  fte_ptr->shared              = false;
-  fte_ptr->owners.owner_single = new_owner;
+  struct owner owner = *rmap_owner (&fte_ptr->owners, i);
+  rmap_remove_at (&fte_ptr->owners, i);
+  if (!fte_ptr->swapped)
+      pff_charge (owner.owner_ptr, -1);
+
+  /* Remember writes made through this mapping for the write back */
+  if (pagedir_pte_clear (owner.owner_ptr->pagedir, owner.pte_ptr, 
+                         owner.upage_ptr, PTE_P | PTE_D) & PTE_D)
+      fte_ptr->dirty = true;
 }
 
 /* Remove a frame if the last owner was removed. In the swapped case
-   remove the entry from the swap bitmap with swap_remove, in the 
-   non-swapped case write back if the frame is dirty. */
+   free its swap slot, in the non-swapped case write back if the frame is
+   dirty. The frame must be stable, see ft_stable_frame. */
 void 
-ft_remove_frame_if_necessary (struct fte *fte_ptr, struct owner original_owner)
+ft_remove_frame_if_necessary (struct fte *fte_ptr)
 {
+  ASSERT (fte_ptr->transit == FRAME_STABLE);
+
   /* if the last owner removed was not the last owner
      we dont need to do anything */
-  if (fte_ptr->shared || fte_ptr->owners.owner_single.owner_ptr != NULL) 
+  if (fte_ptr->owners.cnt > 0) 
       return;
 
-  /* Otherwise we just removed the last owner. */
+  /* Otherwise we just removed the last owner. A swapped frame only has its
+     slot and entry left to free. */
   if (fte_ptr->swapped) 
-			swap_remove (fte_ptr);
-  else if (fte_ptr->eviction_method == WRITE_IF_DIRTY && 
-           pagedir_is_dirty (original_owner.owner_ptr->pagedir,
-                             original_owner.upage_ptr)) 
+    {
+      if (fte_ptr->loc.swap_index != SWAP_ZERO)
+          swap_release (fte_ptr->loc.swap_index);
+      evict_frame_forget (fte_ptr);
+      if (fte_ptr->shareable)
+          hash_delete (&ft, &fte_ptr->hash_elem);
+      free (fte_ptr);
+      return;
+    }
+
+  /* The ft_lock is released during the write, but with no owners left and
+     the frame in transit nobody else will touch it. If the write fails
+     there is nobody left to tell. */
+  if (fte_ptr->eviction_method == WRITE_IF_DIRTY && fte_ptr->dirty) 
       frame_write (fte_ptr);
 
-  /* NULL the slot in the frame_index_arr that the frame occupied */
-  frame_index_arr[index_from_frame_ptr(fte_ptr->loc.frame_ptr)] = NULL;
   frame_delete (fte_ptr);
 }
 
@@ -522,28 +1262,44 @@ construct_fte (union Frame_location loc,
   if (fte_ptr == NULL) return NULL;
 
   fte_ptr->swapped             = false;
-  fte_ptr->shared              = false;
+  fte_ptr->shareable           = false;
+  fte_ptr->dirty               = false;
+  fte_ptr->cow                 = false;
   fte_ptr->pin_cnt             = 0;
-  fte_ptr->owners.owner_single = (struct owner) { NULL, NULL };
+  fte_ptr->transit             = FRAME_STABLE;
+  fte_ptr->owners              = (struct rmap) { .cnt = 0 };
   fte_ptr->loc                 = loc;
+  fte_ptr->swap_slot           = -1;
   fte_ptr->inode_ptr           = inode_ptr;
   fte_ptr->offset              = offset;
   fte_ptr->eviction_method     = eviction_method;
   fte_ptr->amount_occupied     = amount_occupied;
+  cond_init (&fte_ptr->transit_done);
     
   return fte_ptr;
 }
 
-/* Attempt to write a frames contents to the filesystem, exit the process
-   on failure to avoid undefined behaviour in the program whose memory 
-   has been lost. */
-void
+/* Attempt to write a frames contents to the filesystem, returning false
+   if it could not all be written, in which case the frame stays dirty.
+   The write is done with ft_lock released. */
+bool
 frame_write (struct fte *fte_ptr)
 {
   ASSERT (!fte_ptr->swapped);
-  if (write_to_inode (fte_ptr->loc.frame_ptr, fte_ptr->inode_ptr,
-      fte_ptr->offset, fte_ptr->amount_occupied) != fte_ptr->amount_occupied)
-      syscall_exit (-1);
+  frame_begin_transit (fte_ptr, PAGING_OUT);
+  release_ft ();
+
+  void *frame_ptr = kmap (fte_ptr->loc.frame_paddr);
+  off_t written = write_to_inode (frame_ptr, fte_ptr->inode_ptr,
+                                  fte_ptr->offset, fte_ptr->amount_occupied);
+  kunmap (frame_ptr);
+
+  acquire_ft ();
+  frame_end_transit (fte_ptr);
+  if (written != fte_ptr->amount_occupied)
+      return false;
+  fte_ptr->dirty = false;
+  return true;
 }
 
 /* Deletes a frame and frees the associated frame table entry */
@@ -552,73 +1308,147 @@ frame_delete (struct fte *fte_ptr)
 {
   /* Free the page in memory and the frame table entry */
   ASSERT (!fte_ptr->swapped);
-  palloc_free_page (fte_ptr->loc.frame_ptr);
-  hash_delete (&ft, &fte_ptr->hash_elem);
+  ASSERT (fte_ptr->transit == FRAME_STABLE);
+  evict_frame_out (fte_ptr);
+  frame_detach (fte_ptr->loc.frame_paddr);
+  frame_free (fte_ptr->loc.frame_paddr);
+  if (fte_ptr->swap_slot >= 0)
+      swap_release (fte_ptr->swap_slot);
+  if (fte_ptr->shareable)
+      hash_delete (&ft, &fte_ptr->hash_elem);
   free (fte_ptr);
 }
 
-/* Swaps a into the swap partition and frees the page in memory */
+/* Swaps a frame into the swap partition and frees the page in memory. The
+   owners keep their reference to the entry, but their mappings are removed
+   first so nothing changes the page while ft_lock is released for the
+   write. If they fault on it they wait for the write to finish and then
+   swap it back in. A frame swapped in or laundered by frame_launder, and
+   not dirtied since, is already in the swap slot it kept, and needs no
+   write at all. Once dirtied, the copy in that slot is stale and the slot
+   is given up for a new one. */
 void
 frame_swap (struct fte *fte_ptr)
 {
-  void *frame_ptr = fte_ptr->loc.frame_ptr;
-  swap_out (fte_ptr);
-  palloc_free_page (frame_ptr);
-}
+  uintptr_t frame_paddr = fte_ptr->loc.frame_paddr;
+  int swap_index        = fte_ptr->swap_slot;
+  bool dirty            = frame_dirty (fte_ptr);
 
-bool
-frame_dirty (struct fte *fte_ptr)
-{
-  if (fte_ptr->shared)
+  evict_frame_out (fte_ptr);
+  frame_clear_ptes (fte_ptr);
+  if (swap_index >= 0 && dirty)
     {
-      struct list *owner_list_ptr = fte_ptr->owners.owner_list_ptr;
+      swap_release (swap_index);
+      fte_ptr->swap_slot = swap_index = -1;
+    }
 
-      for (struct list_elem *e = list_begin (owner_list_ptr); 
-           e != list_end (owner_list_ptr);
-           e  = list_next (e))
-        {
-          struct owner owner 
-              = list_entry (e, struct owner_list_elem, elem)->owner;
-          if (pagedir_is_dirty (owner.owner_ptr->pagedir, 
-                                owner.upage_ptr))
-              return true;
-        }
+  if (swap_index >= 0)
+      swap_count_write_avoided ();
+  else if (swap_page_is_zero (frame_paddr))
+    {
+      /* Pages of zeros are recorded as such, without a slot or any I/O */
+      swap_index = SWAP_ZERO;
+      swap_count_zero ();
     }
   else
     {
-      struct owner owner = fte_ptr->owners.owner_single;
-      return pagedir_is_dirty (owner.owner_ptr->pagedir,
-                               owner.upage_ptr);
+      if ((swap_index = frame_swap_slot (fte_ptr)) < 0)
+          PANIC ("No swap space available");
+      frame_begin_transit (fte_ptr, PAGING_OUT);
+      release_ft ();
+      swap_write (swap_index, frame_paddr);
+      acquire_ft ();
+      frame_end_transit (fte_ptr);
     }
 
-  return false;
+  /* From now on the page only lives in swap, whatever it was read from */
+  frame_charge_owners (fte_ptr, -1);
+  fte_ptr->swapped         = true;
+  fte_ptr->loc.swap_index  = swap_index;
+  fte_ptr->swap_slot       = -1;
+  fte_ptr->eviction_method = SWAP;
+  fte_ptr->dirty           = false;
+  frame_detach (frame_paddr);
+  frame_free (frame_paddr);
 }
 
-void
-frame_remove_owners (struct fte *fte_ptr, bool remove_spte_reference)
+/* Writes a dirty frame back while leaving it mapped, so that evicting it
+   later is as cheap as deleting it. File backed frames are written to
+   their file and anonymous ones to a swap slot the frame keeps. Owners'
+   dirty bits are cleared first, so a write made during the I/O marks the
+   frame dirty again. Returns false if nothing was written. ft_lock must
+   be held, and is released for the write. */
+bool
+frame_launder (struct fte *fte_ptr)
 {
-  if (fte_ptr->shared)
-    {
-      struct list *owner_list_ptr = fte_ptr->owners.owner_list_ptr;
+  ASSERT (!fte_ptr->swapped);
+  ASSERT (fte_ptr->transit == FRAME_STABLE);
 
-      for (struct list_elem *e = list_begin (owner_list_ptr); 
-           e != list_end (owner_list_ptr);
-           e  = list_next (e))
-        {
-          struct owner_list_elem *owner_e_ptr
-              = list_entry (e, struct owner_list_elem, elem);
-          frame_remove_owner (
-                owner_e_ptr->owner, 
-                remove_spte_reference);
-          list_remove (&owner_e_ptr->elem);
-        }
+  if (fte_ptr->eviction_method == DELETE)
+      return false;
+
+  if (fte_ptr->eviction_method == WRITE_IF_DIRTY)
+    {
+      frame_clean_ptes (fte_ptr);
+      if (frame_write (fte_ptr))
+          return true;
+      fte_ptr->dirty = true;
+      return false;
     }
-  else
+
+  int swap_index = fte_ptr->swap_slot;
+  if (swap_index < 0 && (swap_index = frame_swap_slot (fte_ptr)) < 0)
+      return false;
+
+  /* Set the slot first, so that the frame being freed meanwhile releases
+     it. Frames read from the executable now have to come back from swap. */
+  fte_ptr->swap_slot       = swap_index;
+  fte_ptr->eviction_method = SWAP;
+  frame_clean_ptes (fte_ptr);
+  frame_begin_transit (fte_ptr, PAGING_OUT);
+  release_ft ();
+  swap_write (swap_index, fte_ptr->loc.frame_paddr);
+  acquire_ft ();
+  frame_end_transit (fte_ptr);
+  return true;
+}
+
+/* Clears the dirty bits of all owners' page table entries, and forgets
+   writes made by owners that have gone */
+static void
+frame_clean_ptes (struct fte *fte_ptr)
+{
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
     {
-      frame_remove_owner (fte_ptr->owners.owner_single, 
-                          remove_spte_reference);
-      fte_ptr->owners.owner_single = (struct owner) { NULL, NULL };
+      struct owner *owner_ptr = rmap_owner (&fte_ptr->owners, i);
+      pagedir_pte_clear (owner_ptr->owner_ptr->pagedir, owner_ptr->pte_ptr,
+                         owner_ptr->upage_ptr, PTE_D);
     }
+
+  fte_ptr->dirty = false;
+}
+
+/* Returns true if an owner has written to the frame, or one that has
+   gone did */
+bool
+frame_dirty (struct fte *fte_ptr)
+{
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
+      if (*rmap_owner (&fte_ptr->owners, i)->pte_ptr & PTE_D)
+          return true;
+
+  return fte_ptr->dirty;
+}
+
+void
+frame_remove_owners (struct fte *fte_ptr, bool remove_spte_reference)
+{
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
+      frame_remove_owner (*rmap_owner (&fte_ptr->owners, i), 
+                          remove_spte_reference);
+  if (!fte_ptr->swapped)
+      frame_charge_owners (fte_ptr, -1);
+  rmap_clear (&fte_ptr->owners);
 }
 
 void
@@ -644,17 +1474,28 @@ void
 frame_remove_pte (struct owner owner)
 {
   /* Clear the page in the owners page directory */
-  pagedir_clear_page (owner.owner_ptr->pagedir, owner.upage_ptr);
+  pagedir_pte_clear (owner.owner_ptr->pagedir, owner.pte_ptr, 
+                     owner.upage_ptr, PTE_P);
 }
 
+/* Clears the page table entries of all owners, keeping them as owners */
+void
+frame_clear_ptes (struct fte *fte_ptr)
+{
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
+      frame_remove_pte (*rmap_owner (&fte_ptr->owners, i));
+}
 
-
+/* Adds DELTA to the resident set of each owner, as the frame comes into
+   or goes out of memory */
 static void
-fte_insert (struct fte *fte_ptr)
+frame_charge_owners (struct fte *fte_ptr, int delta)
 {
-  hash_insert (&ft, &fte_ptr->hash_elem);
+  for (int i = 0; i < fte_ptr->owners.cnt; i++)
+      pff_charge (rmap_owner (&fte_ptr->owners, i)->owner_ptr, delta);
 }
 
+
 static unsigned
 fte_hash_func (const struct hash_elem *e_ptr, void *aux UNUSED)
 {
@@ -667,8 +1508,11 @@ fte_less_func (const struct hash_elem *a_ptr,
                const struct hash_elem *b_ptr,
                void *aux UNUSED) 
 {
-  return hash_entry (a_ptr, struct fte, hash_elem)->loc.swap_index <
-         hash_entry (b_ptr, struct fte, hash_elem)->loc.swap_index;
+  const struct fte *a = hash_entry (a_ptr, struct fte, hash_elem);
+  const struct fte *b = hash_entry (b_ptr, struct fte, hash_elem);
+  if (a->inode_ptr != b->inode_ptr)
+      return a->inode_ptr < b->inode_ptr;
+  return a->offset < b->offset;
 }
 
 static void
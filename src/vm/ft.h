@@ -2,10 +2,12 @@
 #define VM_FT_H
 
 #include <hash.h>
+#include "threads/synch.h"
 #include "userprog/syscall.h"
 #include "vm/spt.h"
 
-/* Retrieval methods for frame table entries being evicted */
+/* Retrieval methods for frame table entries being evicted. Counted by
+   vmstat() in this order, see enum vmstat_evict. */
 enum eviction_method {
   DELETE,
   SWAP,
@@ -13,71 +15,117 @@ enum eviction_method {
   WRITE_IF_DIRTY
 };
 
-/* Uniquely references the thread and upage that reference a frame */
+/* Block I/O a frame is undergoing with ft_lock released. Frames in transit
+   are pinned, and anyone else who needs one waits on its transit_done until
+   it is FRAME_STABLE again. */
+enum frame_transit {
+  FRAME_STABLE,
+  PAGING_IN,
+  PAGING_OUT
+};
+
+/* Uniquely references the thread and upage that reference a frame, and
+   the page table entry mapping it there. Page tables are only freed with
+   their page directory, after the frame table has unmapped everything, so
+   the entry stays put for as long as the owner does. */
 struct owner
 {
   struct thread *owner_ptr;
   void *upage_ptr;
+  uint32_t *pte_ptr;
 };
 
-/* used to store a single owner when multiple processes own a frame */
-struct owner_list_elem
+/* Owners of a frame kept in its entry, before spilling to an array */
+#define RMAP_INLINE 2
+
+/* Reverse map of a frame to its owners. The first RMAP_INLINE are kept
+   inline, the rest in a malloc'd array that grows by doubling and is
+   freed once they fit inline again. */
+struct rmap
 {
-  struct owner owner;
-  struct list_elem elem;
+  uint16_t cnt;
+  uint16_t spill_capacity;
+  struct owner inline_owners[RMAP_INLINE];
+  struct owner *spill_ptr;
 };
 
-/* When swapped is false, use frame_ptr, otherwise use swap_index */
+/* When swapped is false, use frame_paddr, otherwise use swap_index.
+   Frames are named by physical address as they may be in high memory,
+   outside the kernel's direct map; use kmap () to access them. */
 union Frame_location
 {
-  void *frame_ptr;
+  uintptr_t frame_paddr;
   int swap_index;
 };
 
-/* When shared is false, use owner_single, otherwise use owner_list_ptr */
-union Owner
-{
-  struct owner owner_single;
-  struct list *owner_list_ptr;
-};
-
 /* Frame / swap table entry */
 struct fte 
 {
   bool swapped;
-  bool shared;
+  bool shareable;      /* In the frame table hash, found by inode/offset */
+  bool dirty;          /* Dirtied by an owner that has since gone */
+  bool cow;            /* Shared by fork, mapped read only until written */
   int pin_cnt;
+  enum frame_transit transit;
+  struct condition transit_done;
   struct inode *inode_ptr;
   off_t offset;
-  union Owner owners;
+  struct rmap owners;  /* Shared if it has more than one */
   union Frame_location loc;
+  int swap_slot;       /* Slot holding a clean copy while resident, or -1 */
   enum eviction_method eviction_method;
   int amount_occupied;
   struct hash_elem hash_elem;
 };
 
+/* Descriptor of a frame that user pages may live in, one for each page of
+   the page pool and of high memory, in frame_arr by frame number. Scans
+   over resident frames walk this dense array, and state only a resident
+   page has is kept here rather than in the fte, which stays the page's
+   identity while it is swapped out. */
+struct frame
+{
+  struct fte *fte_ptr;            /* Page held, NULL if free or the kernel's */
+  struct list_elem policy_elem;   /* In the replacement policy's lists */
+  uint8_t policy_list;            /* Which of them, 0 if none */
+  bool referenced;                /* Found accessed by evict_sample_access */
+  bool readahead;                 /* Read ahead from swap, not faulted on */
+};
+
 extern bool debug;
 
 bool         ft_init                      (void);
 void         ft_destroy                   (void);
-void         ft_remove_frame              (struct fte *fte_ptr);
-struct owner ft_remove_owner              (struct fte *fte_ptr);
-void         ft_remove_frame_if_necessary (struct fte *fte_ptr, 
-                                           struct owner original_owner);
-struct fte  *ft_get_frame                 (struct spte *spte_ptr);
-struct fte  *ft_get_frame_preemptive      (enum frame_type frame_type, 
-                                          struct inode *inode_ptr,
-                                          off_t offset,
-                                          int amount_occupied);
+void         ft_remove_owner              (struct fte *fte_ptr, void *upage);
+void         ft_remove_frame_if_necessary (struct fte *fte_ptr);
+struct fte  *ft_get_frame                 (struct spte *spte_ptr,
+                                           enum vmstat_fault *fault_ptr);
+struct fte  *ft_stable_frame              (struct spte *spte_ptr);
 bool         ft_install_frame             (struct spte *spte_ptr, 
                                            struct fte *fte_ptr);
+bool         ft_fork_frame                (struct thread *parent_ptr,
+                                           struct spte *spte_ptr,
+                                           struct spte *child_spte_ptr);
+bool         ft_break_cow                 (struct spte *spte_ptr,
+                                           bool left_pinned);
+int          ft_fault_around              (struct spte *spte_ptr);
+int          ft_readahead                 (struct spte *spte_ptr);
+void         ft_finish_readahead          (struct fte *fte_ptr);
+void         ft_drop_behind               (struct spte *spte_ptr);
+void         ft_madvise                   (struct spte *spte_ptr, int advice);
+bool         ft_map_zero_page             (struct spte *spte_ptr);
+void         ft_unmap_zero_page           (struct spte *spte_ptr);
 void         acquire_ft                   (void);
 void         release_ft                   (void);
 
-bool frame_dirty  (struct fte *fte_ptr);
-void frame_write  (struct fte *fte_ptr);
-void frame_delete (struct fte *fte_ptr);
-void frame_swap   (struct fte *fte_ptr);
+struct owner *rmap_owner (struct rmap *rmap_ptr, int i);
+struct frame *ft_frame   (struct fte *fte_ptr);
+
+bool frame_dirty   (struct fte *fte_ptr);
+bool frame_write   (struct fte *fte_ptr);
+void frame_delete  (struct fte *fte_ptr);
+void frame_swap    (struct fte *fte_ptr);
+bool frame_launder (struct fte *fte_ptr);
 
 void frame_remove_owner  (struct owner owner, 
                           bool remove_spte_reference);
@@ -86,7 +134,8 @@ void frame_remove_owners (struct fte *fte_ptr,
 
 void frame_remove_spte_reference (struct owner owner);
 void frame_remove_pte            (struct owner owner);
+void frame_clear_ptes            (struct fte *fte_ptr);
 
-extern struct fte** frame_index_arr;
-extern size_t       frame_index_size;
+extern struct frame *frame_arr;
+extern size_t        frame_cnt;
 #endif
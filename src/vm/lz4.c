@@ -0,0 +1,209 @@
+#include "vm/lz4.h"
+#include <debug.h>
+#include <string.h>
+
+/* Compression in the LZ4 block format, for pages going to the compressed
+   swap tier.
+
+   A block is a series of sequences, each a token byte followed by a run
+   of literal bytes and then a match: a 2 byte little endian offset back
+   into the output and a length. The token holds the literal length in
+   its top 4 bits and the match length less LZ4_MIN_MATCH in its bottom
+   4; a field of 15 continues in further bytes, each added to it, until
+   one is not 255. The last sequence has literals only.
+
+   The compressor is the simple greedy one: it hashes each 4 byte
+   sequence, looks up where that hash was last seen, and takes the match
+   if the bytes agree. Offsets are 16 bits, so inputs are at most 64 kB,
+   and as in LZ4 the last LZ4_LAST_LITERALS bytes are always literals. */
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_MF_LIMIT      12        /* No match starts this close to the end */
+#define LZ4_LAST_LITERALS 5
+#define LZ4_HASH_BITS     12
+#define LZ4_MAX_INPUT     65535
+
+static uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+static unsigned
+hash32 (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Writes LENGTH's continuation bytes, of a field that overflowed its 4
+   bits, at OP and returns the byte after them */
+static uint8_t *
+put_length (uint8_t *op, size_t length)
+{
+  for (length -= 15; length >= 255; length -= 255)
+      *op++ = 255;
+  *op++ = length;
+  return op;
+}
+
+/* Appends a sequence of LIT_SIZE literals from LIT followed by a match of
+   MATCH_SIZE bytes OFFSET back, or by no match if MATCH_SIZE is 0.
+   Returns the byte after it, or NULL if it would not fit before OEND. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *oend, const uint8_t *lit, 
+              size_t lit_size, size_t offset, size_t match_size)
+{
+  size_t need = 1 + lit_size + lit_size / 255 + 1;
+  if (match_size > 0)
+      need += 2 + match_size / 255 + 1;
+  if (need > (size_t) (oend - op))
+      return NULL;
+
+  size_t match_code = match_size > 0 ? match_size - LZ4_MIN_MATCH : 0;
+  uint8_t *token = op++;
+  *token = (lit_size < 15 ? lit_size : 15) << 4;
+  if (lit_size >= 15)
+      op = put_length (op, lit_size);
+  memcpy (op, lit, lit_size);
+  op += lit_size;
+
+  if (match_size > 0)
+    {
+      *token |= match_code < 15 ? match_code : 15;
+      *op++ = offset & 0xff;
+      *op++ = offset >> 8;
+      if (match_code >= 15)
+          op = put_length (op, match_code);
+    }
+  return op;
+}
+
+/* Compresses SRC_SIZE bytes from SRC into at most DST_CAP bytes at DST,
+   using WORK, of LZ4_WORK_SIZE bytes, as scratch space. Returns the
+   compressed size, or 0 if it would not fit in DST_CAP. */
+size_t
+lz4_compress (const void *src, size_t src_size, 
+              void *dst, size_t dst_cap, void *work)
+{
+  const uint8_t *base   = src;
+  const uint8_t *ip     = base;
+  const uint8_t *anchor = base;
+  const uint8_t *end    = base + src_size;
+  uint8_t *op           = dst;
+  uint8_t *oend         = op + dst_cap;
+  uint16_t *table       = work;
+
+  ASSERT (src_size <= LZ4_MAX_INPUT);
+  memset (table, 0, LZ4_WORK_SIZE);
+
+  if (src_size > LZ4_MF_LIMIT)
+    {
+      const uint8_t *mf_limit    = end - LZ4_MF_LIMIT;
+      const uint8_t *match_limit = end - LZ4_LAST_LITERALS;
+
+      for (ip++; ip < mf_limit; )
+        {
+          uint32_t seq       = read32 (ip);
+          unsigned h         = hash32 (seq);
+          const uint8_t *ref = base + table[h];
+          table[h] = ip - base;
+
+          if (read32 (ref) != seq || ref >= ip)
+            {
+              ip++;
+              continue;
+            }
+
+          /* Extend the match backwards over literals, then forwards */
+          while (ip > anchor && ref > base && ip[-1] == ref[-1])
+            {
+              ip--;
+              ref--;
+            }
+          const uint8_t *match_end = ip + LZ4_MIN_MATCH;
+          const uint8_t *ref_end   = ref + LZ4_MIN_MATCH;
+          while (match_end < match_limit && *match_end == *ref_end)
+            {
+              match_end++;
+              ref_end++;
+            }
+
+          op = put_sequence (op, oend, anchor, ip - anchor, ip - ref,
+                             match_end - ip);
+          if (op == NULL)
+              return 0;
+          ip = anchor = match_end;
+        }
+    }
+
+  op = put_sequence (op, oend, anchor, end - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - (uint8_t *) dst) : 0;
+}
+
+/* Decompresses the SRC_SIZE byte block at SRC into at most DST_CAP bytes
+   at DST. Returns the decompressed size, or -1 if the block is corrupt or
+   does not fit. */
+int
+lz4_decompress (const void *src, size_t src_size, void *dst, size_t dst_cap)
+{
+  const uint8_t *ip   = src;
+  const uint8_t *iend = ip + src_size;
+  uint8_t *op         = dst;
+  uint8_t *oend       = op + dst_cap;
+
+  while (ip < iend)
+    {
+      unsigned token = *ip++;
+      size_t size    = token >> 4;
+      uint8_t b;
+
+      if (size == 15)
+          do
+            {
+              if (ip >= iend)
+                  return -1;
+              b = *ip++;
+              size += b;
+            }
+          while (b == 255);
+      if (size > (size_t) (iend - ip) || size > (size_t) (oend - op))
+          return -1;
+      memcpy (op, ip, size);
+      op += size;
+      ip += size;
+
+      /* The last sequence has no match */
+      if (ip == iend)
+          break;
+
+      if (iend - ip < 2)
+          return -1;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - (uint8_t *) dst))
+          return -1;
+
+      size = token & 15;
+      if (size == 15)
+          do
+            {
+              if (ip >= iend)
+                  return -1;
+              b = *ip++;
+              size += b;
+            }
+          while (b == 255);
+      size += LZ4_MIN_MATCH;
+      if (size > (size_t) (oend - op))
+          return -1;
+
+      /* Byte by byte, as the match may overlap what it produces */
+      const uint8_t *ref = op - offset;
+      while (size-- > 0)
+          *op++ = *ref++;
+    }
+
+  return op - (uint8_t *) dst;
+}
@@ -0,0 +1,15 @@
+#ifndef VM_LZ4_H
+#define VM_LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes of scratch space lz4_compress needs */
+#define LZ4_WORK_SIZE (4096 * sizeof (uint16_t))
+
+size_t lz4_compress   (const void *src, size_t src_size, 
+                       void *dst, size_t dst_cap, void *work);
+int    lz4_decompress (const void *src, size_t src_size,
+                       void *dst, size_t dst_cap);
+
+#endif
@@ -1,53 +1,183 @@
+#include <round.h>
 #include "threads/malloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/exception.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "vm/mmap.h"
 #include "spt.h"
+#include "vm/vma.h"
 
 static struct mmape *mmap_locate_entry (struct list *list_ptr, mapid_t mid);
+static void          mmap_unmap_pages  (struct mmape *mmape_ptr);
+static void          mmap_populate     (void *uaddr, size_t page_cnt);
 
 void mmap_init (struct list *list_ptr)
 {
   list_init (list_ptr);
 }
 
+/* Maps LENGTH bytes of FILE_PTR from OFFSET, which must be page aligned, 
+   into the current thread at *UADDR_PTR, or wherever there is room below
+   the stack if it is NULL, in which case *UADDR_PTR is set to the address
+   chosen. A LENGTH of 0 maps the rest of the file. Pages past the end of
+   the file read as zeros and are not written back.
+
+   FLAGS holds exactly one of MAP_SHARED, whose writes go back to the file
+   and are seen by every process mapping it, and MAP_PRIVATE, whose pages
+   are read from the file and then belong to the process, copied on write
+   after a fork. MAP_ANONYMOUS maps zeroed memory, FILE_PTR being NULL,
+   and must be private. MAP_POPULATE faults every page in before returning.
+   Returns the new mapping's id, or MAP_FAILED. */
+mapid_t
+mmap_create (struct file *file_ptr,
+             void **uaddr_ptr,
+             off_t offset,
+             size_t length,
+             int flags)
+{
+  struct thread *t_ptr = thread_current ();
+  bool anonymous       = (flags & MAP_ANONYMOUS) != 0;
+  bool shared          = (flags & MAP_SHARED) != 0;
+
+  /* Fail on unknown flags, on anything but exactly one of shared or private,
+     on shared anonymous memory, or on a file given with MAP_ANONYMOUS */
+  if ((flags & ~(MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE)) ||
+      shared == ((flags & MAP_PRIVATE) != 0) ||
+      (anonymous && shared) ||
+      anonymous != (file_ptr == NULL) ||
+      offset < 0 || offset % PGSIZE != 0)
+      goto fail_1;
+
+  /* A file mapping of length 0 runs to the end of the file, and fails if
+     there is nothing there */
+  off_t filesize = 0;
+  if (!anonymous)
+    {
+      filesize = file_length (file_ptr);
+      if (length == 0 && offset < filesize)
+          length = filesize - offset;
+    }
+  if (length == 0 || length >= (uintptr_t) STACK_LIMIT)
+      goto fail_1;
+
+  /* Fail if the mapping would overflow into the stack, or overlap any
+     other region */
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  void *uaddr     = *uaddr_ptr;
+  if (uaddr == NULL)
+    {
+      uaddr = vma_find_free (STACK_LIMIT, page_cnt);
+      if (uaddr == NULL)
+          goto fail_1;
+    }
+  else if (uaddr != pg_round_down (uaddr) ||
+           (uintptr_t) uaddr + page_cnt * PGSIZE > (uintptr_t) STACK_LIMIT ||
+           !vma_range_free (uaddr, page_cnt))
+      goto fail_1;
+
+  /* The inode is kept open for the pages until the mapping is removed */
+  struct inode *inode_ptr = NULL;
+  if (!anonymous)
+    {
+      acquire_filesys ();
+      inode_ptr = inode_reopen (file_ptr->inode);
+      release_filesys ();
+    }
+
+  /* Add the mapping as a region, whose pages are given supplemental page
+     table entries as they are used */
+  enum frame_type frame_type = anonymous ? ALL_ZERO 
+                             : shared    ? MMAP 
+                                         : EXECUTABLE_DATA;
+  off_t read_bytes = filesize > offset ? filesize - offset : 0;
+  if ((size_t) read_bytes > page_cnt * PGSIZE)
+      read_bytes = page_cnt * PGSIZE;
+  if (!vma_add (uaddr, page_cnt, frame_type, inode_ptr, offset, read_bytes, 
+                true))
+      goto fail_2;
+
+  mapid_t mid = t_ptr->mid_cnt;
+  if (!mmap_add_entry (&t_ptr->mmap_list, mid, uaddr, length, inode_ptr))
+      goto fail_3;
+  t_ptr->mid_cnt++;
+
+  if (flags & MAP_POPULATE)
+      mmap_populate (uaddr, page_cnt);
+
+  *uaddr_ptr = uaddr;
+  return mid;
+
+fail_3: vma_remove (uaddr);
+fail_2: acquire_filesys ();
+        inode_close (inode_ptr);
+        release_filesys ();
+fail_1: return MAP_FAILED;
+}
+
 /* Allocates space for a new mmap entry, returns false if malloc fails */
 bool 
 mmap_add_entry (struct list *list_ptr, 
                 mapid_t mid, 
                 void *uaddr, 
-                size_t filesize)
+                size_t length,
+                struct inode *inode_ptr)
 {
   struct mmape *mmape_ptr = malloc (sizeof (struct mmape));
   if (mmape_ptr == NULL) return false;
 
   mmape_ptr->mid          = mid;
   mmape_ptr->uaddr        = uaddr;
-  mmape_ptr->filesize     = filesize;
+  mmape_ptr->length       = length;
+  mmape_ptr->inode_ptr    = inode_ptr;
   list_push_front (list_ptr, &mmape_ptr->list_elem);
 
   return true;
 }
 
-/* Locates and deletes an mmap entry in the current thread, returns NULL 
-   if not located and does not free the mmape_ptr. */
+/* Gives the current thread, a child forked from PARENT_PTR, the same mmap
+   entries as its parent, whose pages spt_fork shares. As with mmap, each
+   file mapping keeps its inode open. Returns false if malloc fails */
+bool
+mmap_fork (struct thread *parent_ptr)
+{
+  struct thread *t_ptr  = thread_current ();
+  struct list *list_ptr = &parent_ptr->mmap_list;
+
+  /* Entries are pushed to the front, so go backwards to keep their order */
+  for (struct list_elem *e = list_rbegin (list_ptr); e != list_rend (list_ptr);
+       e = list_prev (e))
+    {
+      struct mmape *mmape_ptr = list_entry (e, struct mmape, list_elem);
+      if (!mmap_add_entry (&t_ptr->mmap_list, mmape_ptr->mid, 
+                           mmape_ptr->uaddr, mmape_ptr->length, 
+                           mmape_ptr->inode_ptr))
+          return false;
+
+      acquire_filesys ();
+      inode_reopen (mmape_ptr->inode_ptr);
+      release_filesys ();
+    }
+
+  t_ptr->mid_cnt = parent_ptr->mid_cnt;
+  return true;
+}
+
+/* Locates and deletes an mmap entry in the current thread, doing nothing
+   if it is not located. */
 void
 mmap_remove_entry (mapid_t mid)
 {
-	struct thread *t_ptr  = thread_current ();
-	struct list *list_ptr = &t_ptr->mmap_list;
-
-  struct mmape *mmape_ptr = mmap_locate_entry (list_ptr, mid);
-/* If list mmap entry not found return. */
-	if (mmape_ptr == NULL) return;
-	
-	list_remove (&mmape_ptr->list_elem);
-	/* Remove all allocated spt entries associated with the mmapped file. */
-  void *loc = mmape_ptr->uaddr + mmape_ptr->filesize;
-  acquire_ft ();
-  while (loc >= mmape_ptr->uaddr) 
-      spt_propagate_removal (t_ptr->spt_ptr, loc = pg_round_down (--loc));
-  release_ft ();
+  struct thread *t_ptr  = thread_current ();
+  struct mmape *mmape_ptr = mmap_locate_entry (&t_ptr->mmap_list, mid);
+  if (mmape_ptr == NULL) return;
+
+  list_remove (&mmape_ptr->list_elem);
+  pagedir_batch_begin ();
+  mmap_unmap_pages (mmape_ptr);
+  pagedir_batch_end ();
   free (mmape_ptr);
 }
 
@@ -55,27 +185,51 @@ mmap_remove_entry (mapid_t mid)
    mmap entries. Called when a process is terminated. */
 void
 mmap_remove_all (struct list *list_ptr)
+{
+  pagedir_batch_begin ();
+  while (!list_empty (list_ptr))
+    {
+      struct mmape *mmape_ptr = list_entry (list_pop_front (list_ptr), 
+                                            struct mmape, list_elem);
+      mmap_unmap_pages (mmape_ptr);
+      free (mmape_ptr);
+    }
+  pagedir_batch_end ();
+}
+
+/* Removes a mapping's region and the spt entries of the pages of it that
+   were used from the current thread, writing back its dirty shared pages,
+   and then closes the mapping's inode */
+static void
+mmap_unmap_pages (struct mmape *mmape_ptr)
+{
+  struct thread *t_ptr = thread_current ();
+
+  vma_remove (mmape_ptr->uaddr);
+  acquire_ft ();
+  spt_remove_range (t_ptr->spt_ptr, mmape_ptr->uaddr, 
+                    DIV_ROUND_UP (mmape_ptr->length, PGSIZE));
+  release_ft ();
+
+  acquire_filesys ();
+  inode_close (mmape_ptr->inode_ptr);
+  release_filesys ();
+}
+
+/* Loads each of the PAGE_CNT pages from UADDR that is not yet mapped,
+   with page_populate. Stops at the first that cannot be loaded, such as
+   when frames run out, leaving the rest to be faulted in as usual. */
+static void
+mmap_populate (void *uaddr, size_t page_cnt)
 {
   struct thread *t_ptr = thread_current ();
-  /* loops through each mmap entry removing it from the list and freeing it
-     as well as calling spt_remove on each of its user addresses */
-	struct list_elem *e = list_begin (list_ptr);
-	struct list_elem *e_nxt;
-	while (e != list_end (list_ptr))
+
+  for (size_t i = 0; i < page_cnt; i++)
     {
-			e_nxt = list_next (e);
-      struct mmape *mmape_ptr = list_entry (e, struct mmape, list_elem);
-      /* Remove all allocated spt entries associated with the mmapped file. */
-			// TODO: remove this duplication of code (repeated in remove entry)
-      void *loc = mmape_ptr->uaddr + mmape_ptr->filesize;
-      acquire_ft ();
-      while (loc >= mmape_ptr->uaddr) 
-          spt_propagate_removal (t_ptr->spt_ptr, loc -= PGSIZE); 
-      release_ft ();
-
-			/* Deallocate the list entry. */
-			free (mmape_ptr);
-			e = e_nxt;
+      void *upage = uaddr + i * PGSIZE;
+      if (!pagedir_is_mapped (t_ptr->pagedir, upage) && 
+          !page_populate (upage))
+          break;
     }
 }
 
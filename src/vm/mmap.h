@@ -3,20 +3,33 @@
 
 #include <list.h>
 #include "lib/user/syscall.h"
+#include "filesys/off_t.h"
+
+struct thread;
+struct file;
+struct inode;
 
 struct mmape
 {
   mapid_t mid;
   void *uaddr;
-  size_t filesize;
+  size_t length;
+  struct inode *inode_ptr;  /* Kept open until unmapped, NULL if anonymous */
   struct list_elem list_elem;
 };
 
-void mmap_init      (struct list *list_ptr);
-bool mmap_add_entry (struct list *list_ptr, 
-                     mapid_t mid, 
-                     void *uaddr, 
-                     size_t filesize);
+void    mmap_init      (struct list *list_ptr);
+mapid_t mmap_create    (struct file *file_ptr,
+                        void **uaddr_ptr,
+                        off_t offset,
+                        size_t length,
+                        int flags);
+bool    mmap_add_entry (struct list *list_ptr, 
+                        mapid_t mid, 
+                        void *uaddr, 
+                        size_t length,
+                        struct inode *inode_ptr);
+bool    mmap_fork      (struct thread *parent_ptr);
 
 void          mmap_remove_entry (mapid_t mid);
 void          mmap_remove_all   (struct list *list_ptr);
@@ -0,0 +1,88 @@
+#include "vm/pagein.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/ft.h"
+
+/* Asynchronous page in.
+
+   A fault on a file page that follows a resident one is taken to be
+   part of a sequential scan, and ft_readahead gives the pages after
+   it frames straight away, owned by the faulting process but not yet
+   mapped. Their reads are queued here and done by a daemon thread,
+   so that the faulting thread returns to user mode after reading
+   just its own page. The frames are in transit until their read is
+   done, so a fault on one of them, or its owner exiting, waits for
+   the read rather than starting another. */
+
+#define PAGEIN_QUEUE 64
+
+/* Frames waiting to be read, oldest first, protected by ft_lock */
+static struct fte *pagein_queue[PAGEIN_QUEUE];
+static size_t queue_head;
+static size_t queue_cnt;
+
+static struct semaphore pagein_wakeup;
+
+/* Statistics. */
+static long long pagein_cnt;
+
+static void pagein_daemon (void *aux UNUSED);
+
+/* Starts the page in daemon. Must be called before any user process
+   runs. */
+void
+pagein_init (void)
+{
+  sema_init (&pagein_wakeup, 0);
+  if (thread_create ("pageind", PRI_DEFAULT, pagein_daemon, NULL) 
+      == TID_ERROR)
+      PANIC ("Could not start the page in daemon");
+}
+
+/* Returns true if another frame may be queued. ft_lock must be held. */
+bool
+pagein_has_room (void)
+{
+  return queue_cnt < PAGEIN_QUEUE;
+}
+
+/* Queues FTE_PTR, which must be paging in, to be read by the daemon.
+   ft_lock must be held. */
+void
+pagein_submit (struct fte *fte_ptr)
+{
+  ASSERT (fte_ptr->transit == PAGING_IN);
+  ASSERT (pagein_has_room ());
+
+  pagein_queue[(queue_head + queue_cnt++) % PAGEIN_QUEUE] = fte_ptr;
+  pagein_cnt++;
+  sema_up (&pagein_wakeup);
+}
+
+/* Prints page in statistics. */
+void
+pagein_print_stats (void)
+{
+  printf ("Pagein: %lld file pages read ahead\n", pagein_cnt);
+}
+
+static void
+pagein_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&pagein_wakeup);
+
+      acquire_ft ();
+      while (queue_cnt > 0)
+        {
+          struct fte *fte_ptr = pagein_queue[queue_head];
+          queue_head = (queue_head + 1) % PAGEIN_QUEUE;
+          queue_cnt--;
+          ft_finish_readahead (fte_ptr);
+        }
+      release_ft ();
+    }
+}
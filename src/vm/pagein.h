@@ -0,0 +1,15 @@
+#ifndef VM_PAGEIN_H
+#define VM_PAGEIN_H
+
+#include <stdbool.h>
+#include "vm/ft.h"
+
+/* File pages read ahead of a sequential fault */
+#define PAGEIN_READAHEAD 16
+
+void pagein_init        (void);
+bool pagein_has_room    (void);
+void pagein_submit      (struct fte *fte_ptr);
+void pagein_print_stats (void);
+
+#endif
@@ -0,0 +1,191 @@
+#include "vm/pff.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "vm/ft.h"
+
+/* Page fault frequency working sets.
+
+   Each process is charged with the resident frames it owns as its
+   resident set size (RSS), and has an allowance of frames. Faults
+   that bring a page in are counted, and once per PFF_WINDOW the
+   process's fault rate is worked out: above PFF_HIGH its allowance
+   grows into the frames other processes do not hold, and below
+   PFF_LOW it shrinks, by a quarter each time. Eviction takes the
+   unreferenced frames of processes over their allowance before it
+   turns to the replacement policy, so a process that faults faster
+   than its allowance can grow loses its own pages rather than the
+   working sets of processes that fit theirs.
+
+   A process started with exec_limit also has a hard limit on its
+   RSS, and evicts one of its own frames for each it takes beyond it.
+
+   All of this is protected by ft_lock. */
+
+/* Ticks over which fault rates are measured */
+#define PFF_WINDOW (TIMER_FREQ / 4)
+
+/* Faults per second above which an allowance grows, and below which it
+   shrinks */
+#define PFF_HIGH 100
+#define PFF_LOW  10
+
+/* The allowance a process starts with, and the least it is left with */
+#define PFF_MIN_ALLOWANCE 16
+
+bool pff_report;
+
+/* Frames charged to all processes, shared ones once for each owner */
+static size_t total_rss;
+
+/* Processes over their allowance */
+static int over_cnt;
+
+/* Statistics. */
+static long long raise_cnt;
+static long long lower_cnt;
+static long long trim_cnt;
+static long long limit_cnt;
+
+static void set_allowance (struct thread *t_ptr, size_t allowance);
+
+/* Starts T_PTR, a new thread, with the least allowance and the hard
+   limit the creating thread asked for with exec_limit, if any */
+void
+pff_init_thread (struct thread *t_ptr)
+{
+  t_ptr->rss               = 0;
+  t_ptr->rss_peak          = 0;
+  t_ptr->rss_allowance     = PFF_MIN_ALLOWANCE;
+  t_ptr->rss_limit         = thread_current ()->exec_rss_limit;
+  t_ptr->exec_rss_limit    = 0;
+  t_ptr->pff_window_start  = timer_ticks ();
+  t_ptr->pff_window_faults = 0;
+  t_ptr->pff_rate          = 0;
+}
+
+/* Adds DELTA frames to the RSS of T_PTR, as it gains or loses an owned
+   frame or one of its frames comes in or goes out of memory */
+void
+pff_charge (struct thread *t_ptr, int delta)
+{
+  bool was_over = pff_over_allowance (t_ptr);
+
+  ASSERT (delta >= 0 || t_ptr->rss >= (size_t) -delta);
+  t_ptr->rss += delta;
+  total_rss  += delta;
+  if (t_ptr->rss > t_ptr->rss_peak)
+      t_ptr->rss_peak = t_ptr->rss;
+
+  over_cnt += pff_over_allowance (t_ptr) - was_over;
+}
+
+/* Counts a fault of the current thread that brought a page in, and at
+   the end of a window adjusts its allowance to its fault rate */
+void
+pff_fault (void)
+{
+  struct thread *t_ptr = thread_current ();
+  int64_t elapsed = timer_elapsed (t_ptr->pff_window_start);
+
+  t_ptr->pff_window_faults++;
+  if (elapsed < PFF_WINDOW)
+      return;
+
+  t_ptr->pff_rate = t_ptr->pff_window_faults * TIMER_FREQ / elapsed;
+  t_ptr->pff_window_faults = 0;
+  t_ptr->pff_window_start += elapsed;
+
+  size_t allowance = t_ptr->rss_allowance;
+  size_t step = allowance / 4;
+  if (t_ptr->pff_rate > PFF_HIGH)
+    {
+      /* Grow from whichever is larger, so that a process that has just
+         started catches up with the pages it is faulting in */
+      size_t others = total_rss - t_ptr->rss;
+      size_t room = frame_cnt > others ? frame_cnt - others : 0;
+      allowance = (allowance > t_ptr->rss ? allowance : t_ptr->rss) + step;
+      if (allowance > room)
+          allowance = room;
+      if (t_ptr->rss_limit != 0 && allowance > t_ptr->rss_limit)
+          allowance = t_ptr->rss_limit;
+      if (allowance > t_ptr->rss_allowance)
+        {
+          set_allowance (t_ptr, allowance);
+          raise_cnt++;
+        }
+    }
+  else if (t_ptr->pff_rate < PFF_LOW && allowance > PFF_MIN_ALLOWANCE)
+    {
+      allowance -= step;
+      set_allowance (t_ptr, allowance > PFF_MIN_ALLOWANCE 
+                                ? allowance : PFF_MIN_ALLOWANCE);
+      lower_cnt++;
+    }
+}
+
+/* Returns true if T_PTR holds more frames than its allowance */
+bool
+pff_over_allowance (const struct thread *t_ptr)
+{
+  return t_ptr->rss > t_ptr->rss_allowance;
+}
+
+/* Returns true if any process holds more frames than its allowance, and
+   so has frames to give up before the replacement policy is asked */
+bool
+pff_any_over (void)
+{
+  return over_cnt > 0;
+}
+
+/* Returns true if T_PTR may take PAGE_CNT more frames under its hard
+   limit */
+bool
+pff_has_room (const struct thread *t_ptr, size_t page_cnt)
+{
+  return t_ptr->rss_limit == 0 || t_ptr->rss + page_cnt <= t_ptr->rss_limit;
+}
+
+/* Counts a frame evicted from a process over its allowance, or, if HARD,
+   at its hard limit */
+void
+pff_count_trim (bool hard)
+{
+  if (hard)
+      limit_cnt++;
+  else
+      trim_cnt++;
+}
+
+/* Prints the resident set of the current thread, which is exiting, if
+   -pff was given and it is a user process */
+void
+pff_report_exit (void)
+{
+  struct thread *t_ptr = thread_current ();
+
+  if (!pff_report || t_ptr->pagedir == NULL)
+      return;
+  printf ("%s: rss %zu, peak %zu, allowance %zu, %d faults/s\n",
+          t_ptr->name, t_ptr->rss, t_ptr->rss_peak, t_ptr->rss_allowance,
+          t_ptr->pff_rate);
+}
+
+/* Prints statistics */
+void
+pff_print_stats (void)
+{
+  printf ("PFF: %lld allowances raised, %lld lowered, "
+          "%lld frames trimmed, %lld evicted at hard limits\n",
+          raise_cnt, lower_cnt, trim_cnt, limit_cnt);
+}
+
+static void
+set_allowance (struct thread *t_ptr, size_t allowance)
+{
+  bool was_over = pff_over_allowance (t_ptr);
+  t_ptr->rss_allowance = allowance;
+  over_cnt += pff_over_allowance (t_ptr) - was_over;
+}
@@ -0,0 +1,21 @@
+#ifndef VM_PFF_H
+#define VM_PFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/thread.h"
+
+/* Set by -pff to print each process's resident set as it exits */
+extern bool pff_report;
+
+void pff_init_thread    (struct thread *t_ptr);
+void pff_charge         (struct thread *t_ptr, int delta);
+void pff_fault          (void);
+bool pff_over_allowance (const struct thread *t_ptr);
+bool pff_any_over       (void);
+bool pff_has_room       (const struct thread *t_ptr, size_t page_cnt);
+void pff_count_trim     (bool hard);
+void pff_report_exit    (void);
+void pff_print_stats    (void);
+
+#endif
@@ -0,0 +1,124 @@
+#include "vm/pin.h"
+#include <debug.h>
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "vm/ft.h"
+#include "vm/spt.h"
+
+/* Pinning of user buffers for system calls.
+
+   A buffer a system call reads or writes has its frames pinned for the
+   call, so that the kernel does not fault on it while holding locks and
+   the frames are not evicted under I/O. Most pages of a buffer are
+   usually mapped already, and those are pinned together under one hold
+   of ft_lock. Only the pages that are not, or are mapped read only when
+   they are to be written, go through the page fault handler, which
+   leaves them pinned.
+
+   Each page whose frame the call pinned is marked in its SPT entry, and
+   only those frames are unpinned afterwards. Pins taken by anything else,
+   such as the page out daemons, are left alone. A process runs one
+   system call at a time, so one mark per entry is enough. */
+
+static bool pin_mapped_page (uint32_t *pd, void *upage, bool write);
+static void mark_pinned     (struct spte *spte_ptr);
+
+/* Pins the frames of the LENGTH bytes from ADDR in the current thread's
+   address space, faulting in any page that is not mapped as a WRITE, or
+   read, access needs, and records the pages in RANGE_PTR for
+   unpin_user_range. Returns false, having pinned nothing, if the bytes
+   are not all in user space. A page that cannot be faulted in kills the
+   process, as a fault on it would. */
+bool
+pin_user_range (const void *addr, size_t length, bool write,
+                struct pinned_range *range_ptr)
+{
+  struct thread *t_ptr = thread_current ();
+
+  if (addr == NULL || !is_user_vaddr (addr) ||
+      length > (uintptr_t) PHYS_BASE - (uintptr_t) addr)
+      return false;
+
+  void *start = pg_round_down (addr);
+  void *end   = pg_round_up (addr + length);
+  range_ptr->start    = start;
+  range_ptr->page_cnt = (end - start) / PGSIZE;
+
+  acquire_ft ();
+  for (void *upage = start; upage < end; upage += PGSIZE)
+    {
+      if (pin_mapped_page (t_ptr->pagedir, upage, write))
+          continue;
+
+      /* The first page is faulted on at ADDR itself, as a buffer on the
+         stack may start above the stack pointer in a page below it */
+      release_ft ();
+      page_fault_trigger (upage < addr ? addr : upage, t_ptr->esp, 
+                          true, write, true, true);
+      acquire_ft ();
+
+      /* The fault handler pinned the frame, if the page got one rather
+         than the zero frame */
+      struct spte *spte_ptr = spt_find_entry (t_ptr->spt_ptr, upage);
+      if (spte_ptr != NULL && spte_ptr->fte_ptr != NULL)
+          mark_pinned (spte_ptr);
+    }
+  release_ft ();
+  return true;
+}
+
+/* Unpins the frames that pin_user_range pinned for RANGE_PTR */
+void
+unpin_user_range (const struct pinned_range *range_ptr)
+{
+  struct spt *spt_ptr = thread_current ()->spt_ptr;
+  void *end = range_ptr->start + range_ptr->page_cnt * PGSIZE;
+
+  acquire_ft ();
+  for (struct spte *spte_ptr = spt_find_next (spt_ptr, range_ptr->start, end);
+       spte_ptr != NULL;
+       spte_ptr = spt_find_next (spt_ptr, spte_ptr->uaddr + PGSIZE, end))
+    {
+      if (!spte_ptr->pinned)
+          continue;
+
+      struct fte *fte_ptr = spte_ptr->fte_ptr;
+      ASSERT (fte_ptr != NULL && fte_ptr->pin_cnt > 0);
+      fte_ptr->pin_cnt--;
+      spte_ptr->pinned = false;
+    }
+  release_ft ();
+}
+
+/* Pins the frame of UPAGE if it is mapped, and writable if WRITE, with
+   ft_lock held. Returns false if it has to be faulted in instead. Pages
+   mapped to the zero frame have nothing to pin. */
+static bool
+pin_mapped_page (uint32_t *pd, void *upage, bool write)
+{
+  uint32_t *pte_ptr = lookup_page (pd, upage, false);
+  uint32_t needed   = write ? PTE_P | PTE_W : PTE_P;
+  if (pte_ptr == NULL || (*pte_ptr & needed) != needed)
+      return false;
+
+  struct spte *spte_ptr = spt_find_entry (thread_current ()->spt_ptr, upage);
+  ASSERT (spte_ptr != NULL);
+  if (spte_ptr->fte_ptr != NULL)
+    {
+      spte_ptr->fte_ptr->pin_cnt++;
+      mark_pinned (spte_ptr);
+    }
+  return true;
+}
+
+/* Records that the frame of SPTE_PTR's page was pinned for the current
+   system call */
+static void
+mark_pinned (struct spte *spte_ptr)
+{
+  ASSERT (!spte_ptr->pinned);
+  spte_ptr->pinned = true;
+}
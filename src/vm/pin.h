@@ -0,0 +1,18 @@
+#ifndef VM_PIN_H
+#define VM_PIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* User pages pinned for a system call by pin_user_range */
+struct pinned_range
+{
+  void *start;         /* First page */
+  size_t page_cnt;
+};
+
+bool pin_user_range   (const void *addr, size_t length, bool write,
+                       struct pinned_range *range_ptr);
+void unpin_user_range (const struct pinned_range *range_ptr);
+
+#endif
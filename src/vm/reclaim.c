@@ -0,0 +1,228 @@
+#include "vm/reclaim.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/highmem.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/evict.h"
+#include "vm/ft.h"
+
+/* Background page reclaim.
+
+   A daemon thread keeps the number of free user frames between a
+   low and a high watermark. Allocating a frame that leaves fewer
+   than low_wmark free wakes it, and it evicts in batches until
+   high_wmark are free, so faulting threads normally find a free
+   frame waiting and only evict for themselves (direct reclaim) if
+   the daemon falls behind.
+
+   When there is no demand the idle thread wakes the daemon, at
+   most once a tick, to launder dirty frames: write them back while
+   leaving them mapped, so that evicting them later needs no I/O.
+   The scheduler has no priorities, so this is how the laundering
+   is kept to otherwise idle time. */
+
+/* Frames evicted before the daemon lets other threads run. */
+#define RECLAIM_BATCH 16
+
+/* Frames laundered per wakeup, and frames looked at to find them. */
+#define LAUNDER_BATCH 4
+#define LAUNDER_SCAN  64
+
+/* The low watermark is this fraction of all user frames, but at least
+   RECLAIM_MIN_LOW frames. The high watermark is twice it. */
+#define RECLAIM_LOW_SHIFT 6
+#define RECLAIM_MIN_LOW   4
+
+static size_t low_wmark;
+static size_t high_wmark;
+
+static struct semaphore reclaim_wakeup;
+static bool reclaim_ready;
+
+/* Set when the daemon was woken to evict, protected by ft_lock. */
+static bool reclaim_wanted;
+
+/* Laundering state. The daemon stops being woken by the idle thread
+   once it has looked at every frame without finding a dirty one,
+   until the next frame is allocated. */
+static size_t launder_cursor;
+static size_t launder_clean_run;
+static bool launder_pending;
+static int64_t last_idle_wakeup;
+
+/* Statistics. */
+static long long daemon_evict_cnt;
+static long long direct_evict_cnt;
+static long long launder_cnt;
+
+static void reclaim_daemon (void *aux UNUSED);
+static void reclaim_to_high (void);
+static void launder_frames (void);
+
+/* Works out the watermarks from the frames free at boot and starts the
+   reclaim daemon. Must be called before any user process runs. */
+void
+reclaim_init (void)
+{
+  size_t frame_cnt = reclaim_free_frames ();
+
+  low_wmark = frame_cnt >> RECLAIM_LOW_SHIFT;
+  if (low_wmark < RECLAIM_MIN_LOW)
+      low_wmark = RECLAIM_MIN_LOW;
+  if (low_wmark > frame_cnt / 4)
+      low_wmark = frame_cnt / 4;
+  high_wmark = 2 * low_wmark;
+
+  sema_init (&reclaim_wakeup, 0);
+  if (thread_create ("reclaimd", PRI_DEFAULT, reclaim_daemon, NULL) 
+      == TID_ERROR)
+      PANIC ("Could not start the reclaim daemon");
+  reclaim_ready = true;
+}
+
+/* Returns the number of frames a user page could be given right now
+   without evicting. */
+size_t
+reclaim_free_frames (void)
+{
+  return highmem_free_page_cnt () + palloc_user_free_pages ();
+}
+
+/* Returns true if frames can be spent on work nobody has asked for yet,
+   such as reading ahead, without pushing free frames below the low
+   watermark. */
+bool
+reclaim_has_spare (void)
+{
+  return reclaim_free_frames () > low_wmark;
+}
+
+/* Called with ft_lock held after a frame is allocated. Wakes the daemon
+   if free frames are below the low watermark. */
+void
+reclaim_poke (void)
+{
+  if (!reclaim_ready)
+      return;
+
+  launder_pending = true;
+  if (!reclaim_wanted && reclaim_free_frames () < low_wmark)
+    {
+      reclaim_wanted = true;
+      sema_up (&reclaim_wakeup);
+    }
+}
+
+/* Called by the idle thread, which must not block. Wakes the daemon to
+   launder frames if it may find any. */
+void
+reclaim_idle (void)
+{
+  int64_t now = timer_ticks ();
+
+  if (!reclaim_ready || !launder_pending || now == last_idle_wakeup)
+      return;
+  last_idle_wakeup = now;
+  sema_up (&reclaim_wakeup);
+}
+
+/* Evicts a frame for a thread that found none free, with ft_lock held.
+   Returns false if there was nothing to evict. */
+bool
+reclaim_direct (void)
+{
+  if (!evict ())
+      return false;
+  direct_evict_cnt++;
+  return true;
+}
+
+/* Prints reclaim statistics. */
+void
+reclaim_print_stats (void)
+{
+  printf ("Reclaim: %lld frames evicted by daemon, %lld direct, "
+          "%lld laundered\n",
+          daemon_evict_cnt, direct_evict_cnt, launder_cnt);
+}
+
+static void
+reclaim_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&reclaim_wakeup);
+
+      acquire_ft ();
+      if (reclaim_wanted)
+          reclaim_to_high ();
+      launder_frames ();
+      release_ft ();
+    }
+}
+
+/* Evicts frames in batches until high_wmark are free. Gives up if there
+   is nothing left to evict, or if it has evicted high_wmark frames and
+   the kernel keeps taking them. ft_lock must be held, and is released
+   between batches. */
+static void
+reclaim_to_high (void)
+{
+  size_t evicted = 0;
+
+  while (reclaim_free_frames () < high_wmark && evicted < high_wmark)
+    {
+      for (int i = 0; i < RECLAIM_BATCH; i++, evicted++)
+        {
+          if (reclaim_free_frames () >= high_wmark)
+              break;
+          if (!evict ())
+              goto done;
+          daemon_evict_cnt++;
+        }
+
+      release_ft ();
+      thread_yield ();
+      acquire_ft ();
+    }
+
+  done: reclaim_wanted = false;
+}
+
+/* Writes back up to LAUNDER_BATCH dirty frames, continuing round the
+   frame descriptors from where the last call stopped. ft_lock must be
+   held, and is released for each write. */
+static void
+launder_frames (void)
+{
+  int laundered = 0;
+
+  for (int scanned = 0; 
+       scanned < LAUNDER_SCAN && laundered < LAUNDER_BATCH; 
+       scanned++)
+    {
+      struct fte *fte_ptr = frame_arr[launder_cursor].fte_ptr;
+      launder_cursor = (launder_cursor + 1) % frame_cnt;
+      launder_clean_run++;
+
+      /* Pinned frames are in transit or not installed yet */
+      if (fte_ptr == NULL || fte_ptr->pin_cnt > 0 || 
+          fte_ptr->eviction_method == DELETE || !frame_dirty (fte_ptr))
+          continue;
+
+      /* A frame that cannot be laundered, for want of swap, counts as
+         clean so that we do not keep coming back for it */
+      if (frame_launder (fte_ptr))
+        {
+          laundered++;
+          launder_cnt++;
+          launder_clean_run = 0;
+        }
+    }
+
+  if (launder_clean_run >= frame_cnt)
+      launder_pending = false;
+}
@@ -0,0 +1,15 @@
+#ifndef VM_RECLAIM_H
+#define VM_RECLAIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void   reclaim_init        (void);
+void   reclaim_poke        (void);
+void   reclaim_idle        (void);
+bool   reclaim_direct      (void);
+size_t reclaim_free_frames (void);
+bool   reclaim_has_spare   (void);
+void   reclaim_print_stats (void);
+
+#endif
@@ -1,58 +1,78 @@
 #include <debug.h>
-#include <hash.h>
+#include <round.h>
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 #include "vm/spt.h"
 #include "vm/ft.h"
+#include "vm/trace.h"
 
+/* The supplementary page table is a two level radix table indexed by
+   virtual page number, laid out like the x86 page directory. The top
+   PDBITS of an address pick a directory entry, which points to a
+   table of entries for the 4 MB the directory entry covers, and the
+   next PTBITS pick an entry in it. Both levels are a page each.
+   Tables are allocated when their first entry is added and freed
+   when their last is removed, so lookups cost two loads and the 4 MB
+   regions with nothing in them are skipped whole when walking a
+   range. As the tables are page aligned, the low bits of a directory
+   entry count the entries in its table, in the way a page directory
+   entry keeps its flags there. */
 
-/* SPT hashmap helpers */
-static unsigned spte_hash_func       (const struct hash_elem *e_ptr, 
-                                      void *aux UNUSED);
-static bool     spte_less_func       (const struct hash_elem *a_ptr,
-                                      const struct hash_elem *b_ptr,
-                                      void *aux UNUSED);
-static void     spte_deallocate_func (struct hash_elem *e_ptr, 
-                                      void *aux UNUSED);
+#define SPT_ENTRIES (1 << PTBITS)       /* Entries in a table */
+#define SPT_CNT_MASK PGMASK             /* Entry count in directory entries */
 
-static struct spte *spte_construct (void *uaddr,
-                                    enum frame_type frame_type,
-                                    struct inode *inode_ptr,
-                                    off_t offset,
-                                    int amount_occupied,
-                                    bool writable);
+struct spt
+{
+  uintptr_t dir[1 << PDBITS];
+};
+
+static struct spte **spt_table (const struct spt *spt_ptr, const void *uaddr);
+static struct spte **spt_slot       (struct spt *spt_ptr, void *uaddr);
+static void          spt_clear_slot (struct spt *spt_ptr, void *uaddr);
+
+static struct spte *spte_construct  (void *uaddr,
+                                     enum frame_type frame_type,
+                                     struct inode *inode_ptr,
+                                     off_t offset,
+                                     int amount_occupied,
+                                     bool writable);
+static void         spte_deallocate (struct spt *spt_ptr,
+                                     struct spte *spte_ptr);
 
 
 /* Attempts to initialise the supplementary page table 
    Returns false if failed and true if succeeeded. */
 bool 
-spt_init (struct hash **spt_ptr_ptr)
+spt_init (struct spt **spt_ptr_ptr)
 {
-  *spt_ptr_ptr = malloc (sizeof (struct hash));
-  if (*spt_ptr_ptr == NULL) return false;
+  ASSERT (sizeof (struct spt) == PGSIZE);
 
-  if (!hash_init (*spt_ptr_ptr, &spte_hash_func, &spte_less_func, NULL)) 
-    {
-      free (*spt_ptr_ptr);
-      return false;
-    }
-
-  return true;
+  *spt_ptr_ptr = palloc_get_page (PAL_ZERO);
+  return *spt_ptr_ptr != NULL;
 }
 
+/* Removes every entry, freeing their frames, and then the table itself.
+   ft_lock must be held. */
 void 
-spt_destroy (struct hash *spt_ptr)
+spt_destroy (struct spt *spt_ptr)
 {
   ASSERT (spt_ptr != NULL);
-  hash_destroy (spt_ptr, &spte_deallocate_func);
-  free (spt_ptr);
+  pagedir_batch_begin ();
+  spt_remove_range (spt_ptr, NULL, (uintptr_t) PHYS_BASE / PGSIZE);
+  pagedir_batch_end ();
+  palloc_free_page (spt_ptr);
 }
 
 /* Constructs supplementary page table entry and inserts it to given 
-   supplementary page table hashmap, returns NULL if spte memory allocation
-   fail */
+   supplementary page table, which must not have one for UADDR yet, 
+   returns NULL if spte memory allocation fail */
 struct spte *
-spt_add_entry (struct hash *spt_ptr,
+spt_add_entry (struct spt *spt_ptr,
                void *uaddr,
                enum frame_type frame_type,
                struct inode *inode_ptr,
@@ -60,47 +80,153 @@ spt_add_entry (struct hash *spt_ptr,
                int amount_occupied,
                bool writable)
 {
+  ASSERT (is_user_vaddr (uaddr));
+
   struct spte *spte_ptr = spte_construct (uaddr, frame_type, 
       inode_ptr, offset, amount_occupied, writable);
 
   if (spte_ptr == NULL) return NULL;
 
-  hash_insert (spt_ptr, &spte_ptr->hash_elem);
+  struct spte **slot_ptr = spt_slot (spt_ptr, uaddr);
+  if (slot_ptr == NULL) 
+    {
+      free (spte_ptr);
+      return NULL;
+    }
+  ASSERT (*slot_ptr == NULL);
 
+  *slot_ptr = spte_ptr;
+  spt_ptr->dir[pd_no (uaddr)]++;
   return spte_ptr;
 }
 
+/* Copies every entry of PARENT_PTR's supplementary page table into
+   SPT_PTR, sharing their frames as ft_fork_frame does. ft_lock must be
+   held. Returns false if memory allocation failed */
+bool
+spt_fork (struct spt *spt_ptr, struct thread *parent_ptr)
+{
+  struct spte *spte_ptr = spt_find_next (parent_ptr->spt_ptr, NULL, 
+                                         PHYS_BASE);
+  for (; spte_ptr != NULL; 
+       spte_ptr = spt_find_next (parent_ptr->spt_ptr, 
+                                 spte_ptr->uaddr + PGSIZE, PHYS_BASE))
+    {
+      struct spte *child_spte_ptr = spt_add_entry (spt_ptr, 
+          spte_ptr->uaddr, spte_ptr->frame_type, spte_ptr->inode_ptr, 
+          spte_ptr->offset, spte_ptr->amount_occupied, spte_ptr->writable);
+
+      if (child_spte_ptr == NULL || 
+          !ft_fork_frame (parent_ptr, spte_ptr, child_spte_ptr))
+          return false;
+      child_spte_ptr->advice = spte_ptr->advice;
+    }
+
+  return true;
+}
+
 /* Finds and removes a supplementary page table entry at uaddr, freeing 
    associated memory.
    Returns true on success, and fale if entry not found */
 bool
-spt_propagate_removal (struct hash *spt_ptr, void *uaddr)
+spt_propagate_removal (struct spt *spt_ptr, void *uaddr)
 {
   struct spte *spte_ptr = spt_find_entry (spt_ptr, uaddr);
+  if (spte_ptr == NULL) return false;
 
-  if (spte_ptr == NULL || 
-      hash_delete (spt_ptr, &spte_ptr->hash_elem) == NULL) return false;
+  spte_deallocate (spt_ptr, spte_ptr);
+  return true;
+}
 
-  spte_deallocate_func (&spte_ptr->hash_elem, NULL);
+/* Removes the entries of the PAGE_CNT pages from UADDR, in address 
+   order, freeing associated memory. Regions without tables are skipped
+   whole. ft_lock must be held. */
+void
+spt_remove_range (struct spt *spt_ptr, void *uaddr, size_t page_cnt)
+{
+  void *end = uaddr + page_cnt * PGSIZE;
+  struct spte *spte_ptr;
 
-  return true;
+  while ((spte_ptr = spt_find_next (spt_ptr, uaddr, end)) != NULL)
+    {
+      uaddr = spte_ptr->uaddr + PGSIZE;
+      spte_deallocate (spt_ptr, spte_ptr);
+    }
 }
 
 /* Attempts to find supplementary page table entry, returns NULL if not
    present */
 struct spte *
-spt_find_entry (struct hash *spt_ptr, void *uaddr)
+spt_find_entry (struct spt *spt_ptr, void *uaddr)
 {
-  /* Create fake supplementary page table entry to search by */
-  struct spte spte;
-  spte.uaddr = uaddr;
+  struct spte **table = spt_table (spt_ptr, uaddr);
+  return table == NULL ? NULL : table[pt_no (uaddr)];
+}
 
-  /* Attempt to locate entry */
-  struct hash_elem *hash_elem_ptr = hash_find (spt_ptr, &spte.hash_elem);
+/* Returns the entry with the lowest address at or above UADDR and below
+   END, or NULL if there is none */
+struct spte *
+spt_find_next (struct spt *spt_ptr, void *uaddr, void *end)
+{
+  uintptr_t page = (uintptr_t) uaddr / PGSIZE;
+  uintptr_t end_page = (uintptr_t) pg_round_up (end) / PGSIZE;
 
-  /* Return NULL on failure or the surrounding struct spte on success */
-  if (hash_elem_ptr == NULL) return NULL;
-  return hash_entry (hash_elem_ptr, struct spte, hash_elem);
+  while (page < end_page)
+    {
+      struct spte **table = spt_table (spt_ptr, (void *) (page * PGSIZE));
+      uintptr_t table_end = ROUND_DOWN (page + SPT_ENTRIES, SPT_ENTRIES);
+      if (table_end > end_page)
+          table_end = end_page;
+
+      if (table != NULL)
+          for (; page < table_end; page++)
+              if (table[page % SPT_ENTRIES] != NULL)
+                  return table[page % SPT_ENTRIES];
+      page = table_end;
+    }
+  return NULL;
+}
+
+/* Returns the table covering UADDR, or NULL if it has none */
+static struct spte **
+spt_table (const struct spt *spt_ptr, const void *uaddr)
+{
+  return (struct spte **) (spt_ptr->dir[pd_no (uaddr)] & ~SPT_CNT_MASK);
+}
+
+/* Returns the slot for UADDR's entry, allocating its table if it does not
+   exist yet. Returns NULL if that allocation fails. */
+static struct spte **
+spt_slot (struct spt *spt_ptr, void *uaddr)
+{
+  struct spte **table = spt_table (spt_ptr, uaddr);
+
+  if (table == NULL)
+    {
+      if ((table = palloc_get_page (PAL_ZERO)) == NULL)
+          return NULL;
+      spt_ptr->dir[pd_no (uaddr)] = (uintptr_t) table;
+    }
+  return &table[pt_no (uaddr)];
+}
+
+/* Empties the slot of UADDR's entry, which must be in use, freeing its
+   table if that was the last entry in it */
+static void
+spt_clear_slot (struct spt *spt_ptr, void *uaddr)
+{
+  uintptr_t *pde_ptr  = &spt_ptr->dir[pd_no (uaddr)];
+  struct spte **table = spt_table (spt_ptr, uaddr);
+
+  ASSERT (table != NULL && table[pt_no (uaddr)] != NULL);
+  ASSERT ((*pde_ptr & SPT_CNT_MASK) > 0);
+
+  table[pt_no (uaddr)] = NULL;
+  if ((--*pde_ptr & SPT_CNT_MASK) == 0)
+    {
+      *pde_ptr = 0;
+      palloc_free_page (table);
+    }
 }
 
 /* Constructs a supplmental page table entry, returns NULL
@@ -123,37 +249,35 @@ spte_construct (void *uaddr,
   spte_ptr->offset          = offset;
   spte_ptr->amount_occupied = amount_occupied;
   spte_ptr->writable        = writable;
+  spte_ptr->zero_mapped     = false;
+  spte_ptr->pinned          = false;
+  spte_ptr->advice          = MADV_NORMAL;
 
   return spte_ptr;
 }
 
-static unsigned
-spte_hash_func (const struct hash_elem *e_ptr, void *aux UNUSED)
-{
-  return (unsigned) hash_entry (e_ptr, struct spte, hash_elem)->uaddr;
-}
-
-static bool 
-spte_less_func (const struct hash_elem *a_ptr,
-                const struct hash_elem *b_ptr,
-                void *aux UNUSED) 
-{
-  return hash_entry (a_ptr, struct spte, hash_elem)->uaddr <
-         hash_entry (b_ptr, struct spte, hash_elem)->uaddr;
-}
-
+/* Takes an entry out of SPT_PTR and frees it, and its frame if no other
+   process shares it. The slot is only cleared once the frame has settled
+   and this page is off its owner list, since eviction looks the entry up
+   through that list while ft_stable_frame waits. */
 static void
-spte_deallocate_func (struct hash_elem *e_ptr, void *aux UNUSED)
+spte_deallocate (struct spt *spt_ptr, struct spte *spte_ptr)
 {
-  struct spte *spte_ptr = hash_entry (e_ptr, struct spte, hash_elem);
+  if (spte_ptr->zero_mapped)
+      ft_unmap_zero_page (spte_ptr);
 
-  /* if the page is in the frame table
-     the frame is removed from memory/swap space inside of ft_remove_frame */
-  if (spte_ptr->fte_ptr != NULL) 
+  /* if the page is in the frame table the frame is removed from 
+     memory/swap space inside of ft_remove_frame_if_necessary, once any 
+     paging in or out of it has finished */
+  struct fte *fte_ptr = ft_stable_frame (spte_ptr);
+  if (fte_ptr != NULL) 
     {
-      struct owner original_owner = ft_remove_owner (spte_ptr->fte_ptr);
-      ft_remove_frame_if_necessary (spte_ptr->fte_ptr, original_owner);
-    } 
+      trace_free (fte_ptr);
+      ft_remove_owner (fte_ptr, spte_ptr->uaddr);
+    }
+  spt_clear_slot (spt_ptr, spte_ptr->uaddr);
 
+  if (fte_ptr != NULL)
+      ft_remove_frame_if_necessary (fte_ptr);
   free (spte_ptr);
 }
@@ -3,12 +3,16 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <hash.h>
+#include <stddef.h>
 
 #include "filesys/off_t.h"
 #include "filesys/file.h"
 #include "filesys/inode.h"
 
+struct thread;
+struct spt;
+
+/* Counted by vmstat() in this order, see enum vmstat_page */
 enum frame_type
 {
   STACK,
@@ -18,25 +22,37 @@ enum frame_type
   MMAP
 };
 
+/* Entries are packed into 24 bytes, as a large mapping has one for every
+   page */
 struct spte
 {
   void *uaddr;
   struct fte *fte_ptr;
-  enum frame_type frame_type;
   struct inode *inode_ptr;
   off_t offset;
-  int amount_occupied;
+  int amount_occupied : 16;         /* At most PGSIZE */
+  enum frame_type frame_type : 8;
+  int advice : 8;           /* MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL */
   bool writable;
-  struct hash_elem hash_elem;
+  bool zero_mapped;         /* Mapped read only to the shared zero frame */
+  bool pinned;              /* Frame pinned by pin_user_range */
 };
 
 #include "vm/ft.h"
 
-bool         spt_init              (struct hash **spt_ptr_ptr);
-void         spt_destroy           (struct hash *spt_ptr);
-bool         spt_propagate_removal (struct hash *spt_ptr, void *uaddr);
-struct spte *spt_find_entry        (struct hash *spt_ptr, void *uaddr);
-struct spte *spt_add_entry         (struct hash *spt_ptr,
+bool         spt_init              (struct spt **spt_ptr_ptr);
+void         spt_destroy           (struct spt *spt_ptr);
+bool         spt_fork              (struct spt *spt_ptr, 
+                                    struct thread *parent_ptr);
+bool         spt_propagate_removal (struct spt *spt_ptr, void *uaddr);
+void         spt_remove_range      (struct spt *spt_ptr, 
+                                    void *uaddr, 
+                                    size_t page_cnt);
+struct spte *spt_find_entry        (struct spt *spt_ptr, void *uaddr);
+struct spte *spt_find_next         (struct spt *spt_ptr, 
+                                    void *uaddr, 
+                                    void *end);
+struct spte *spt_add_entry         (struct spt *spt_ptr,
                                     void *uaddr,
                                     enum frame_type frame_type,
                                     struct inode *inode_ptr,
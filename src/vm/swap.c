@@ -1,7 +1,11 @@
 #include "vm/swap.h"
 #include <stdio.h>
+#include <string.h>
 #include "vm/spt.h"
+#include "vm/zswap.h"
 #include "threads/synch.h"
+#include "threads/vmalloc.h"
+#include "threads/highmem.h"
 #include "threads/vaddr.h"
 #include "lib/kernel/bitmap.h"
 
@@ -10,68 +14,273 @@ static bool find_free_slot (block_sector_t *sector_ptr);
 struct block *swap_device;
 static struct bitmap *swap_bitmap;  
 static struct lock swap_lock;
+static size_t slot_used_cnt;        /* Slots claimed, by swap_lock */
+
+/* The fte whose page each slot holds, for reading ahead. Set with ft_lock
+   held, and cleared before the slot is freed. */
+static struct fte **slot_fte;
+
+/* Statistics */
+static long long readahead_cnt;
+static long long readahead_hit_cnt;
+static long long write_avoided_cnt;
+static long long zero_cnt;
 
 /* Initializes the swap disk */
 void
 swap_init (void)
 {
   swap_device = block_get_role (BLOCK_SWAP);
-  swap_bitmap = bitmap_create (block_size (swap_device) / SECTORS_PER_PAGE);
+  /* The bitmap grows with the swap device, so keep it in vmalloc space
+     rather than needing contiguous pages for it. */
+  size_t slot_cnt = block_size (swap_device) / SECTORS_PER_PAGE;
+  size_t bm_size  = bitmap_buf_size (slot_cnt);
+  void *bm_buf    = vmalloc (bm_size);
+  swap_bitmap = bm_buf != NULL 
+                    ? bitmap_create_in_buf (slot_cnt, bm_buf, bm_size) 
+                    : NULL;
+  slot_fte = vmalloc (slot_cnt * sizeof *slot_fte);
   printf ("Swap slots: %d\n", block_size (swap_device));
 
-  if (swap_bitmap == NULL)
+  if (swap_bitmap == NULL || slot_fte == NULL)
       PANIC ("Memory allocation for swap bitmap failed--Swap device is too large");
+  memset (slot_fte, 0, slot_cnt * sizeof *slot_fte);
 
   lock_init (&swap_lock);
+  zswap_init (slot_cnt);
 }
 
-/* Swaps in the page from the swap table into the memory */
-void
-swap_in (struct fte *fte_ptr, void *kpage)
+/* Reads the page in swap slot SWAP_INDEX into the frame at FRAME_PADDR.
+   The page comes from the compressed tier if it is there, and from the
+   swap device otherwise. May do block I/O, so ft_lock should not be held.
+
+   A page read from the device keeps its slot, so that if it is evicted
+   again before being written to it needs no write. Returns true if the
+   slot was kept, and false if it was freed: pages from the compressed
+   tier are cheap to store again, and their copies would take up memory,
+   and slots are not kept while swap is nearly full. */
+bool
+swap_in (int swap_index, uintptr_t frame_paddr)
 {
-  ASSERT (fte_ptr != NULL);
-  ASSERT (fte_ptr->swapped);
+  if (zswap_load (swap_index, frame_paddr))
+    {
+      swap_release (swap_index);
+      return false;
+    }
 
-  block_sector_t sector  = fte_ptr->loc.swap_index * SECTORS_PER_PAGE;
+  block_sector_t sector  = swap_index * SECTORS_PER_PAGE;
+  void *kpage            = kmap (frame_paddr);
   void *kpage_write_head = kpage;
 
   for (int i = 0; i < SECTORS_PER_PAGE; i++, sector++, 
                                         kpage_write_head += BLOCK_SECTOR_SIZE)
       block_read (swap_device, sector, kpage_write_head);
+  kunmap (kpage);
 
-  bitmap_reset (swap_bitmap, fte_ptr->loc.swap_index);
-  
-  fte_ptr->swapped = false;
-  fte_ptr->loc.frame_ptr = kpage;
+  if (swap_nearly_full ())
+    {
+      swap_release (swap_index);
+      return false;
+    }
+  return true;
 }
 
-/* Swaps out the evicted page from the frame and copy into the swap disk */
-void
-swap_out (struct fte *fte_ptr)
+/* Returns true if more than 3/4 of the swap slots are in use */
+bool
+swap_nearly_full (void)
 {
-  ASSERT (fte_ptr != NULL);
-  
-  block_sector_t sector;
-  void *kpage = fte_ptr->loc.frame_ptr;
+  return slot_used_cnt > swap_slot_cnt () / 4 * 3;
+}
+
+/* Writes the frame at FRAME_PADDR to a free swap slot and returns the slot.
+   Does block I/O, so ft_lock should not be held. */
+int
+swap_out (uintptr_t frame_paddr)
+{
+  int swap_index = swap_reserve ();
   
-  if (!find_free_slot (&sector))
+  if (swap_index < 0)
     PANIC ("No swap space available");
   
-  fte_ptr->swapped = true;
-  fte_ptr->loc.swap_index = sector / SECTORS_PER_PAGE;
+  swap_write (swap_index, frame_paddr);
+  return swap_index;
+}
+
+/* Claims a free swap slot without writing to it, returning -1 if swap is
+   full. */
+int
+swap_reserve (void)
+{
+  block_sector_t sector;
+
+  if (!find_free_slot (&sector))
+      return -1;
+  return sector / SECTORS_PER_PAGE;
+}
+
+/* Writes the frame at FRAME_PADDR to the claimed swap slot SWAP_INDEX,
+   overwriting whatever it held. The page is kept compressed in memory if
+   it compresses well and the tier has room. May do block I/O, so ft_lock
+   should not be held. */
+void
+swap_write (int swap_index, uintptr_t frame_paddr)
+{
+  if (!zswap_store (swap_index, frame_paddr))
+      swap_write_device (swap_index, frame_paddr);
+}
+
+/* Writes the page at FRAME_PADDR to slot SWAP_INDEX on the swap device
+   itself. */
+void
+swap_write_device (int swap_index, uintptr_t frame_paddr)
+{
+  block_sector_t sector = swap_index * SECTORS_PER_PAGE;
+  void *kpage           = kmap (frame_paddr);
+  void *kpage_read_head = kpage;
  
-  for (int i = 0; i < SECTORS_PER_PAGE; i++, sector++, kpage += BLOCK_SECTOR_SIZE)
-      block_write (swap_device, sector, kpage);
+  for (int i = 0; i < SECTORS_PER_PAGE; i++, sector++, 
+                                        kpage_read_head += BLOCK_SECTOR_SIZE)
+      block_write (swap_device, sector, kpage_read_head);
+  kunmap (kpage);
 }
 
-/* Resets the bit corresponding to the fte in the swap bitmap. */
+/* Frees swap slot SWAP_INDEX without reading it. If the compressed tier
+   is writing the slot back, it is freed once that is done instead. */
 void
-swap_remove (struct fte *fte_ptr)
+swap_release (int swap_index)
 {
-	ASSERT (fte_ptr != NULL);
 	lock_acquire (&swap_lock);
-	bitmap_reset (swap_bitmap, fte_ptr->loc.swap_index);
+	ASSERT (bitmap_test (swap_bitmap, swap_index));
+	slot_fte[swap_index] = NULL;
 	lock_release (&swap_lock);
+
+	if (zswap_invalidate (swap_index))
+	    swap_free (swap_index);
+}
+
+/* Returns swap slot SWAP_INDEX to the free slots */
+void
+swap_free (int swap_index)
+{
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_bitmap, swap_index));
+	bitmap_reset (swap_bitmap, swap_index);
+	slot_used_cnt--;
+	lock_release (&swap_lock);
+}
+
+/* Hands out the next slot of a process's cluster [*NEXT_PTR, *END_PTR), 
+   reserving a new cluster of SWAP_CLUSTER contiguous slots when that is
+   used up, so that pages the process has swapped out one after another
+   lie next to each other for swap_in to read ahead. Falls back to a lone
+   slot if there is no run that long free. Returns -1 if swap is full. */
+int
+swap_alloc_clustered (int *next_ptr, int *end_ptr)
+{
+  if (*next_ptr < *end_ptr)
+      return (*next_ptr)++;
+
+  lock_acquire (&swap_lock);
+  size_t first = bitmap_scan_and_flip (swap_bitmap, 0, SWAP_CLUSTER, false);
+  if (first != BITMAP_ERROR)
+      slot_used_cnt += SWAP_CLUSTER;
+  lock_release (&swap_lock);
+
+  if (first == BITMAP_ERROR)
+      return swap_reserve ();
+
+  *next_ptr = first + 1;
+  *end_ptr  = first + SWAP_CLUSTER;
+  return first;
+}
+
+/* Frees the slots of a cluster [NEXT, END) that were never handed out */
+void
+swap_release_cluster (int next, int end)
+{
+  for (; next < end; next++)
+      swap_release (next);
+}
+
+/* Returns the number of swap slots */
+size_t
+swap_slot_cnt (void)
+{
+  return bitmap_size (swap_bitmap);
+}
+
+/* Returns the number of swap slots claimed, including those reserved in
+   clusters but not yet written */
+size_t
+swap_slots_used (void)
+{
+  return slot_used_cnt;
+}
+
+/* Returns the fte whose page is in slot SWAP_INDEX, if it is recorded,
+   and NULL otherwise. ft_lock must be held. */
+struct fte *
+swap_slot_fte (int swap_index)
+{
+  return slot_fte[swap_index];
+}
+
+/* Records that slot SWAP_INDEX holds the page of FTE_PTR. ft_lock must be
+   held. */
+void
+swap_set_slot_fte (int swap_index, struct fte *fte_ptr)
+{
+  slot_fte[swap_index] = fte_ptr;
+}
+
+/* Counts a page read ahead, and a fault that found one */
+void
+swap_count_readahead (bool hit)
+{
+  if (hit)
+      readahead_hit_cnt++;
+  else
+      readahead_cnt++;
+}
+
+/* Returns true if the page at FRAME_PADDR is all zeros */
+bool
+swap_page_is_zero (uintptr_t frame_paddr)
+{
+  const uint32_t *kpage = kmap (frame_paddr);
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *kpage; i++)
+      if (kpage[i] != 0)
+          break;
+  kunmap ((void *) kpage);
+  return i == PGSIZE / sizeof *kpage;
+}
+
+/* Counts a page of zeros swapped out without a slot */
+void
+swap_count_zero (void)
+{
+  zero_cnt++;
+}
+
+/* Counts an eviction that needed no write, as the page's slot still held
+   it */
+void
+swap_count_write_avoided (void)
+{
+  write_avoided_cnt++;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages read ahead, %lld of them used\n",
+          readahead_cnt, readahead_hit_cnt);
+  printf ("Swap: %lld writes avoided by slots kept for clean pages, "
+          "%lld by pages of zeros\n", write_avoided_cnt, zero_cnt);
+  zswap_print_stats ();
 }
 
 static bool
@@ -79,6 +288,8 @@ find_free_slot (block_sector_t *sector_ptr)
 {
     lock_acquire (&swap_lock);
     block_sector_t sector = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
+    if (sector != BITMAP_ERROR)
+        slot_used_cnt++;
     lock_release (&swap_lock);
 
     *sector_ptr = sector * SECTORS_PER_PAGE;
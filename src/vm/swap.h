@@ -6,9 +6,38 @@
 
 #define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 
-void swap_init   (void);
-void swap_in     (struct fte *fte_ptr, void *kpage);
-void swap_out    (struct fte *fte_ptr);
-void swap_remove (struct fte *fte_ptr);
+/* Slots reserved for a process at a time, and slots read ahead on a swap
+   in */
+#define SWAP_CLUSTER   16
+#define SWAP_READAHEAD 3
+
+/* Swap index of a page that was all zeros when swapped out, which is
+   kept in no slot */
+#define SWAP_ZERO -1
+
+void swap_init    (void);
+bool swap_in      (int swap_index, uintptr_t frame_paddr);
+int  swap_out     (uintptr_t frame_paddr);
+void swap_release (int swap_index);
+int  swap_reserve (void);
+void swap_write   (int swap_index, uintptr_t frame_paddr);
+
+void swap_write_device (int swap_index, uintptr_t frame_paddr);
+void swap_free         (int swap_index);
+
+int    swap_alloc_clustered (int *next_ptr, int *end_ptr);
+void   swap_release_cluster (int next, int end);
+size_t swap_slot_cnt        (void);
+size_t swap_slots_used      (void);
+bool   swap_nearly_full     (void);
+bool   swap_page_is_zero    (uintptr_t frame_paddr);
+
+struct fte *swap_slot_fte     (int swap_index);
+void        swap_set_slot_fte (int swap_index, struct fte *fte_ptr);
+
+void swap_count_readahead     (bool hit);
+void swap_count_write_avoided (void);
+void swap_count_zero          (void);
+void swap_print_stats         (void);
 
 #endif
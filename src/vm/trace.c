@@ -0,0 +1,165 @@
+#include "vm/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/evict.h"
+#include "vm/ft.h"
+#include "vm/reclaim.h"
+
+/* Ticks between samples of the accessed bits */
+#define TRACE_SAMPLE_TICKS 10
+
+#define RECS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (struct trace_rec))
+
+/* -vmtrace: Record a reference trace on the scratch device. */
+bool vm_trace;
+
+static struct block *trace_device;
+static struct lock trace_lock;
+static struct trace_rec trace_buf[RECS_PER_SECTOR];
+static uint32_t trace_rec_cnt;
+static block_sector_t trace_sector;
+static uint32_t trace_frame_cnt;
+static bool trace_full;
+
+static void trace_record (enum trace_type type, struct fte *fte_ptr);
+static uint32_t trace_page_id (struct fte *fte_ptr);
+static void trace_sampler (void *aux UNUSED);
+
+/* Starts tracing to the scratch device, if -vmtrace was given, along with
+   a thread to sample accessed bits. */
+void
+trace_init (void)
+{
+  if (!vm_trace)
+      return;
+
+  trace_device = block_get_role (BLOCK_SCRATCH);
+  if (trace_device == NULL)
+    {
+      printf ("vmtrace: no scratch device, not tracing\n");
+      vm_trace = false;
+      return;
+    }
+
+  lock_init (&trace_lock);
+  trace_sector    = 1;
+  trace_frame_cnt = reclaim_free_frames ();
+  printf ("vmtrace: tracing to %s\n", block_name (trace_device));
+
+  if (thread_create ("vmsampled", PRI_DEFAULT, trace_sampler, NULL) 
+      == TID_ERROR)
+      PANIC ("Could not start the accessed bit sampler");
+}
+
+/* Records that FTE_PTR was just installed by a page fault. ft_lock must be
+   held. */
+void
+trace_fault (struct fte *fte_ptr)
+{
+  trace_record (TRACE_FAULT, fte_ptr);
+}
+
+/* Records that FTE_PTR was found accessed. ft_lock must be held. */
+void
+trace_access (struct fte *fte_ptr)
+{
+  trace_record (TRACE_ACCESS, fte_ptr);
+}
+
+/* Records that FTE_PTR's owner is letting go of it, if it is the only
+   owner. ft_lock must be held. */
+void
+trace_free (struct fte *fte_ptr)
+{
+  if (fte_ptr->owners.cnt == 1)
+      trace_record (TRACE_FREE, fte_ptr);
+}
+
+/* Writes out what is left of the trace and the header. */
+void
+trace_finish (void)
+{
+  static uint8_t sector[BLOCK_SECTOR_SIZE];
+  struct trace_header *header = (struct trace_header *) sector;
+
+  if (!vm_trace)
+      return;
+
+  lock_acquire (&trace_lock);
+  if (!trace_full && trace_rec_cnt % RECS_PER_SECTOR != 0)
+      block_write (trace_device, trace_sector, trace_buf);
+
+  header->magic     = TRACE_MAGIC;
+  header->version   = TRACE_VERSION;
+  header->rec_cnt   = trace_rec_cnt;
+  header->frame_cnt = trace_frame_cnt;
+  block_write (trace_device, 0, sector);
+
+  printf ("vmtrace: %"PRIu32" records%s\n", trace_rec_cnt,
+          trace_full ? ", scratch device full" : "");
+  vm_trace = false;
+  lock_release (&trace_lock);
+}
+
+/* Appends a record, writing out the buffer a sector at a time. Records
+   past the end of the device are dropped. */
+static void
+trace_record (enum trace_type type, struct fte *fte_ptr)
+{
+  if (!vm_trace)
+      return;
+
+  lock_acquire (&trace_lock);
+  if (!trace_full)
+    {
+      struct trace_rec *rec_ptr = &trace_buf[trace_rec_cnt % RECS_PER_SECTOR];
+      rec_ptr->page = trace_page_id (fte_ptr);
+      rec_ptr->info = ((uint32_t) type << TRACE_TYPE_SHIFT) 
+                      | (timer_ticks () & TRACE_TICK_MASK);
+
+      if (++trace_rec_cnt % RECS_PER_SECTOR == 0)
+        {
+          block_write (trace_device, trace_sector++, trace_buf);
+          trace_full = trace_sector >= block_size (trace_device);
+        }
+    }
+  lock_release (&trace_lock);
+}
+
+/* Names the page in FTE_PTR as described in vm/trace.h */
+static uint32_t
+trace_page_id (struct fte *fte_ptr)
+{
+  if (fte_ptr->shareable)
+      return 0x80000000 
+             | (inode_get_inumber (fte_ptr->inode_ptr) & 0x7ff) << 20
+             | ((fte_ptr->offset / PGSIZE) & 0xfffff);
+
+  ASSERT (fte_ptr->owners.cnt == 1);
+  struct owner *owner_ptr = rmap_owner (&fte_ptr->owners, 0);
+  return (owner_ptr->owner_ptr->tid & 0x7ff) << 20 
+         | pg_no (owner_ptr->upage_ptr);
+}
+
+/* Samples accessed bits every TRACE_SAMPLE_TICKS while tracing */
+static void
+trace_sampler (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (TRACE_SAMPLE_TICKS);
+      if (!vm_trace)
+          continue;
+      acquire_ft ();
+      evict_sample_access ();
+      release_ft ();
+    }
+}
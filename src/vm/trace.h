@@ -0,0 +1,56 @@
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct fte;
+
+/* Page reference traces, written to the scratch device for
+   src/utils/vmsim to replay against other replacement policies.
+
+   Sector 0 holds a struct trace_header, which is only written by
+   trace_finish (). Records follow from sector 1, each naming a page
+   and saying what happened to it at which timer tick. The format is
+   also read by vmsim on the host, so this header stands alone. */
+
+#define TRACE_MAGIC   0x52544d56        /* "VMTR" */
+#define TRACE_VERSION 1
+
+struct trace_header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rec_cnt;           /* Records that follow */
+    uint32_t frame_cnt;         /* User frames free at boot */
+  };
+
+/* Record types, in the top two bits of info */
+enum trace_type
+  {
+    TRACE_FAULT = 1,            /* Page brought in by a fault */
+    TRACE_ACCESS = 2,           /* Resident page found accessed */
+    TRACE_FREE = 3              /* Page's last owner let go of it */
+  };
+
+#define TRACE_TYPE_SHIFT 30
+#define TRACE_TICK_MASK ((1u << TRACE_TYPE_SHIFT) - 1)
+
+/* Private pages are named by owner tid and page number, file pages
+   that can be shared by inode number and page offset, with the top
+   bit set. */
+struct trace_rec
+  {
+    uint32_t page;
+    uint32_t info;              /* Type and low bits of timer tick */
+  };
+
+extern bool vm_trace;
+
+void trace_init   (void);
+void trace_fault  (struct fte *fte_ptr);
+void trace_access (struct fte *fte_ptr);
+void trace_free   (struct fte *fte_ptr);
+void trace_finish (void);
+
+#endif
@@ -0,0 +1,375 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Per-process memory regions.
+
+   Each process keeps its regions in an AA tree, a balanced binary
+   search tree, ordered by start address, so that finding the region
+   of a faulting address, checking a new mapping for overlap and
+   finding a gap for one all take time logarithmic in the number of
+   regions, whatever their size. Creating a region costs the same for
+   one page as for a million: a page's supplemental page table entry
+   is only made, by vma_get_entry, when the page is first faulted or
+   otherwise needed, so the page table holds entries for the pages
+   that have been used, and removing a region only has those to free.
+
+   Only the owning thread looks at or changes its regions. */
+
+static struct vma *vma_below  (struct vma *node, const void *uaddr);
+static struct vma *vma_above  (struct vma *node, const void *uaddr);
+static struct vma *vma_insert (struct vma *node, struct vma *vma_ptr);
+static struct vma *vma_delete (struct vma *node, const void *start);
+static struct vma *vma_fix    (struct vma *node);
+static struct vma *vma_skew   (struct vma *node);
+static struct vma *vma_split  (struct vma *node);
+static int         vma_level  (const struct vma *node);
+static bool        vma_clone  (const struct vma *node, struct vma **copy_ptr);
+static void        vma_free   (struct vma *node);
+
+/* Adds a region of PAGE_CNT pages from START, which must not overlap any
+   other, to the current thread. Callers check with vma_range_free when
+   the range comes from user input. Its first READ_BYTES bytes are read from
+   INODE_PTR from OFFSET, and the rest are zeros. Returns false if memory
+   allocation failed */
+bool
+vma_add (void *start, 
+         size_t page_cnt, 
+         enum frame_type frame_type,
+         struct inode *inode_ptr, 
+         off_t offset, 
+         off_t read_bytes,
+         bool writable)
+{
+  struct thread *t_ptr = thread_current ();
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (vma_range_free (start, page_cnt));
+
+  struct vma *vma_ptr = malloc (sizeof (struct vma));
+  if (vma_ptr == NULL) return false;
+
+  vma_ptr->start      = start;
+  vma_ptr->end        = start + page_cnt * PGSIZE;
+  vma_ptr->frame_type = frame_type;
+  vma_ptr->inode_ptr  = inode_ptr;
+  vma_ptr->offset     = offset;
+  vma_ptr->read_bytes = read_bytes;
+  vma_ptr->writable   = writable;
+  t_ptr->vma_root     = vma_insert (t_ptr->vma_root, vma_ptr);
+
+  return true;
+}
+
+/* Removes and frees the current thread's region that starts at START. Its
+   pages' supplemental page table entries are left for the caller. */
+void
+vma_remove (void *start)
+{
+  struct thread *t_ptr = thread_current ();
+  struct vma *vma_ptr  = vma_find (start);
+
+  ASSERT (vma_ptr != NULL && vma_ptr->start == start);
+  t_ptr->vma_root = vma_delete (t_ptr->vma_root, start);
+  free (vma_ptr);
+}
+
+/* Returns the current thread's region that UADDR is in, or NULL */
+struct vma *
+vma_find (const void *uaddr)
+{
+  struct vma *vma_ptr = vma_below (thread_current ()->vma_root, 
+                                   pg_round_down (uaddr) + PGSIZE);
+  return vma_ptr != NULL && uaddr < vma_ptr->end ? vma_ptr : NULL;
+}
+
+/* Returns true if none of the PAGE_CNT pages from START is in a region */
+bool
+vma_range_free (void *start, size_t page_cnt)
+{
+  struct vma *vma_ptr = vma_below (thread_current ()->vma_root, 
+                                   start + page_cnt * PGSIZE);
+  return vma_ptr == NULL || vma_ptr->end <= start;
+}
+
+/* Finds the highest run of PAGE_CNT pages outside any region that ends at
+   or below LIMIT, which must be page aligned, stepping down past each
+   region in the way. Page 0 is never handed out. Returns the start of the
+   run, or NULL if there is none. */
+void *
+vma_find_free (void *limit, size_t page_cnt)
+{
+  struct vma *root = thread_current ()->vma_root;
+  void *end = limit;
+
+  for (;;)
+    {
+      if (page_cnt == 0 || (uintptr_t) end / PGSIZE <= page_cnt)
+          return NULL;
+
+      void *start = end - page_cnt * PGSIZE;
+      struct vma *vma_ptr = vma_below (root, end);
+      if (vma_ptr == NULL || vma_ptr->end <= start)
+          return start;
+      end = vma_ptr->start;
+    }
+}
+
+/* Grows the current thread's stack region down to UPAGE, if UPAGE is 
+   below it and no other region is in the way. Returns false if it could
+   not. */
+bool
+vma_grow_stack (void *upage)
+{
+  struct vma *stack_ptr = vma_above (thread_current ()->vma_root, upage);
+
+  if (stack_ptr == NULL || stack_ptr->frame_type != STACK ||
+      !vma_range_free (upage, (stack_ptr->start - upage) / PGSIZE))
+      return false;
+
+  /* Nothing lies between, so the region keeps its place in the tree */
+  stack_ptr->start = upage;
+  return true;
+}
+
+/* Returns the current thread's supplemental page table entry for UPAGE,
+   making it from UPAGE's region if it has none yet. Returns NULL if UPAGE
+   is in no region, or memory allocation failed */
+struct spte *
+vma_get_entry (void *upage)
+{
+  struct thread *t_ptr  = thread_current ();
+  struct spte *spte_ptr = spt_find_entry (t_ptr->spt_ptr, upage);
+  if (spte_ptr != NULL) return spte_ptr;
+
+  struct vma *vma_ptr = vma_find (upage);
+  if (vma_ptr == NULL) return NULL;
+
+  /* A page of an executable or private mapping with nothing to read is
+     zeros, and is first mapped to the shared zero frame. Pages past the
+     end of a shared mapping's file stay with the file. */
+  off_t page_offset   = upage - vma_ptr->start;
+  off_t left          = vma_ptr->read_bytes - page_offset;
+  int amount_occupied = left <= 0 ? 0 : left < PGSIZE ? left : PGSIZE;
+  enum frame_type frame_type = vma_ptr->frame_type;
+  if (amount_occupied == 0 && 
+      (frame_type == EXECUTABLE_CODE || frame_type == EXECUTABLE_DATA))
+      frame_type = ALL_ZERO;
+
+  if (frame_type == STACK || frame_type == ALL_ZERO)
+      return spt_add_entry (t_ptr->spt_ptr, upage, frame_type, NULL, 0,
+                            frame_type == STACK ? PGSIZE : 0, 
+                            vma_ptr->writable);
+
+  return spt_add_entry (t_ptr->spt_ptr, upage, frame_type, 
+                        vma_ptr->inode_ptr, vma_ptr->offset + page_offset,
+                        amount_occupied, vma_ptr->writable);
+}
+
+/* Gives the current thread, a child forked from PARENT_PTR, a copy of its
+   parent's regions. Returns false if memory allocation failed, leaving
+   the regions copied so far for vma_destroy. */
+bool
+vma_fork (struct thread *parent_ptr)
+{
+  return vma_clone (parent_ptr->vma_root, &thread_current ()->vma_root);
+}
+
+/* Frees all of the current thread's regions */
+void
+vma_destroy (void)
+{
+  struct thread *t_ptr = thread_current ();
+
+  vma_free (t_ptr->vma_root);
+  t_ptr->vma_root = NULL;
+}
+
+/* Returns the region under NODE with the highest start below UADDR */
+static struct vma *
+vma_below (struct vma *node, const void *uaddr)
+{
+  struct vma *best = NULL;
+
+  while (node != NULL)
+    {
+      if (node->start < uaddr)
+        {
+          best = node;
+          node = node->right;
+        }
+      else
+          node = node->left;
+    }
+  return best;
+}
+
+/* Returns the region under NODE with the lowest start above UADDR */
+static struct vma *
+vma_above (struct vma *node, const void *uaddr)
+{
+  struct vma *best = NULL;
+
+  while (node != NULL)
+    {
+      if (node->start > uaddr)
+        {
+          best = node;
+          node = node->left;
+        }
+      else
+          node = node->right;
+    }
+  return best;
+}
+
+/* Inserts VMA_PTR into the tree under NODE, returning its new root */
+static struct vma *
+vma_insert (struct vma *node, struct vma *vma_ptr)
+{
+  if (node == NULL)
+    {
+      vma_ptr->left  = NULL;
+      vma_ptr->right = NULL;
+      vma_ptr->level = 1;
+      return vma_ptr;
+    }
+
+  if (vma_ptr->start < node->start)
+      node->left = vma_insert (node->left, vma_ptr);
+  else
+      node->right = vma_insert (node->right, vma_ptr);
+  return vma_split (vma_skew (node));
+}
+
+/* Unlinks the region starting at START from the tree under NODE, without
+   freeing it, returning the tree's new root. A region with children is
+   replaced by its neighbour in order, which is unlinked from below it. */
+static struct vma *
+vma_delete (struct vma *node, const void *start)
+{
+  if (node == NULL)
+      return NULL;
+
+  if (start < node->start)
+      node->left = vma_delete (node->left, start);
+  else if (start > node->start)
+      node->right = vma_delete (node->right, start);
+  else if (node->left == NULL && node->right == NULL)
+      return NULL;
+  else if (node->left == NULL)
+    {
+      struct vma *next = node->right;
+      while (next->left != NULL)
+          next = next->left;
+      next->right = vma_delete (node->right, next->start);
+      next->left  = NULL;
+      next->level = node->level;
+      node = next;
+    }
+  else
+    {
+      struct vma *prev = node->left;
+      while (prev->right != NULL)
+          prev = prev->right;
+      prev->left  = vma_delete (node->left, prev->start);
+      prev->right = node->right;
+      prev->level = node->level;
+      node = prev;
+    }
+
+  return vma_fix (node);
+}
+
+/* Restores the AA tree levels under NODE after a deletion below it */
+static struct vma *
+vma_fix (struct vma *node)
+{
+  int left_level  = vma_level (node->left);
+  int right_level = vma_level (node->right);
+  int level = (left_level < right_level ? left_level : right_level) + 1;
+
+  if (level < node->level)
+    {
+      node->level = level;
+      if (level < right_level)
+          node->right->level = level;
+    }
+
+  node = vma_skew (node);
+  node->right = vma_skew (node->right);
+  if (node->right != NULL)
+      node->right->right = vma_skew (node->right->right);
+  node = vma_split (node);
+  node->right = vma_split (node->right);
+  return node;
+}
+
+/* Rotates right if NODE's left child is on its level */
+static struct vma *
+vma_skew (struct vma *node)
+{
+  if (node == NULL || node->left == NULL || node->left->level != node->level)
+      return node;
+
+  struct vma *left = node->left;
+  node->left  = left->right;
+  left->right = node;
+  return left;
+}
+
+/* Rotates left, raising the new root a level, if NODE has two right
+   children in a row on its level */
+static struct vma *
+vma_split (struct vma *node)
+{
+  if (node == NULL || node->right == NULL || node->right->right == NULL ||
+      node->right->right->level != node->level)
+      return node;
+
+  struct vma *right = node->right;
+  node->right = right->left;
+  right->left = node;
+  right->level++;
+  return right;
+}
+
+static int
+vma_level (const struct vma *node)
+{
+  return node == NULL ? 0 : node->level;
+}
+
+/* Copies the tree under NODE into *COPY_PTR. Returns false if memory 
+   allocation failed, leaving the nodes copied so far linked in. */
+static bool
+vma_clone (const struct vma *node, struct vma **copy_ptr)
+{
+  *copy_ptr = NULL;
+  if (node == NULL)
+      return true;
+
+  struct vma *copy = malloc (sizeof (struct vma));
+  if (copy == NULL)
+      return false;
+
+  *copy = *node;
+  copy->left = copy->right = NULL;
+  *copy_ptr = copy;
+  return vma_clone (node->left, &copy->left) && 
+         vma_clone (node->right, &copy->right);
+}
+
+/* Frees every region under NODE */
+static void
+vma_free (struct vma *node)
+{
+  if (node == NULL)
+      return;
+
+  vma_free (node->left);
+  vma_free (node->right);
+  free (node);
+}
@@ -0,0 +1,44 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm/spt.h"
+
+struct thread;
+
+/* A region of a process's address space, such as an executable segment,
+   the stack or a mapping, whose pages are all backed in the same way.
+   Pages get supplemental page table entries from their region when they
+   are first needed. */
+struct vma
+{
+  void *start;                  /* First page */
+  void *end;                    /* Page after the last */
+  enum frame_type frame_type;
+  struct inode *inode_ptr;      /* Backing file, NULL if anonymous */
+  off_t offset;                 /* File offset of the first page */
+  off_t read_bytes;             /* Bytes read from the file, then zeros */
+  bool writable;
+  struct vma *left;             /* Tree of regions ordered by start */
+  struct vma *right;
+  int level;
+};
+
+bool         vma_add        (void *start, 
+                             size_t page_cnt, 
+                             enum frame_type frame_type,
+                             struct inode *inode_ptr, 
+                             off_t offset, 
+                             off_t read_bytes,
+                             bool writable);
+void         vma_remove     (void *start);
+struct vma  *vma_find       (const void *uaddr);
+bool         vma_range_free (void *start, size_t page_cnt);
+void        *vma_find_free  (void *limit, size_t page_cnt);
+bool         vma_grow_stack (void *upage);
+struct spte *vma_get_entry  (void *upage);
+bool         vma_fork       (struct thread *parent_ptr);
+void         vma_destroy    (void);
+
+#endif
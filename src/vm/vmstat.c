@@ -0,0 +1,230 @@
+#include "vm/vmstat.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "vm/swap.h"
+
+/* Virtual memory statistics.
+
+   Page faults that were resolved are counted by how, and by the kind
+   of page, with the time each took kept in a histogram for its class.
+   Evictions are counted by method, and waits for frames in I/O as pin
+   waits. All are printed at shutdown, and vmstat() takes a snapshot
+   of them for user programs. Faults are counted with interrupts off,
+   as they are resolved without ft_lock held; the rest are counted
+   with ft_lock held. */
+
+/* Latency histograms, in CPU cycles. Buckets are powers of two, each
+   split into LATENCY_SUBBUCKETS, so percentiles are good to within 25%.
+   Values below LATENCY_SUBBUCKETS get a bucket each. */
+#define LATENCY_SUBBUCKETS 4
+#define LATENCY_BUCKETS (64 * LATENCY_SUBBUCKETS)
+
+/* Histogram over all classes, for the percentile functions */
+#define ALL_FAULTS VMSTAT_FAULT_CNT
+
+static long long fault_cnt[VMSTAT_FAULT_CNT];
+static long long page_type_cnt[VMSTAT_PAGE_CNT];
+static long long evict_cnt[VMSTAT_EVICT_CNT];
+static long long pin_wait_cnt;
+
+static long long fault_latency[VMSTAT_FAULT_CNT][LATENCY_BUCKETS];
+static uint64_t fault_latency_max[VMSTAT_FAULT_CNT];
+
+static const char *fault_names[VMSTAT_FAULT_CNT] = 
+  {"minor", "file", "swap", "stack", "zero"};
+
+static int      latency_bucket       (uint64_t cycles);
+static uint64_t latency_bucket_floor (int bucket);
+static long long latency_bucket_cnt  (int fault, int bucket);
+static long long latency_cnt         (int fault);
+static uint64_t latency_max          (int fault);
+static uint64_t latency_percentile   (int fault, int percent);
+static void     print_latency        (const char *name, int fault);
+
+/* Counts a fault on a page of FRAME_TYPE, resolved as FAULT in CYCLES */
+void
+vmstat_count_fault (enum frame_type frame_type, enum vmstat_fault fault,
+                    uint64_t cycles)
+{
+  enum intr_level old_level = intr_disable ();
+  fault_cnt[fault]++;
+  page_type_cnt[frame_type]++;
+  fault_latency[fault][latency_bucket (cycles)]++;
+  if (cycles > fault_latency_max[fault])
+      fault_latency_max[fault] = cycles;
+  intr_set_level (old_level);
+}
+
+/* Counts the eviction of a frame by EVICTION_METHOD */
+void
+vmstat_count_evict (enum eviction_method eviction_method)
+{
+  evict_cnt[eviction_method]++;
+}
+
+/* Counts a wait for a frame to finish being paged in or out */
+void
+vmstat_count_pin_wait (void)
+{
+  pin_wait_cnt++;
+}
+
+/* Fills in STAT_PTR with the statistics so far */
+void
+vmstat_snapshot (struct vmstat *stat_ptr)
+{
+  memset (stat_ptr, 0, sizeof *stat_ptr);
+  stat_ptr->swap_slots_used = swap_slots_used ();
+  stat_ptr->swap_slot_cnt   = swap_slot_cnt ();
+
+  enum intr_level old_level = intr_disable ();
+  memcpy (stat_ptr->faults, fault_cnt, sizeof fault_cnt);
+  memcpy (stat_ptr->page_faults, page_type_cnt, sizeof page_type_cnt);
+  memcpy (stat_ptr->evictions, evict_cnt, sizeof evict_cnt);
+  stat_ptr->pin_waits = pin_wait_cnt;
+  for (int fault = 0; fault < VMSTAT_FAULT_CNT; fault++)
+    {
+      struct vmstat_latency *latency_ptr = &stat_ptr->latency[fault];
+      latency_ptr->cnt = latency_cnt (fault);
+      if (latency_ptr->cnt == 0)
+          continue;
+      latency_ptr->p50 = latency_percentile (fault, 50);
+      latency_ptr->p90 = latency_percentile (fault, 90);
+      latency_ptr->p99 = latency_percentile (fault, 99);
+      latency_ptr->max = fault_latency_max[fault];
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints statistics */
+void
+vmstat_print_stats (void)
+{
+  printf ("Page faults: %lld minor, %lld file, %lld swap, %lld stack, "
+          "%lld zero\n", fault_cnt[VMSTAT_FAULT_MINOR],
+          fault_cnt[VMSTAT_FAULT_FILE], fault_cnt[VMSTAT_FAULT_SWAP],
+          fault_cnt[VMSTAT_FAULT_STACK], fault_cnt[VMSTAT_FAULT_ZERO]);
+  printf ("Page faults: %lld stack, %lld code, %lld data, %lld zero, "
+          "%lld mmap pages\n", page_type_cnt[VMSTAT_PAGE_STACK],
+          page_type_cnt[VMSTAT_PAGE_CODE], page_type_cnt[VMSTAT_PAGE_DATA],
+          page_type_cnt[VMSTAT_PAGE_ZERO], page_type_cnt[VMSTAT_PAGE_MMAP]);
+  printf ("Evictions: %lld delete, %lld swap, %lld swap if dirty, "
+          "%lld write if dirty, %lld pin waits\n", 
+          evict_cnt[VMSTAT_EVICT_DELETE], evict_cnt[VMSTAT_EVICT_SWAP],
+          evict_cnt[VMSTAT_EVICT_SWAP_IF_DIRTY],
+          evict_cnt[VMSTAT_EVICT_WRITE_IF_DIRTY], pin_wait_cnt);
+  printf ("Swap: %zu of %zu slots in use\n", swap_slots_used (),
+          swap_slot_cnt ());
+
+  print_latency ("Page fault latency", ALL_FAULTS);
+  for (int fault = 0; fault < VMSTAT_FAULT_CNT; fault++)
+    {
+      char name[32];
+      snprintf (name, sizeof name, "Page fault latency (%s)", 
+                fault_names[fault]);
+      print_latency (name, fault);
+    }
+}
+
+/* Prints the percentiles of FAULT's latencies, or of all faults if it is
+   ALL_FAULTS, if there are any */
+static void
+print_latency (const char *name, int fault)
+{
+  long long cnt = latency_cnt (fault);
+  if (cnt == 0)
+      return;
+  printf ("%s: %lld loads, cycles p50 %"PRIu64" p90 %"PRIu64
+          " p99 %"PRIu64" max %"PRIu64"\n", name, cnt,
+          latency_percentile (fault, 50), latency_percentile (fault, 90),
+          latency_percentile (fault, 99), latency_max (fault));
+}
+
+/* Returns the latency histogram bucket for CYCLES. */
+static int
+latency_bucket (uint64_t cycles)
+{
+  uint32_t hi = cycles >> 32;
+  int msb;
+
+  if (cycles < LATENCY_SUBBUCKETS)
+    return cycles;
+  msb = hi != 0 ? 63 - __builtin_clz (hi) : 31 - __builtin_clz (cycles);
+  return msb * LATENCY_SUBBUCKETS + ((cycles >> (msb - 2)) & 3);
+}
+
+/* Returns the smallest latency that falls in histogram BUCKET. */
+static uint64_t
+latency_bucket_floor (int bucket)
+{
+  int msb = bucket / LATENCY_SUBBUCKETS;
+
+  if (bucket < LATENCY_SUBBUCKETS)
+    return bucket;
+  return (uint64_t) (LATENCY_SUBBUCKETS + bucket % LATENCY_SUBBUCKETS)
+         << (msb - 2);
+}
+
+/* Returns how many faults of class FAULT, or of all classes if it is
+   ALL_FAULTS, fell in histogram BUCKET */
+static long long
+latency_bucket_cnt (int fault, int bucket)
+{
+  long long cnt = 0;
+
+  if (fault != ALL_FAULTS)
+    return fault_latency[fault][bucket];
+  for (fault = 0; fault < VMSTAT_FAULT_CNT; fault++)
+    cnt += fault_latency[fault][bucket];
+  return cnt;
+}
+
+/* Returns the number of latencies recorded for FAULT, or for all faults
+   if it is ALL_FAULTS. */
+static long long
+latency_cnt (int fault)
+{
+  long long cnt = 0;
+
+  if (fault != ALL_FAULTS)
+    return fault_cnt[fault];
+  for (fault = 0; fault < VMSTAT_FAULT_CNT; fault++)
+    cnt += fault_cnt[fault];
+  return cnt;
+}
+
+/* Returns the longest latency recorded for FAULT, or for all faults if it
+   is ALL_FAULTS. */
+static uint64_t
+latency_max (int fault)
+{
+  uint64_t max = 0;
+
+  if (fault != ALL_FAULTS)
+    return fault_latency_max[fault];
+  for (fault = 0; fault < VMSTAT_FAULT_CNT; fault++)
+    if (fault_latency_max[fault] > max)
+      max = fault_latency_max[fault];
+  return max;
+}
+
+/* Returns the PERCENT'th percentile of the latencies recorded for FAULT,
+   or for all faults if it is ALL_FAULTS, rounded down to the start of its
+   histogram bucket. */
+static uint64_t
+latency_percentile (int fault, int percent)
+{
+  long long rank = (latency_cnt (fault) * percent + 99) / 100;
+  long long seen = 0;
+  int bucket;
+
+  for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+      seen += latency_bucket_cnt (fault, bucket);
+      if (seen >= rank)
+        break;
+    }
+  return latency_bucket_floor (bucket);
+}
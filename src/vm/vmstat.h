@@ -0,0 +1,16 @@
+#ifndef VM_VMSTAT_H
+#define VM_VMSTAT_H
+
+#include <stdint.h>
+#include "lib/user/syscall.h"
+#include "vm/ft.h"
+#include "vm/spt.h"
+
+void vmstat_count_fault    (enum frame_type frame_type, 
+                            enum vmstat_fault fault, uint64_t cycles);
+void vmstat_count_evict    (enum eviction_method eviction_method);
+void vmstat_count_pin_wait (void);
+void vmstat_snapshot       (struct vmstat *stat_ptr);
+void vmstat_print_stats    (void);
+
+#endif
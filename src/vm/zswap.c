@@ -0,0 +1,378 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/highmem.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+#include "vm/lz4.h"
+#include "vm/reclaim.h"
+#include "vm/swap.h"
+
+/* Compressed swap tier.
+
+   Pages written to a swap slot are first compressed with LZ4 and, if
+   they shrink to at most ZSWAP_MAX_SIZE bytes, kept in memory under
+   their slot number instead of going to the swap device. Reading the
+   slot back is then a decompression rather than a disk read. The
+   slot stays claimed on the device all the while, so a page can move
+   there at any time.
+
+   Compressed pages are kept in pool pages taken from the user pool,
+   each split into equal objects of one size class, a multiple of
+   ZSWAP_CLASS_SIZE. The pool may grow to zswap_percent of the user
+   frames free at boot. A page that needs a new pool page when the pool
+   is at that size goes to the device, and the least recently stored
+   compressed pages are written back to the device to make room for
+   later ones.
+
+   A page being written back stays in the pool until the write is done,
+   so it can still be loaded meanwhile. Releasing its slot then leaves
+   the slot claimed until the write is finished, and rewriting it waits
+   for the write, so a stale write back never lands over newer data. */
+
+#define ZSWAP_CLASS_SIZE      128
+#define ZSWAP_MAX_SIZE        (PGSIZE * 3 / 4)
+#define ZSWAP_CLASS_CNT       (ZSWAP_MAX_SIZE / ZSWAP_CLASS_SIZE)
+#define ZSWAP_WRITEBACK_BATCH 4
+
+int zswap_percent = 20;
+
+/* A pool page, split into objects of one size class */
+struct zpage
+  {
+    uint8_t *kpage;
+    int class;
+    uint32_t free_map;              /* Bit per object, set if free */
+    struct list_elem elem;          /* In partial, unless full */
+  };
+
+/* A compressed page */
+struct zentry
+  {
+    int swap_index;
+    struct zpage *zpage_ptr;
+    int obj;                        /* Object within zpage */
+    size_t size;                    /* Compressed size */
+    bool writing;                   /* Being written back */
+    bool released;                  /* Slot released while writing back */
+    struct list_elem lru_elem;      /* In lru, unless writing */
+  };
+
+static bool zswap_enabled;
+static struct lock zswap_lock;
+static struct zentry **slot_zentry;
+
+/* Pool pages with free objects, by size class */
+static struct list partial[ZSWAP_CLASS_CNT];
+static size_t pool_page_cnt;
+static size_t pool_page_max;
+
+/* Entries that are not being written back, least recently stored first */
+static struct list lru;
+
+/* Scratch space for compression, protected by zswap_lock */
+static uint8_t compress_buf[ZSWAP_MAX_SIZE];
+static uint16_t compress_work[LZ4_WORK_SIZE / sizeof (uint16_t)];
+
+/* Page written back from, and the lock serializing its use */
+static struct lock writeback_lock;
+static void *writeback_page;
+static struct condition writeback_done;
+
+/* Statistics */
+static long long store_cnt;
+static long long store_bytes;
+static long long incompressible_cnt;
+static long long pool_full_cnt;
+static long long load_hit_cnt;
+static long long load_miss_cnt;
+static long long writeback_cnt;
+static size_t pool_page_high;
+
+static struct zentry *entry_alloc (int swap_index, size_t size);
+static void entry_free (struct zentry *e_ptr);
+static void *entry_data (struct zentry *e_ptr);
+static bool writeback_one (void);
+
+/* Sets up the compressed tier for a swap device of SLOT_CNT slots. It is
+   left disabled if zswap_percent is 0 or memory is short. */
+void
+zswap_init (size_t slot_cnt)
+{
+  pool_page_max = reclaim_free_frames () * zswap_percent / 100;
+  if (pool_page_max == 0)
+      return;
+
+  slot_zentry    = vmalloc (slot_cnt * sizeof *slot_zentry);
+  writeback_page = palloc_get_page (0);
+  if (slot_zentry == NULL || writeback_page == NULL)
+    {
+      printf ("zswap: out of memory, compressed swap disabled\n");
+      return;
+    }
+  memset (slot_zentry, 0, slot_cnt * sizeof *slot_zentry);
+
+  for (int i = 0; i < ZSWAP_CLASS_CNT; i++)
+      list_init (&partial[i]);
+  list_init (&lru);
+  lock_init (&zswap_lock);
+  lock_init (&writeback_lock);
+  cond_init (&writeback_done);
+  zswap_enabled = true;
+}
+
+/* Compresses the page at FRAME_PADDR into the pool as the contents of 
+   slot SWAP_INDEX, replacing any it held before. Returns false if the
+   page must go to the swap device instead, because it does not compress
+   well enough or there is no room. */
+bool
+zswap_store (int swap_index, uintptr_t frame_paddr)
+{
+  if (!zswap_enabled)
+      return false;
+
+  struct zentry *e_ptr;
+  bool stored    = false;
+  bool pool_full = false;
+
+  lock_acquire (&zswap_lock);
+  while ((e_ptr = slot_zentry[swap_index]) != NULL && e_ptr->writing)
+      cond_wait (&writeback_done, &zswap_lock);
+  if (e_ptr != NULL)
+    {
+      list_remove (&e_ptr->lru_elem);
+      entry_free (e_ptr);
+    }
+
+  void *kpage = kmap (frame_paddr);
+  size_t size = lz4_compress (kpage, PGSIZE, compress_buf, ZSWAP_MAX_SIZE,
+                              compress_work);
+  kunmap (kpage);
+
+  if (size == 0)
+      incompressible_cnt++;
+  else if ((e_ptr = entry_alloc (swap_index, size)) == NULL)
+    {
+      pool_full_cnt++;
+      pool_full = true;
+    }
+  else
+    {
+      memcpy (entry_data (e_ptr), compress_buf, size);
+      list_push_back (&lru, &e_ptr->lru_elem);
+      store_cnt++;
+      store_bytes += size;
+      stored = true;
+    }
+  lock_release (&zswap_lock);
+
+  if (pool_full)
+      for (int i = 0; i < ZSWAP_WRITEBACK_BATCH; i++)
+          if (!writeback_one ())
+              break;
+  return stored;
+}
+
+/* Decompresses the contents of slot SWAP_INDEX into the frame at 
+   FRAME_PADDR. Returns false if they are not in the pool. */
+bool
+zswap_load (int swap_index, uintptr_t frame_paddr)
+{
+  if (!zswap_enabled)
+      return false;
+
+  lock_acquire (&zswap_lock);
+  struct zentry *e_ptr = slot_zentry[swap_index];
+  if (e_ptr == NULL)
+    {
+      load_miss_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  void *kpage = kmap (frame_paddr);
+  if (lz4_decompress (entry_data (e_ptr), e_ptr->size, kpage, PGSIZE) 
+      != PGSIZE)
+      PANIC ("zswap: slot %d is corrupt", swap_index);
+  kunmap (kpage);
+  load_hit_cnt++;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Drops the contents of slot SWAP_INDEX from the pool, as the slot is 
+   being released. Returns false if it is being written back, in which
+   case the write back frees the slot when it is done. */
+bool
+zswap_invalidate (int swap_index)
+{
+  if (!zswap_enabled)
+      return true;
+
+  bool free_now = true;
+
+  lock_acquire (&zswap_lock);
+  struct zentry *e_ptr = slot_zentry[swap_index];
+  if (e_ptr != NULL && e_ptr->writing)
+    {
+      e_ptr->released = true;
+      free_now = false;
+    }
+  else if (e_ptr != NULL)
+    {
+      list_remove (&e_ptr->lru_elem);
+      entry_free (e_ptr);
+    }
+  lock_release (&zswap_lock);
+  return free_now;
+}
+
+/* Prints compressed tier statistics */
+void
+zswap_print_stats (void)
+{
+  if (!zswap_enabled)
+      return;
+
+  long long ratio = store_bytes > 0 ? store_cnt * PGSIZE * 100 / store_bytes
+                                    : 0;
+  printf ("Zswap: %lld pages stored, %lld incompressible, %lld pool full, "
+          "%lld.%02lld:1 compression\n",
+          store_cnt, incompressible_cnt, pool_full_cnt, ratio / 100, 
+          ratio % 100);
+  printf ("Zswap: %lld of %lld loads from memory, %lld written back, "
+          "%zu of %zu pool pages used at most\n",
+          load_hit_cnt, load_hit_cnt + load_miss_cnt, writeback_cnt,
+          pool_page_high, pool_page_max);
+}
+
+/* Allocates an object for SIZE compressed bytes and an entry for it as
+   the contents of slot SWAP_INDEX. Returns NULL if the pool is at its
+   size limit or memory is short. zswap_lock must be held. */
+static struct zentry *
+entry_alloc (int swap_index, size_t size)
+{
+  int class       = (size - 1) / ZSWAP_CLASS_SIZE;
+  int obj_cnt     = PGSIZE / ((class + 1) * ZSWAP_CLASS_SIZE);
+  struct list *lp = &partial[class];
+  struct zpage *zp_ptr;
+
+  struct zentry *e_ptr = malloc (sizeof *e_ptr);
+  if (e_ptr == NULL)
+      return NULL;
+
+  if (list_empty (lp))
+    {
+      if (pool_page_cnt >= pool_page_max)
+          goto fail_1;
+      zp_ptr = malloc (sizeof *zp_ptr);
+      if (zp_ptr == NULL)
+          goto fail_1;
+      zp_ptr->kpage = palloc_get_page (PAL_USER);
+      if (zp_ptr->kpage == NULL)
+          goto fail_2;
+
+      zp_ptr->class    = class;
+      zp_ptr->free_map = obj_cnt == 32 ? 0xffffffff : (1u << obj_cnt) - 1;
+      list_push_back (lp, &zp_ptr->elem);
+      if (++pool_page_cnt > pool_page_high)
+          pool_page_high = pool_page_cnt;
+    }
+
+  zp_ptr = list_entry (list_front (lp), struct zpage, elem);
+  int obj = __builtin_ctz (zp_ptr->free_map);
+  zp_ptr->free_map &= ~(1u << obj);
+  if (zp_ptr->free_map == 0)
+      list_remove (&zp_ptr->elem);
+
+  e_ptr->swap_index = swap_index;
+  e_ptr->zpage_ptr  = zp_ptr;
+  e_ptr->obj        = obj;
+  e_ptr->size       = size;
+  e_ptr->writing    = false;
+  e_ptr->released   = false;
+  slot_zentry[swap_index] = e_ptr;
+  return e_ptr;
+
+  fail_2: free (zp_ptr);
+  fail_1: free (e_ptr);
+  return NULL;
+}
+
+/* Frees an entry, which must not be on lru, and its object, along with
+   the pool page if that is left empty. zswap_lock must be held. */
+static void
+entry_free (struct zentry *e_ptr)
+{
+  struct zpage *zp_ptr = e_ptr->zpage_ptr;
+  int obj_cnt = PGSIZE / ((zp_ptr->class + 1) * ZSWAP_CLASS_SIZE);
+  uint32_t all_free = obj_cnt == 32 ? 0xffffffff : (1u << obj_cnt) - 1;
+  bool was_full     = zp_ptr->free_map == 0;
+
+  zp_ptr->free_map |= 1u << e_ptr->obj;
+  if (zp_ptr->free_map == all_free)
+    {
+      if (!was_full)
+          list_remove (&zp_ptr->elem);
+      palloc_free_page (zp_ptr->kpage);
+      free (zp_ptr);
+      pool_page_cnt--;
+    }
+  else if (was_full)
+      list_push_back (&partial[zp_ptr->class], &zp_ptr->elem);
+
+  slot_zentry[e_ptr->swap_index] = NULL;
+  free (e_ptr);
+}
+
+/* Returns where an entry's compressed bytes are */
+static void *
+entry_data (struct zentry *e_ptr)
+{
+  struct zpage *zp_ptr = e_ptr->zpage_ptr;
+  return zp_ptr->kpage + e_ptr->obj * (zp_ptr->class + 1) * ZSWAP_CLASS_SIZE;
+}
+
+/* Writes the least recently stored page back to its slot on the swap
+   device and frees it from the pool. Returns false if the pool is
+   empty. Does block I/O without zswap_lock held. */
+static bool
+writeback_one (void)
+{
+  lock_acquire (&writeback_lock);
+  lock_acquire (&zswap_lock);
+  if (list_empty (&lru))
+    {
+      lock_release (&zswap_lock);
+      lock_release (&writeback_lock);
+      return false;
+    }
+
+  struct zentry *e_ptr = list_entry (list_pop_front (&lru), 
+                                     struct zentry, lru_elem);
+  e_ptr->writing = true;
+  if (lz4_decompress (entry_data (e_ptr), e_ptr->size, writeback_page, 
+                      PGSIZE) != PGSIZE)
+      PANIC ("zswap: slot %d is corrupt", e_ptr->swap_index);
+  lock_release (&zswap_lock);
+
+  swap_write_device (e_ptr->swap_index, vtop (writeback_page));
+
+  lock_acquire (&zswap_lock);
+  int swap_index = e_ptr->swap_index;
+  bool released  = e_ptr->released;
+  entry_free (e_ptr);
+  writeback_cnt++;
+  cond_broadcast (&writeback_done, &zswap_lock);
+  lock_release (&zswap_lock);
+  lock_release (&writeback_lock);
+
+  if (released)
+      swap_free (swap_index);
+  return true;
+}
@@ -0,0 +1,17 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Percentage of user frames the compressed tier may use, 0 for none */
+extern int zswap_percent;
+
+void zswap_init        (size_t slot_cnt);
+bool zswap_store       (int swap_index, uintptr_t frame_paddr);
+bool zswap_load        (int swap_index, uintptr_t frame_paddr);
+bool zswap_invalidate  (int swap_index);
+void zswap_print_stats (void);
+
+#endif